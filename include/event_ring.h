@@ -0,0 +1,245 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+
+
+// What EventRing::push() does when the ring is full
+enum class EventRingOverflow {
+    drop_newest,    // drop the event being pushed
+    drop_oldest,    // overwrite the oldest event not yet popped
+    coalesce_moves, // hold the latest move per contact until there is room;
+                    // other events overwrite the oldest
+};
+
+
+// Fixed-capacity single-producer/single-consumer event ring
+//
+// One context (an IRQ handler, the other core, or the main loop) calls
+// push() and flush(); one other context calls pop(). Neither ever blocks or
+// allocates. E needs a type field with E::Type::move and E::Type::up, and id
+// and predicted fields.
+//
+// Each slot has a sequence number so the producer can overwrite a slot the
+// consumer is looking at (drop_oldest); the consumer notices and skips ahead
+// instead of returning a torn event. Events come out in the order pushed,
+// except that under coalesce_moves a held move can come out after events for
+// other contacts pushed while it was held. Order per contact is kept.
+template <typename E, int N, int held_max = 5>
+class EventRing
+{
+public:
+
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+    using Overflow = EventRingOverflow;
+
+    EventRing() :
+        _head(0),
+        _tail(0),
+        _overflow(Overflow::drop_newest),
+        _held_cnt(0),
+        _dropped(0),
+        _coalesced(0),
+        _lost(0)
+    {
+        for (Slot &s : _slots)
+            s.seq.store(0, std::memory_order_relaxed);
+    }
+
+    static constexpr int capacity()
+    {
+        return N;
+    }
+
+    // producer
+
+    void set_overflow(Overflow overflow)
+    {
+        _overflow = overflow;
+    }
+
+    // Returns false if the event was dropped.
+    bool push(const E &event)
+    {
+        flush();
+
+        if (!full()) {
+            put(event);
+            return true;
+        }
+
+        switch (_overflow) {
+
+            case Overflow::drop_newest:
+                _dropped.store(_dropped.load(std::memory_order_relaxed) + 1,
+                               std::memory_order_relaxed);
+                return false;
+
+            case Overflow::coalesce_moves:
+                if (event.type == E::Type::move) {
+                    hold(event);
+                    return true;
+                }
+                // An up carries the final position, so a held move for the
+                // same contact is not needed.
+                if (event.type == E::Type::up)
+                    unhold(event.id);
+                put(event); // overwrite oldest
+                return true;
+
+            case Overflow::drop_oldest:
+            default:
+                put(event);
+                return true;
+
+        } // switch (_overflow)
+    }
+
+    // Push held moves if there is room now. push() does this first thing;
+    // call it when there is nothing new to push so held moves get out.
+    void flush()
+    {
+        int h = 0;
+        while (h < _held_cnt && !full())
+            put(_held[h++]);
+        if (h == 0)
+            return;
+        for (int i = h; i < _held_cnt; i++)
+            _held[i - h] = _held[i];
+        _held_cnt -= h;
+    }
+
+    // consumer
+
+    // Pop up to event_cnt_max events; returns the number popped.
+    int pop(E events[], int event_cnt_max)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        int cnt = 0;
+        while (cnt < event_cnt_max) {
+            uint32_t head = _head.load(std::memory_order_acquire);
+            if (tail == head)
+                break;
+            if (head - tail > uint32_t(N)) {
+                // producer lapped us (drop_oldest)
+                lost(head - N - tail);
+                tail = head - N;
+            }
+            Slot &s = _slots[tail % N];
+            uint32_t seq = s.seq.load(std::memory_order_acquire);
+            E event = s.event;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq != tail + 1 || s.seq.load(std::memory_order_relaxed) != seq)
+                continue; // overwritten while we looked; look at head again
+            events[cnt++] = event;
+            tail++;
+        }
+        _tail.store(tail, std::memory_order_release);
+        return cnt;
+    }
+
+    // either side
+
+    int size() const
+    {
+        uint32_t n = _head.load(std::memory_order_acquire) -
+                     _tail.load(std::memory_order_acquire);
+        return n > uint32_t(N) ? N : int(n);
+    }
+
+    // events dropped by push() or overwritten before pop() got them
+    uint32_t dropped() const
+    {
+        return _dropped.load(std::memory_order_relaxed) +
+               _lost.load(std::memory_order_relaxed);
+    }
+
+    // moves merged into a later move for the same contact
+    uint32_t coalesced() const
+    {
+        return _coalesced.load(std::memory_order_relaxed);
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<uint32_t> seq; // position + 1 when written, 0 while writing
+        E event;
+    };
+
+    Slot _slots[N];
+
+    std::atomic<uint32_t> _head; // next position to write (producer)
+    std::atomic<uint32_t> _tail; // next position to read (consumer)
+
+    // producer only
+    Overflow _overflow;
+    E _held[held_max];
+    int _held_cnt;
+
+    std::atomic<uint32_t> _dropped;   // producer writes
+    std::atomic<uint32_t> _coalesced; // producer writes
+    std::atomic<uint32_t> _lost;      // consumer writes
+
+    bool full() const
+    {
+        return _head.load(std::memory_order_relaxed) -
+                   _tail.load(std::memory_order_acquire) >=
+               uint32_t(N);
+    }
+
+    void put(const E &event)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        Slot &s = _slots[head % N];
+        s.seq.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.event = event;
+        s.seq.store(head + 1, std::memory_order_release);
+        _head.store(head + 1, std::memory_order_release);
+    }
+
+    void hold(const E &event)
+    {
+        for (int h = 0; h < _held_cnt; h++) {
+            if (_held[h].id == event.id) {
+                // a prediction never takes a real move's place
+                if (!event.predicted || _held[h].predicted)
+                    _held[h] = event;
+                _coalesced.store(
+                    _coalesced.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+                return;
+            }
+        }
+        if (_held_cnt < held_max) {
+            _held[_held_cnt++] = event;
+        } else {
+            _dropped.store(_dropped.load(std::memory_order_relaxed) + 1,
+                           std::memory_order_relaxed);
+        }
+    }
+
+    void unhold(int id)
+    {
+        for (int h = 0; h < _held_cnt; h++) {
+            if (_held[h].id == id) {
+                for (int i = h + 1; i < _held_cnt; i++)
+                    _held[i - 1] = _held[i];
+                _held_cnt--;
+                _coalesced.store(
+                    _coalesced.load(std::memory_order_relaxed) + 1,
+                    std::memory_order_relaxed);
+                return;
+            }
+        }
+    }
+
+    void lost(uint32_t cnt)
+    {
+        _lost.store(_lost.load(std::memory_order_relaxed) + cnt,
+                    std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Events collected between display frames, with moves merged
+//
+// add() appends an event, except that a move for a contact whose latest
+// event in the batch is also a move replaces that one (in its place, with
+// the new position and times). Downs and ups are always kept, so every
+// contact still goes down, moves and comes up in order; what is lost is
+// only the in-between positions. A predicted move only replaces a
+// predicted one, and a real move first takes out a predicted one before
+// it, so what is left is the latest real move and the latest prediction
+// after it. take() hands out the batch, oldest first. Not thread-safe:
+// add() and take() are for one context. E needs a type field with
+// E::Type::move, and id and predicted fields.
+template <typename E, int N>
+class FrameBatch
+{
+public:
+
+    FrameBatch() :
+        _cnt(0),
+        _coalesced(0)
+    {
+    }
+
+    static constexpr int capacity()
+    {
+        return N;
+    }
+
+    int size() const
+    {
+        return _cnt;
+    }
+
+    bool full() const
+    {
+        return _cnt >= N;
+    }
+
+    // Returns false (and drops the event) if it is not a merge and the
+    // batch is full.
+    bool add(const E &event)
+    {
+        if (event.type == E::Type::move) {
+            for (int i = _cnt - 1; i >= 0; i--) {
+                if (_events[i].id != event.id)
+                    continue;
+                if (_events[i].type != E::Type::move)
+                    break;
+                if (_events[i].predicted && !event.predicted) {
+                    remove(i); // replaced by the real thing
+                    _coalesced++;
+                    continue; // and maybe a real move before it
+                }
+                if (_events[i].predicted != event.predicted)
+                    break;
+                _events[i] = event;
+                _coalesced++;
+                return true;
+            }
+        }
+        if (full())
+            return false;
+        _events[_cnt++] = event;
+        return true;
+    }
+
+    // Take up to event_cnt_max events; the rest stay for the next take().
+    int take(E events[], int event_cnt_max)
+    {
+        int cnt = _cnt < event_cnt_max ? _cnt : event_cnt_max;
+        for (int i = 0; i < cnt; i++)
+            events[i] = _events[i];
+        for (int i = cnt; i < _cnt; i++)
+            _events[i - cnt] = _events[i];
+        _cnt -= cnt;
+        return cnt;
+    }
+
+    // moves merged into a later move for the same contact
+    uint32_t coalesced() const
+    {
+        return _coalesced;
+    }
+
+private:
+
+    E _events[N];
+    int _cnt;
+    uint32_t _coalesced;
+
+    void remove(int i)
+    {
+        for (_cnt--; i < _cnt; i++)
+            _events[i] = _events[i + 1];
+    }
+};
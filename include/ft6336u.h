@@ -4,8 +4,9 @@
 #include <cstdint>
 // pico
 #include "hardware/gpio.h"
-#include "hardware/i2c.h"
 #include "pico/stdlib.h"
+// misc
+#include "i2c_dev.h"
 // touchscreen
 #include "touchscreen.h"
 
@@ -15,32 +16,133 @@ class Ft6336u : public Touchscreen
 
 public:
 
-    Ft6336u(i2c_inst_t *i2c, int scl_pin, int sda_pin, int rst_pin, int int_pin,
-            int i2c_freq = 400'000);
+    // scl_pin and sda_pin are the ones i2c is using; init needs to hold
+    // them low while the FT6336U comes out of reset. width and height are
+    // the display's, in landscape. The FT6336U has no resolution register;
+    // the panel is taken to be the display in portrait until set_panel()
+    // says otherwise.
+    Ft6336u(I2cDev &i2c, int scl_pin, int sda_pin, int rst_pin, int int_pin,
+            int width = 480, int height = 320);
 
     virtual ~Ft6336u() = default;
 
+    // Reset and check IDs. This blocks for about 750 msec, mostly waiting
+    // for the FT6336U to come out of reset.
     bool init(int verbosity = 0);
 
-    uint i2c_freq() const
+    // Incremental init
+    // init_start() begins what init() does, then init_poll() carries it on
+    // one step at a time without ever blocking; call it from the main loop
+    // until it returns true, then check ready(). Before init_start() it
+    // returns false. The event engine does nothing until ready.
+    void init_start(int verbosity = 0);
+    bool init_poll();
+
+    bool ready() const
     {
-        return _i2c_freq;
+        return _init_state == InitState::ready;
     }
 
-    virtual void set_rotation(Rotation r) override;
-
-    virtual int get_touches(int *col, int *row, int touch_cnt_max,
+    // contacts have id, weight (as size), area and event flag
+    virtual int get_touches(Contact contacts[], int touch_cnt_max,
                             int verbosity = 0) override;
 
+    using Touchscreen::get_touches;
+
+    // Event state machine
+    // Like Gt911::get_event(), this always returns very quickly (no blocking
+    // on i2c). It reads TD_STATUS on the poll schedule (see
+    // Touchscreen::PollSched) or INT, and when there are touches, reads just
+    // the point registers needed for them.
     virtual Event get_event() override;
 
+    // Touch register reads (get_touches and get_event)
+    //
+    // TD_STATUS is read in one burst with the registers for as many points
+    // as recent reads have seen: 1 byte when idle, 7 with one touch, 13 with
+    // two. If there turn out to be more touches, the rest are read after.
+    //
+    // With predictive reads on, the burst stays at the most touches seen
+    // until all touches are gone, so a finger that drops out of a two-finger
+    // gesture for a frame or two does not cost a second read when it comes
+    // back. That only matters with two touches: it saves a transaction
+    // each time the count goes 1 -> 2, and costs 6 unneeded bytes on every
+    // read with one touch until all touches are gone. It pays off when the
+    // second touch flickers (host_bench trace=flicker: 15 fewer
+    // transactions, 7% fewer bits); for a steady pinch ending one finger
+    // at a time it reads slightly more bits. One-touch use sees no change.
+    void set_predictive_read(bool enable)
+    {
+        _predictive_read = enable;
+    }
+
+    // Tuning registers
+    //
+    // tuning_read() and tuning_write() get and set the registers below that
+    // trade report rate and sensitivity against current draw; tuning_write()
+    // refuses a period_active outside 3..14 msec, and reads the registers
+    // back and returns false if any did not take. Like
+    // Gt911::config_read(), both block (well under a msec) and return false
+    // without touching the bus if the event engine is partway through a
+    // read. Nothing survives a reset.
+    //
+    // With int_trigger and INT wired, get_event() stops polling and reads
+    // the touch registers on each INT pulse instead. Otherwise it polls once
+    // per active-mode report period.
+    struct Tuning {
+        uint8_t touch_thresh;   // TH_GROUP: lower is more sensitive
+        uint8_t filter_coef;    // TH_DIFF: position filter coefficient
+        bool monitor_auto;      // CTRL: drop to monitor mode when untouched
+        uint8_t monitor_wait_s; // TIMEENTERMONITOR: untouched this long
+        uint8_t period_active;  // PERIODACTIVE: report period, msec
+        uint8_t period_monitor; // PERIODMONITOR: scan period, msec
+        bool int_trigger;       // G_MODE: INT pulses per frame (else low
+                                //         while touched)
+    };
+
+    bool tuning_read(Tuning &tuning, int verbosity = 0);
+    bool tuning_write(const Tuning &tuning, int verbosity = 0);
+
+    // Profiles change only the timing and INT fields of the current tuning:
+    //   low_latency: fastest reports, never drops to monitor mode
+    //   balanced:    reset defaults, monitor mode after 30 sec untouched
+    //   low_power:   slowest reports, monitor mode after 2 sec untouched
+    // All of them use INT trigger mode, so with INT wired the bus is quiet
+    // while nothing is touched.
+    enum class Profile {
+        low_latency,
+        balanced,
+        low_power,
+    };
+
+    bool set_profile(Profile profile, int verbosity = 0);
+
+    static const char *profile_name(Profile profile);
+
     void dump();
 
+protected:
+
+    // get_event() with the coordinate map given (see Gt911::event_step)
+    template <typename Map>
+    Event event_step(const Map &map)
+    {
+        Event event; // default: type=none
+
+        // finish handing out events from the last read first
+        if (event_pop(event))
+            return event;
+
+        if (engine_step())
+            touch_event(event, map);
+        return event;
+    }
+
 private:
 
     static constexpr uint8_t i2c_adrs = 0x38;
 
-    i2c_inst_t *_i2c;
+    I2cDev &_i2c;
     const int _scl_pin;
     const int _sda_pin;
 
@@ -52,10 +154,29 @@ private:
     static constexpr bool int_assert = false; // assert low
     static constexpr bool int_deassert = true;
 
-    uint _i2c_freq;
-
     static constexpr uint32_t TRST_ms = 5;
 
+    // after reset, INT goes high in about int_high_typ_us (measured), then
+    // give it settle_us more
+    static constexpr uint32_t int_high_typ_us = 125'000;
+    static constexpr uint32_t int_high_max_us = 1'000'000; // no idea
+    static constexpr uint32_t settle_us = 600'000;
+
+    // up to two touches
+    static constexpr int touch_max = 2;
+    static_assert(touch_max <= contact_max);
+
+    // PERIODACTIVE range (see the FT6x36 application note); the register
+    // reads 10 after reset
+    static constexpr int period_active_min = 3;
+    static constexpr int period_active_max = 14;
+
+    // Poll schedule (not used with INT): about the controller's active-mode
+    // report period after reset while touched (tuning_write() keeps min_us
+    // in step with PERIODACTIVE), backing off when idle to its monitor-mode
+    // scan period after reset.
+    static constexpr PollSched poll_sched_def = {10'000, 40'000, 250'000};
+
     enum Reg : uint8_t {
         DEV_MODE = 0x00, // Device Mode
         //GEST_ID = 0x01,   // Gesture ID
@@ -113,11 +234,113 @@ private:
         gpio_set_dir(gpio_num, true); // out
     }
 
-    void reset();
+    // Incremental Init
+
+    enum class InitState {
+        none,
+        rst_low,
+        i2c_low,
+        rst_high,
+        int_high,
+        settle,
+        focaltech_id,
+        cipher,
+        ready,
+        failed,
+    } _init_state;
+
+    int _init_verbosity;
+    uint32_t _init_us; // when the current wait is done
+    bool _init_rd_busy;
+    uint8_t _init_buf[5];
+
+    void init_next(InitState state, uint32_t wait_us = 0);
+    bool init_waited() const;
+    bool init_read(Reg reg, int buf_len);
 
     int read(Reg reg, uint8_t *buf, int buf_len);
 
     int write(Reg reg, const uint8_t *buf, int buf_len);
 
-    void rotate(int x, int y, int &col, int &row) const;
+    // Given TD_STATUS and the point registers after it, fill in contacts
+    // and return the touch count (-1 if TD_STATUS is bad).
+    template <typename Map>
+    static int parse_touches(const uint8_t *buf, Contact contacts[],
+                             const Map &map)
+    {
+        int touch_cnt = buf[0] & 0x0f;
+        // should be 0, 1, or 2
+        if (touch_cnt < 0 || touch_cnt > touch_max)
+            return -1;
+
+        for (int t = 0; t < touch_cnt; t++) {
+            const uint8_t *p = buf + 1 + t * touch_reg_cnt;
+            int x = (int(p[0] & 0x0f) << 8) | p[1];
+            int y = (int(p[2] & 0x0f) << 8) | p[3];
+            int col, row;
+            map(x, y, col, row);
+            Contact &c = contacts[t];
+            c.col = int16_t(col);
+            c.row = int16_t(row);
+            c.size = p[4];     // weight
+            c.id = p[2] >> 4;
+            c.area = p[5] >> 4;
+            c.flag = p[0] >> 6;
+        }
+
+        return touch_cnt;
+    }
+
+    // Each point is XH, XL, YH, YL, WEIGHT, MISC
+    static constexpr int touch_reg_cnt = 6;
+
+    // TD_STATUS and touch_cnt points
+    static constexpr int regs_len(int touch_cnt)
+    {
+        return 1 + touch_reg_cnt * touch_cnt;
+    }
+
+    bool _predictive_read;
+
+    // points to read along with TD_STATUS
+    int _burst_cnt;
+
+    void burst_update(int touch_cnt);
+
+    // Event State Machine
+
+    enum class I2cState {
+        idle,
+        status_read,
+        touch_read,
+    } _i2c_state;
+
+    // for async reads: TD_STATUS, then point registers
+    uint8_t _regs[1 + touch_reg_cnt * touch_max];
+    int _regs_cnt;  // points read with TD_STATUS
+    int _touch_cnt; // from TD_STATUS
+
+    // See Gt911: start_* start an i2c operation and set the state, check_*
+    // process the results and return true when there is a complete read
+    // for event_step() to turn into events.
+    void start_status_read();
+    void start_touch_read();
+
+    bool engine_step();
+
+    bool check_status_read();
+    bool check_touch_read();
+
+    // process a complete read in _regs
+    template <typename Map>
+    void touch_event(Event &event, const Map &map)
+    {
+        Contact contacts[touch_max];
+        int touch_cnt = parse_touches(_regs, contacts, map);
+        if (touch_cnt < 0)
+            return;
+        burst_update(touch_cnt);
+        contacts_update(contacts, touch_cnt);
+        event_pop(event);
+    }
 };
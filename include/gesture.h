@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+// touchscreen
+#include "touchscreen.h"
+
+
+// Gesture recognizer on top of the Touchscreen event stream
+//
+// Feed it every event from get_event() or get_events() with event(), call
+// poll() now and then (e.g. once per main loop) so gestures that are about
+// time passing with nothing happening come out, and take what it recognized
+// with pop(). Work per call is a scan of at most Touchscreen::contact_max
+// contacts; there is no heap and no floating point. Predicted moves (see
+// Touchscreen::set_predictor()) are skipped: gestures go by where fingers
+// were, so an overshoot cannot spoil a tap or a pinch.
+//
+// One finger gives tap, double_tap, long_press and swipe. A tap waits out
+// the double-tap window in poll() before it is reported (set double_tap_us
+// to 0 to get taps at once and no double taps). Two fingers give pinch,
+// reported on every move once the span or angle between them has changed
+// past a threshold; anything a second finger lands on stops being a
+// one-finger gesture until all fingers are up.
+class GestureRecognizer
+{
+public:
+
+    // Thresholds; distances in pixels, times in microseconds
+    struct Config {
+        int tap_slop = 12;             // moved less than this: still a tap
+        uint32_t tap_us = 300'000;     // longest tap
+        uint32_t double_tap_us = 300'000; // up to the next down
+        int double_tap_slop = 40;      // between the two taps
+        uint32_t long_press_us = 600'000;
+        int swipe_min = 60;            // distance along the main axis
+        int swipe_speed_min = 300;     // pixels/sec along the main axis
+        int pinch_scale_min = 20;      // span change, 1/256ths
+        int pinch_angle_min = 1'000;   // angle change, 1/100 degree
+    };
+
+    struct Gesture {
+        enum class Type {
+            none,
+            tap,
+            double_tap,
+            long_press,
+            swipe,
+            pinch,
+        } type;
+        enum class Dir { none, left, right, up, down } dir; // swipe
+        int col, row;     // where it started; pinch: between the fingers
+        int speed;        // swipe: pixels/sec along dir
+        int scale;        // pinch: span now / span at start, 256 = 1.0
+        int angle;        // pinch: turn since start, 1/100 degree, cw > 0
+        uint32_t time_us; // event (or poll) time it was recognized at
+        static const char *type_name(Type type);
+    };
+
+    GestureRecognizer();
+
+    void set_config(const Config &config)
+    {
+        _config = config;
+    }
+
+    const Config &config() const
+    {
+        return _config;
+    }
+
+    void event(const Touchscreen::Event &event);
+
+    void poll(uint32_t now_us);
+
+    bool pop(Gesture &gesture);
+
+    // forget all contacts and anything pending
+    void reset();
+
+    // 1/100 degree, -18000..18000, from the positive x axis toward
+    // positive y (clockwise on screen); about 0.1 degree error
+    static int angle(int x, int y);
+
+    static uint32_t isqrt(uint64_t n);
+
+private:
+
+    Config _config;
+
+    struct Track {
+        int id;
+        int col0, row0; // at down
+        int col, row;   // latest
+        uint32_t down_us;
+    };
+
+    Track _tracks[Touchscreen::contact_max];
+    int _track_cnt;
+
+    // one finger
+    bool _single;       // only one finger since all were up
+    bool _moved;        // it went past tap_slop
+    bool _long_pressed; // long_press reported for it
+
+    // a tap waiting out the double-tap window
+    bool _tap_pend;
+    int _tap_col, _tap_row;
+    uint32_t _tap_us;
+
+    // two fingers: the first two down
+    bool _pinch_armed;
+    bool _pinching;
+    int _pinch_id[2];
+    int _pinch_dx, _pinch_dy; // vector between them at start
+    uint32_t _pinch_d2;       // its length squared
+
+    static constexpr int queue_len = 4; // power of 2
+    Gesture _queue[queue_len];
+    uint32_t _queue_head;
+    uint32_t _queue_tail;
+
+    Track *track_find(int id);
+    void down(const Touchscreen::Event &event);
+    void move(const Touchscreen::Event &event);
+    void up(const Touchscreen::Event &event);
+
+    void single_up(const Track &t, uint32_t time_us);
+    void pinch_start();
+    void pinch_move(uint32_t time_us);
+
+    void tap_flush();
+    void push(const Gesture &gesture);
+    static Gesture make(Gesture::Type type, int col, int row,
+                        uint32_t time_us);
+};
@@ -15,27 +15,248 @@ class Gt911 : public Touchscreen
 
 public:
 
-    Gt911(I2cDev &i2c, uint8_t i2c_addr, int rst_pin, int int_pin);
+    // int_pin < 0 if INT is not wired; get_event() then polls the status
+    // register instead of waiting for INT. width and height are the
+    // display's, in landscape; init() reads the panel's own resolution.
+    Gt911(I2cDev &i2c, uint8_t i2c_addr, int rst_pin, int int_pin,
+          int width = 480, int height = 320);
 
     virtual ~Gt911() = default;
 
+    // Reset, check IDs, and read the config. This blocks for about 55 msec,
+    // mostly waiting through the reset sequence.
     bool init(int verbosity = 0);
 
-    // get up to touch_cnt_max touches
-    virtual int get_touches(int col[], int row[], int touch_cnt_max,
+    // Incremental init
+    // init_start() begins what init() does, then init_poll() carries it on
+    // one step at a time without ever blocking; call it from the main loop
+    // until it returns true, then check ready(). Before init_start() it
+    // returns false. The event engine does nothing until ready.
+    void init_start(int verbosity = 0);
+    bool init_poll();
+
+    bool ready() const
+    {
+        return _init_state == InitState::ready;
+    }
+
+    // get up to touch_cnt_max touches; contacts have id and size
+    virtual int get_touches(Contact contacts[], int touch_cnt_max,
                             int verbosity = 0) override;
 
+    using Touchscreen::get_touches;
+
     // Event state machine
     // This always returns very quickly (no blocking on i2c). It will
     // usually see that a bus operation is in progress and just return.
     // When something finishes, it will process results, possibly returning
     // an event, and start another operation.
+    // If INT is wired, init() attaches an edge interrupt to it and the
+    // state machine sits idle (no bus traffic) until the GT911 signals a new
+    // frame. Otherwise it polls the status register every msec while
+    // touched, backing off when idle (see Touchscreen::PollSched).
     virtual Event get_event() override;
 
+    // Config block (0x8047 - 0x80fe)
+    //
+    // config_read() gets the whole block in one burst; the setters change
+    // the copy; config_write() sends it back with the checksum (0x80ff) and
+    // config-fresh flag (0x8100) recomputed, which is what makes the GT911
+    // load it. Changes do not survive a reset.
+    //
+    // Both block, for about 4.3 msec each at 400 KHz, and return false
+    // without touching the bus if the event engine is partway through a
+    // frame; call them again from the main loop. With INT wired, the engine
+    // is idle between frames.
+    //
+    // x2y, x2x and y2y change what the GT911 reports; config_write() flips
+    // the panel geometry (see Touchscreen::Panel) to match, so (col, row)
+    // stays put.
+    struct Config {
+        static constexpr int len = 0x80ff - 0x8047; // 184
+
+        uint8_t regs[len]; // 0x8047 - 0x80fe
+
+        int version() const
+        {
+            return regs[VERSION];
+        }
+
+        // 1..5
+        int touch_max() const
+        {
+            return regs[TOUCH_NUM] & 0x0f;
+        }
+
+        void set_touch_max(int touch_cnt)
+        {
+            assert(1 <= touch_cnt && touch_cnt <= Gt911::touch_max);
+            regs[TOUCH_NUM] = (regs[TOUCH_NUM] & 0xf0) | touch_cnt;
+        }
+
+        enum class IntMode : uint8_t { rising, falling, low, high };
+
+        IntMode int_mode() const
+        {
+            return IntMode(regs[SWITCH_1] & 0x03);
+        }
+
+        void set_int_mode(IntMode mode)
+        {
+            regs[SWITCH_1] = (regs[SWITCH_1] & ~0x03) | uint8_t(mode);
+        }
+
+        // swap x and y
+        bool x2y() const
+        {
+            return (regs[SWITCH_1] & 0x08) != 0;
+        }
+
+        void set_x2y(bool on)
+        {
+            set_bit(SWITCH_1, 0x08, on);
+        }
+
+        // reverse x
+        bool x2x() const
+        {
+            return (regs[SWITCH_1] & 0x40) != 0;
+        }
+
+        void set_x2x(bool on)
+        {
+            set_bit(SWITCH_1, 0x40, on);
+        }
+
+        // reverse y
+        bool y2y() const
+        {
+            return (regs[SWITCH_1] & 0x80) != 0;
+        }
+
+        void set_y2y(bool on)
+        {
+            set_bit(SWITCH_1, 0x80, on);
+        }
+
+        // Signal level a touch has to go over to be reported, and fall
+        // under to be released; lower is more sensitive.
+        int touch_thresh() const
+        {
+            return regs[TOUCH_LEVEL];
+        }
+
+        void set_touch_thresh(int level)
+        {
+            assert(0 <= level && level <= 255);
+            regs[TOUCH_LEVEL] = uint8_t(level);
+        }
+
+        int leave_thresh() const
+        {
+            return regs[LEAVE_LEVEL];
+        }
+
+        void set_leave_thresh(int level)
+        {
+            assert(0 <= level && level <= 255);
+            regs[LEAVE_LEVEL] = uint8_t(level);
+        }
+
+        // Report period: a frame every 5 + REFRESH_RATE[3:0] msec, so
+        // 5 msec (200 Hz) to 20 msec (50 Hz).
+        int report_ms() const
+        {
+            return 5 + (regs[REFRESH_RATE] & 0x0f);
+        }
+
+        void set_report_ms(int ms)
+        {
+            assert(5 <= ms && ms <= 20);
+            regs[REFRESH_RATE] = (regs[REFRESH_RATE] & 0xf0) | (ms - 5);
+        }
+
+        // what goes at 0x80ff: sum of 0x8047 - 0x80ff is 0 (mod 256)
+        uint8_t checksum() const
+        {
+            uint8_t sum = 0;
+            for (int i = 0; i < len; i++)
+                sum += regs[i];
+            return uint8_t(~sum + 1);
+        }
+
+        // offsets from 0x8047
+        enum : int {
+            VERSION = 0x8047 - 0x8047,
+            TOUCH_NUM = 0x804c - 0x8047,
+            SWITCH_1 = 0x804d - 0x8047,
+            TOUCH_LEVEL = 0x8053 - 0x8047,
+            LEAVE_LEVEL = 0x8054 - 0x8047,
+            REFRESH_RATE = 0x8056 - 0x8047,
+        };
+
+    private:
+
+        void set_bit(int off, uint8_t bit, bool on)
+        {
+            regs[off] = on ? (regs[off] | bit) : (regs[off] & ~bit);
+        }
+    };
+
+    bool config_read(Config &config, int verbosity = 0);
+    bool config_write(const Config &config, int verbosity = 0);
+
     void dump();
 
     const char *show_switch_1(uint8_t switch_1, char *buf, int buf_len) const;
 
+protected:
+
+    // host tests and benchmarks (test/host/frame_access.h)
+    friend struct FrameAccess;
+
+    // get_event()'s work on a frame, without the bus: frame is the status
+    // byte and the point records after it for its touch count, as a burst
+    // read from TOUCH_STAT leaves them. The touches go to the contact
+    // tracker as if just read, and up to event_cnt_max of the events come
+    // back (the rest wait for get_event()). Not while the event engine is
+    // partway through a read.
+    int frame_events(const uint8_t frame[], Event events[],
+                     int event_cnt_max);
+
+    // get_event() with the coordinate map given as map(x, y, col, row);
+    // get_event() passes transform(), TouchscreenFixed a map of constants.
+    template <typename Map>
+    Event event_step(const Map &map)
+    {
+        Event event; // default: type=none
+
+        // finish handing out events from the last frame first
+        if (event_pop(event))
+            return event;
+
+        if (engine_step()) {
+            frame_event(event, map);
+            start_status_write(); // clear status
+        }
+        return event;
+    }
+
+    // frame_events() with the coordinate map given (see event_step)
+    template <typename Map>
+    int frame_step(const uint8_t frame[], Event events[], int event_cnt_max,
+                   const Map &map)
+    {
+        int touch_cnt = frame[0] & 0x0f;
+        if (touch_cnt > touch_max)
+            touch_cnt = 0;
+        frame_update(frame + 1, touch_cnt, map);
+        int cnt = 0;
+        while (cnt < event_cnt_max && event_pop(events[cnt]))
+            cnt++;
+        return cnt;
+    }
+
 private:
 
     static constexpr uint8_t i2c_addr_0 = 0x5d; // if INT is 0 at reset
@@ -63,20 +284,27 @@ private:
         // 0x8040 - 0x8046 are command-related.
         // 0x8047 - 0x80fe are checksum-protected, so changes require a
         //                 checksum update at 0x80ff to have any effect.
-        SWITCH_1 = 0x804d, // 1 byte
-        THRESH = 0x8053,   // 2 bytes: touch, leave
-        PWR_CTRL = 0x8055, // 1 byte
+        CONFIG = 0x8047,       // Config::len bytes
+        SWITCH_1 = 0x804d,     // 1 byte
+        THRESH = 0x8053,       // 2 bytes: touch, leave
+        PWR_CTRL = 0x8055,     // 1 byte
+        CONFIG_CHKSUM = 0x80ff, // 1 byte
+        CONFIG_FRESH = 0x8100,  // 1 byte: write 1 to load the config
         // Most of 0x81xx is read-only
         VENDOR_ID = 0x8140,  // 4 bytes: '9', '1', '1', '\0'
         XY_RES = 0x8146,     // 4 bytes: x_lo, x_hi, y_lo, y_hi
         TOUCH_STAT = 0x814e, // 1 byte: writable to clear status
-        TOUCH_1 = 0x8150,    // 4 bytes: x_lo, x_hi, y_lo, y_hi
-        // TOUCH_2 = TOUCH_1 + 8
-        // TOUCH_3 = TOUCH_2 + 8
-        // TOUCH_4 = TOUCH_3 + 8
-        // TOUCH_5 = TOUCH_4 + 8
+        TOUCH_REC = 0x814f,  // touch_max records of touch_rec_len bytes
     };
 
+    // Point records follow the status register, so status and all points
+    // can be read in one burst starting at TOUCH_STAT. Each record is:
+    //   track id, x_lo, x_hi, y_lo, y_hi, size_lo, size_hi, reserved
+    static constexpr int touch_max = 5;
+    static constexpr int touch_rec_len = 8;
+    static constexpr int frame_len = 1 + touch_max * touch_rec_len; // 41
+    static_assert(touch_max <= contact_max);
+
     // expected vendor ID
     static constexpr uint32_t vendor_id_exp = 0x39313100; // '9' '1' '1' '\0'
 
@@ -99,10 +327,9 @@ private:
         gpio_set_dir(gpio_num, true); // out
     }
 
-    void reset(uint8_t i2c_addr);
-
     int read(Reg reg, uint8_t *buf, int buf_len);
 
+    // buf_len up to the config block plus checksum and fresh flag
     int write(Reg reg, const uint8_t *buf, int buf_len);
 
     bool read_checked(Reg reg, uint8_t *buf, int buf_len, //
@@ -111,21 +338,77 @@ private:
     bool write_checked(Reg reg, uint8_t *buf, int buf_len, //
                        const char *label = nullptr, int verbosity = 0);
 
-    bool get_vendor_id(uint32_t &vendor_id, int verbosity = 0);
-    bool read_resolution(int verbosity = 0);
+    // Incremental Init
+
+    enum class InitState {
+        none,
+        reset_t1,
+        reset_t2,
+        reset_t3,
+        reset_t4,
+        vendor_id,
+        xy_res,
+        switch_1,
+        thresh,
+        ready,
+        failed,
+    } _init_state;
+
+    int _init_verbosity;
+    uint32_t _init_us; // when the current reset step is done
+    bool _init_rd_busy;
+    uint8_t _init_buf[4];
+    uint8_t _switch_1;
+
+    void init_next(InitState state, uint32_t wait_us = 0);
+    bool init_waited() const;
+    bool init_read(Reg reg, int buf_len, const char *label);
+
+    // edge to attach for SWITCH_1[1:0] (rising, falling, low, high)
+    static bool int_rising(uint8_t switch_1)
+    {
+        uint8_t int_mode = switch_1 & 0x03;
+        return int_mode == 0 || int_mode == 3;
+    }
 
-    void rotate(int x, int y, int &col, int &row) const;
+    static Panel panel_follow(Panel panel, uint8_t was, uint8_t now);
 
-    // Event State Machine
+    // x, y from a point record
+    static void rec_xy(const uint8_t *rec, int &x, int &y)
+    {
+        x = (int(rec[2]) << 8) | rec[1];
+        y = (int(rec[4]) << 8) | rec[3];
+    }
 
-    // Last event emitted
-    Event _last_event;
+    // Contact from a point record, (x, y) through map
+    template <typename Map>
+    static void rec_contact(const uint8_t *rec, Contact &contact,
+                            const Map &map)
+    {
+        int x, y, col, row;
+        rec_xy(rec, x, y);
+        map(x, y, col, row);
+        contact.col = int16_t(col);
+        contact.row = int16_t(row);
+        contact.size = uint16_t((int(rec[6]) << 8) | rec[5]);
+        contact.id = rec[0];
+        contact.area = 0;
+        contact.flag = Contact::contact;
+    }
 
-    // Next time we might poll the status register.
-    // According to the "GT911 Programming Guide v0.1", we're supposed to wait
-    // at least 1 msec between polls, although before this delay was added it
-    // seemed to work fine without the extra delay.
-    uint32_t _poll_us;
+    // Number of point records to read along with the status register: the
+    // count from the last valid status read, on the bet that the next frame
+    // has as many touches.
+    int _burst_cnt;
+
+    // Event State Machine
+
+    // Poll schedule (not used with INT). According to the "GT911 Programming
+    // Guide v0.1", we're supposed to wait at least 1 msec between polls,
+    // although before this delay was added it seemed to work fine without
+    // the extra delay. Idle, there is no point polling much faster than the
+    // chip reports (10 msec after reset, see Config::report_ms()).
+    static constexpr PollSched poll_sched_def = {1'000, 10'000, 250'000};
 
     enum class I2cState {
         idle,
@@ -134,21 +417,44 @@ private:
         status_write,
     } _i2c_state;
 
-    // for async reads
-    uint8_t _status[1];
-    uint8_t _touch[4];
+    // for async reads: status, then point records
+    uint8_t _frame[frame_len];
+    int _frame_cnt; // point records read with status
+    int _touch_cnt; // touch count from status
 
-    // The start_* and check_* functions are called by get_event() to
+    // The start_* and check_* functions are called by engine_step() to
     // implement the event state machine. The start_* functions start an i2c
     // operation and set the state accordingly. The check_* functions retrieve
     // results of an i2c operation and process them, always starting another
-    // i2c operation.
+    // i2c operation, except that a complete frame is left for event_step()
+    // to turn into events before it starts the status write.
 
     void start_status_read();
     void start_status_write();
     void start_touch_read();
 
-    void check_status_read(Event &event);
-    void check_touch_read(Event &event);
+    bool engine_step();
+
+    bool check_status_read();
+    bool check_touch_read();
+
+    // Hand touch_cnt point records to the contact tracker, which turns
+    // them into down/move/up events by track id.
+    template <typename Map>
+    void frame_update(const uint8_t *recs, int touch_cnt, const Map &map)
+    {
+        Contact contacts[touch_max];
+        for (int t = 0; t < touch_cnt; t++)
+            rec_contact(recs + t * touch_rec_len, contacts[t], map);
+        contacts_update(contacts, touch_cnt);
+    }
+
+    // All the touches in the frame read, and the first event from them
+    template <typename Map>
+    void frame_event(Event &event, const Map &map)
+    {
+        frame_update(_frame + 1, _touch_cnt, map);
+        event_pop(event);
+    }
 
 }; // class Gt911
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Latency histogram, microseconds
+//
+// Buckets are log2 with four steps per octave, so a percentile comes back
+// within 25% of the true value. Values of 2^22 us (about 4 sec) and up all
+// land in the last bucket. add() is cheap enough for the event path (no
+// division, no floating point). One context adds; reading from another while
+// it does can see a count one sample off, which is fine for statistics.
+class LatencyHist
+{
+public:
+
+    static constexpr int bucket_cnt = 84;
+
+    LatencyHist()
+    {
+        reset();
+    }
+
+    void reset();
+
+    void add(uint32_t us)
+    {
+        _buckets[bucket(us)]++;
+        _count++;
+        _sum += us;
+        if (us < _min)
+            _min = us;
+        if (us > _max)
+            _max = us;
+    }
+
+    uint32_t count() const
+    {
+        return _count;
+    }
+
+    // these are 0 if count() is 0
+    uint32_t min() const
+    {
+        return _count == 0 ? 0 : _min;
+    }
+
+    uint32_t max() const
+    {
+        return _max;
+    }
+
+    uint32_t mean() const
+    {
+        return _count == 0 ? 0 : uint32_t(_sum / _count);
+    }
+
+    // Value at or below which pct percent of samples fall (upper edge of the
+    // bucket holding that sample, but never more than max()).
+    uint32_t percentile(int pct) const;
+
+    uint32_t bucket_count(int b) const
+    {
+        return _buckets[b];
+    }
+
+    // smallest value that goes in bucket b
+    static uint32_t bucket_lo(int b);
+
+    static int bucket(uint32_t us)
+    {
+        if (us < 4)
+            return int(us);
+        int e = 31 - __builtin_clz(us); // us in [2^e, 2^(e+1))
+        if (e >= 22)
+            return bucket_cnt - 1;
+        return 4 * (e - 1) + int((us >> (e - 2)) & 3);
+    }
+
+    // one line: name count min p50 p90 p99 max mean
+    void dump(const char *name) const;
+
+private:
+
+    uint32_t _buckets[bucket_cnt];
+    uint32_t _count;
+    uint64_t _sum;
+    uint32_t _min;
+    uint32_t _max;
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+// touchscreen
+#include "touchscreen.h"
+
+
+// Runs a Touchscreen's event engine on RP2040 core 1
+//
+// Bring the touchscreen up first (init() and set_rotation()), then start()
+// it here. Core 1 then spins on service(), so a slow frame on core 0 no
+// longer delays polling or INT handling. While it runs, core 0 should only
+// use the calls that are safe across cores:
+//
+//   get_events()    events in order, via the SPSC ring
+//   get_snapshot()  latest contacts, via the sequence lock
+//   events_dropped(), events_coalesced(), bus_stats()
+//
+// Anything else (get_event(), get_touches(), set_rotation(), ...) must wait
+// until stop(). Only one touchscreen can be serviced at a time.
+//
+// Off target (host build) the service loop runs on a std::thread instead.
+class TouchService
+{
+public:
+
+    static void start(Touchscreen &ts);
+
+    // Returns once the service loop has exited.
+    static void stop();
+
+    static bool running();
+
+    // service() passes since start()
+    static uint32_t loops();
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cstdint>
+
+
+// Touch controller bus trace
+//
+// Records what the driver sent to and got back from the controller, plus INT
+// edges, into a RAM ring so a misbehaving unit can be captured and the trace
+// replayed on the host (test/host/trace_replay.h). Hand a recorder to
+// Touchscreen::set_trace(); recording happens in whatever context runs the
+// event engine, so take() and stream() must be called from there too (or
+// after stop()). When the ring fills, the oldest records go.
+//
+// Each record is a 10-byte header followed by the bytes written and the
+// bytes read, all little-endian:
+//
+//   u8  type      'X' transaction, 'I' INT edge
+//   u8  i2c_addr
+//   u8  wr_len    bytes written, register address first
+//   u8  rd_len    bytes read (never more than result)
+//   i16 result    what the transaction returned (bytes, or PICO_ERROR_*)
+//   u32 time_us   time_us_32() when it started (or of the edge)
+//
+// A record holds at most wr_max bytes written and rd_max read, enough for
+// the longest transfer either driver makes: the GT911 config block (written
+// as register, block, checksum and fresh flag; read back as block and
+// checksum). A longer transfer asserts, since a clipped record could not be
+// replayed faithfully. The ring needs room for at least one rec_max record.
+//
+// stream() prints records as hex, one per line starting "tt ", so a trace
+// survives stdio's newline handling and can be picked out of other output.
+class TouchTrace
+{
+public:
+
+    static constexpr int hdr_len = 10;
+    static constexpr int wr_max = 2 + 184 + 2; // GT911 config_write()
+    static constexpr int rd_max = 184 + 1;     // GT911 config_read()
+    static constexpr int rec_max = hdr_len + wr_max + rd_max;
+
+    enum Type : uint8_t {
+        xfer = 'X',
+        irq = 'I',
+    };
+
+    struct Record {
+        Type type;
+        uint8_t i2c_addr;
+        uint8_t wr_len;
+        uint8_t rd_len;
+        int16_t result;
+        uint32_t time_us;
+        const uint8_t *wr; // wr_len bytes
+        const uint8_t *rd; // rd_len bytes
+    };
+
+    // buf_len should be at least rec_max
+    TouchTrace(uint8_t *buf, int buf_len);
+
+    void start()
+    {
+        _recording = true;
+    }
+
+    void stop()
+    {
+        _recording = false;
+    }
+
+    bool recording() const
+    {
+        return _recording;
+    }
+
+    // Recording; called by the driver through Touchscreen
+
+    void record_irq(uint32_t time_us);
+
+    void record_start(uint8_t i2c_addr, const uint8_t *wr, int wr_len,
+                      int rd_len);
+
+    void record_end(int result, const uint8_t *rd);
+
+    // Reading out
+
+    // bytes of whole records in the ring
+    int size() const
+    {
+        return _used;
+    }
+
+    // records overwritten before they were taken
+    uint32_t dropped() const
+    {
+        return _dropped;
+    }
+
+    // Copy out and remove whole records, oldest first, up to buf_len bytes.
+    // Returns the bytes copied.
+    int take(uint8_t *buf, int buf_len);
+
+    // take() everything and print it as hex lines; returns records printed
+    int stream();
+
+    // Parse the record at the start of buf; returns its length, or 0 if buf
+    // does not hold a whole valid record.
+    static int parse(const uint8_t *buf, int buf_len, Record &rec);
+
+    // Parse one "tt " line back to record bytes; returns the byte count, or
+    // 0 if the line is not a trace record.
+    static int unhex(const char *line, uint8_t *buf, int buf_len);
+
+private:
+
+    uint8_t *const _buf;
+    const int _buf_len;
+
+    int _head; // next byte to write
+    int _tail; // oldest record
+    int _used;
+
+    bool _recording;
+    uint32_t _dropped;
+
+    // transaction started but not yet finished
+    uint8_t _pend[rec_max];
+    bool _pend_active;
+
+    void put(const uint8_t *rec, int rec_len);
+    uint8_t at(int i) const
+    {
+        return _buf[(_tail + i) % _buf_len];
+    }
+};
@@ -1,27 +1,71 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+// pico
+#include "pico/stdlib.h"
+// touchscreen
+#include "event_ring.h"
+#include "frame_batch.h"
+#include "latency_hist.h"
+#include "touch_trace.h"
 
 
 class Touchscreen
 {
 public:
 
+    // width and height are the display's, in landscape
     Touchscreen(int width, int height) :
         _phys_wid(width),
         _phys_hgt(height),
         _width(width),
         _height(height),
-        _rotation(Rotation::landscape)
+        _rotation(Rotation::landscape),
+        _panel{height, width, false, false, false},
+        _cal(),
+        _grid(),
+        _grid_on(false),
+        _grid_xform(),
+        _xform(),
+        _bus_baud(0),
+        _trace(nullptr),
+        _contact_cnt(0),
+        _jitter_filter(),
+        _jitter_on(false),
+        _predictor(),
+        _predict_on(false),
+        _pend_head(0),
+        _pend_tail(0),
+        _frame_int_us(0),
+        _frame_poll_us(0),
+        _frame_status_us(0),
+        _frame_data_us(0),
+        _snap_seq(0),
+        _snap(),
+        _irq_gpio(-1),
+        _irq_events(0),
+        _irq_cnt(0),
+        _irq_us(0),
+        _irq_seen(0),
+        _irq_sync(false),
+        _poll_sched{1'000, 1'000, 0},
+        _poll_touch_us(0),
+        _poll_next_us(0)
     {
         // Initialization of width, height, and rotation assume we
         // start out in landscape mode and _phys_wid >= _phys_hgt.
         assert(_rotation == Rotation::landscape ||
                 _rotation == Rotation::landscape2);
         assert(_phys_wid >= _phys_hgt);
+        xform_build();
     }
 
-    virtual ~Touchscreen() = default;
+    virtual ~Touchscreen()
+    {
+        irq_detach();
+    }
 
     int width() const
     {
@@ -56,6 +100,7 @@ public:
             _height = _phys_wid;
             assert(_width <= _height);
         }
+        xform_build();
     }
 
     Rotation get_rotation() const
@@ -63,27 +108,253 @@ public:
         return _rotation;
     }
 
-    // get up to touch_cnt_max touches
-    virtual int get_touches(int col[], int row[], int touch_cnt_max,
+    // Panel geometry
+    //
+    // How the controller's (x, y) line up with the display. The controller
+    // reports x in 0..x_res-1 and y in 0..y_res-1; mirror_x and mirror_y
+    // reverse those, then swap_xy exchanges them. What comes out is taken
+    // to be the display in portrait if it is taller than wide, else the
+    // display in landscape, and is scaled to the display's resolution.
+    // Drivers set this from what the controller says in init(); boards
+    // with the glass mounted some other way can change it after. A flavor
+    // with the geometry built in (TouchscreenFixed) says no to any other
+    // through panel_allowed(); set_panel() asserts it, and leaves the panel
+    // as it was if it is not.
+    struct Panel {
+        int x_res, y_res;
+        bool swap_xy;
+        bool mirror_x, mirror_y;
+    };
+
+    virtual bool panel_allowed(const Panel &) const
+    {
+        return true;
+    }
+
+    void set_panel(const Panel &panel)
+    {
+        assert(panel.x_res > 1 && panel.y_res > 1);
+        assert(panel_allowed(panel));
+        if (!panel_allowed(panel))
+            return;
+        _panel = panel;
+        xform_build();
+    }
+
+    const Panel &get_panel() const
+    {
+        return _panel;
+    }
+
+    // Calibration
+    //
+    // An affine correction for a panel that is offset, scaled or skewed
+    // against the display. It works in the display's portrait frame, so one
+    // calibration holds for every rotation, and is composed into the
+    // transform, so it costs nothing per point.
+    //
+    //   CalPoint targets[5], touches[5];
+    //   ts.calibration_targets(targets, 5);
+    //   for (int i = 0; i < 5; i++) {
+    //       // draw a cross at targets[i], then
+    //       if (!ts.calibration_capture(touches[i]))
+    //           ...
+    //   }
+    //   if (ts.calibration_solve(targets, touches, 5))
+    //       ts.get_calibration().save(blob); // for flash
+    struct Calibration {
+        // u' = a u + b v + c, v' = d u + e v + f, all 16.16
+        int32_t a = 1 << 16, b = 0, c = 0;
+        int32_t d = 0, e = 1 << 16, f = 0;
+
+        // magic, version, six little-endian words, checksum
+        static constexpr int blob_len = 2 + 6 * 4 + 1;
+
+        void save(uint8_t blob[blob_len]) const;
+
+        // false (and unchanged) if blob is not a saved calibration
+        bool load(const uint8_t blob[blob_len]);
+    };
+
+    void set_calibration(const Calibration &cal)
+    {
+        _cal = cal;
+        xform_build();
+    }
+
+    const Calibration &get_calibration() const
+    {
+        return _cal;
+    }
+
+    void calibration_clear()
+    {
+        set_calibration(Calibration());
+    }
+
+    struct CalPoint {
+        int col, row;
+    };
+
+    static constexpr int cal_points_max = 5;
+
+    // 3 targets (a triangle) or 5 (corners and center), a tenth of the way
+    // in from the edges, in the current rotation.
+    void calibration_targets(CalPoint targets[], int n) const;
+
+    // Using get_touch(), wait up to timeout_ms for a single touch, average
+    // cal_samples readings of it, then wait for it to lift. Returns false
+    // on timeout.
+    static constexpr int cal_samples = 8;
+    bool calibration_capture(CalPoint &touch, int timeout_ms = 10'000);
+
+    // Fit touches[i] onto targets[i] (exactly for n = 3, least squares for
+    // more) and fold that into the calibration. touches are as captured
+    // with the calibration in place at the time. Returns false if n is out
+    // of range or the touches are too near a line to fit.
+    bool calibration_solve(const CalPoint targets[], const CalPoint touches[],
+                           int n);
+
+    // Edge correction grid
+    //
+    // Cheap panels bunch up near the bezel, which no affine calibration
+    // fixes. The grid holds pixel offsets at nodes spread evenly over the
+    // display, corners included, 9 across by 7 down in landscape; they are
+    // interpolated bilinearly and added after the transform. Like the
+    // calibration it is kept in the portrait frame, so it holds in every
+    // rotation.
+    //
+    // To fill it, for each of the grid_targets(), show the target, capture
+    // a touch on it (calibration_capture()) and grid_learn() the pair.
+    // Learning adds to what is there, so it can be repeated with the grid
+    // on to refine it.
+    static constexpr int grid_u = 7; // nodes across, in portrait
+    static constexpr int grid_v = 9; // nodes down, in portrait
+    static constexpr int grid_cnt = grid_u * grid_v;
+
+    struct Grid {
+        int8_t off[grid_v][grid_u][2]; // (du, dv) pixels, in portrait
+    };
+
+    void set_grid(const Grid &grid)
+    {
+        _grid = grid;
+        _grid_on = true;
+    }
+
+    const Grid &get_grid() const
+    {
+        return _grid;
+    }
+
+    // zero and turn off
+    void grid_clear();
+
+    bool grid_on() const
+    {
+        return _grid_on;
+    }
+
+    // the nodes in the current rotation; returns grid_cnt
+    int grid_targets(CalPoint targets[]) const;
+
+    // Add target - touch to the node nearest target.
+    void grid_learn(const CalPoint &target, const CalPoint &touch);
+
+    // Most contacts any driver tracks at once
+    static constexpr int contact_max = 5;
+
+    // One contact (finger), packed into 8 bytes so a whole frame's worth
+    // sits in one cache line. id is the controller's track ID, which stays
+    // the same from down through up. size and area are what the controller
+    // says of the contact patch, straight from the point record: the GT911
+    // gives a size and no area, the FT6336U a weight and an area. They are
+    // in the controller's own units, so only compare them on one panel.
+    // flag is the FT6336U's event flag for the point; the GT911 only
+    // reports points in contact.
+    struct Contact {
+        enum Flag : uint8_t { down = 0, up = 1, contact = 2, none = 3 };
+        int16_t col = 0, row = 0;
+        uint16_t size = 0;
+        uint8_t id = 0;
+        uint8_t area : 4;
+        uint8_t flag : 2;
+        Contact() : area(0), flag(contact)
+        {
+        }
+    };
+    static_assert(sizeof(Contact) == 8);
+
+    // Get up to touch_cnt_max contacts with one read of the controller
+    // (the same bus transactions as the event engine's), not through the
+    // event engine. Returns how many touches the controller says there are,
+    // even if more than touch_cnt_max, or -1 on error.
+    virtual int get_touches(Contact contacts[], int touch_cnt_max,
                             int verbosity = 0) = 0;
 
+    // get_touches(), positions only
+    int get_touches(int col[], int row[], int touch_cnt_max,
+                    int verbosity = 0);
+
     // get one touch
     int get_touch(int &col, int &row, int verbosity = 0)
     {
         return get_touches(&col, &row, 1, verbosity);
     }
 
+    // Current contacts as of the last event engine update
+    // Call this from the same place that runs the event engine.
+    int get_contacts(Contact contacts[], int contact_cnt_max) const;
+
+    // Latest contacts, published by the event engine after every frame
+    // with a sequence lock. get_snapshot() can be called from anywhere (e.g.
+    // the render loop on core 0 while service() runs on core 1); it never
+    // waits on a lock, and only goes around again if an update lands while
+    // it is copying.
+    struct Snapshot {
+        uint32_t frame;   // frames published so far
+        uint32_t time_us; // when this one was
+        int contact_cnt;
+        Contact contacts[contact_max];
+    };
+
+    void get_snapshot(Snapshot &snap) const;
+
     // clang-format off
     struct Event {
         enum class Type { none, down, up, move, } type;
+        int id; // contact id
         int col, row;
-        Event() : type(Type::none), col(0), row(0) { }
-        Event(Type t, int c, int r) : type(t), col(c), row(r) { }
+        bool predicted; // a move to where the contact is expected to be
+                        // (see Predictor), not where it was seen
+        uint8_t area;   // Contact::area as of the event
+        uint16_t size;  // Contact::size as of the event
+        // time_us_32() when...
+        uint32_t time_us; // the frame's data arrived
+        uint32_t int_us;  // INT edge that started the read (0 if polled)
+        uint32_t poll_us; // the frame's status read was started
+        Event() :
+            type(Type::none), id(0), col(0), row(0), predicted(false),
+            area(0), size(0), time_us(0), int_us(0), poll_us(0) { }
+        Event(Type t, int c, int r, int i = 0) :
+            type(t), id(i), col(c), row(r), predicted(false),
+            area(0), size(0), time_us(0), int_us(0), poll_us(0) { }
+        Event(Type t, const Contact &contact) :
+            type(t), id(contact.id), col(contact.col), row(contact.row),
+            predicted(false), area(contact.area), size(contact.size),
+            time_us(0), int_us(0), poll_us(0) { }
         void reset()
         {
             type = Type::none;
+            id = 0;
             col = 0;
             row = 0;
+            predicted = false;
+            area = 0;
+            size = 0;
+            time_us = 0;
+            int_us = 0;
+            poll_us = 0;
         }
         const char *type_name() const
         {
@@ -98,9 +369,405 @@ public:
     };
     // clang-format on
 
-    // event state machine
+    // Event state machine
+    // Each contact gets its own down, move(s), and up, tagged with its id.
+    // One frame from the controller can produce several events; they come
+    // out of successive calls.
     virtual Event get_event() = 0;
 
+    // Event ring
+    //
+    // service() runs the event engine until it has nothing more to say and
+    // queues the events in a fixed-size lock-free ring. It can
+    // be called from the main loop, a timer IRQ, or a loop on the other core,
+    // but only from one of them. get_events() takes up to event_cnt_max
+    // events out of the ring, oldest first, and can be called from one other
+    // place (e.g. the UI); it must not be called from an interrupt that can
+    // preempt service(). Don't mix these with calling get_event() directly.
+    static constexpr int event_ring_len = 32;
+
+    using Overflow = EventRingOverflow;
+
+    void service();
+
+    int get_events(Event events[], int event_cnt_max);
+
+    // what service() does when the ring is full (default drop_newest)
+    void set_overflow(Overflow overflow)
+    {
+        _event_ring.set_overflow(overflow);
+    }
+
+    uint32_t events_dropped() const
+    {
+        return _event_ring.dropped();
+    }
+
+    uint32_t events_coalesced() const
+    {
+        return _event_ring.coalesced();
+    }
+
+    // Frame-synchronized delivery
+    //
+    // A UI that lays out and redraws once per display frame (30-60 Hz) has
+    // no use for a move every msec. get_frame_events() is get_events() for
+    // it: call it once per frame tick, from wherever the tick comes (vsync,
+    // the render loop), and it returns everything service() queued since
+    // the last tick, with each contact's run of moves merged into one at
+    // the latest position. Downs and ups are always kept. Events that don't
+    // fit in event_cnt_max are held for the next call. Same rules as
+    // get_events(), and don't mix the two. Set the ring to
+    // Overflow::coalesce_moves so a burst between ticks is merged rather
+    // than dropped.
+    //
+    // Apps that need every position (ink, handwriting) use get_events();
+    // frame_coalesced() says how many moves were merged away here.
+    int get_frame_events(Event events[], int event_cnt_max);
+
+    uint32_t frame_coalesced() const
+    {
+        return _frame_batch.coalesced();
+    }
+
+    // i2c bus usage, counted by the driver
+    //
+    // Always on; counting is a few adds per transaction. bus_stats() returns
+    // a copy, with bus_us worked out from the bit count at the bus clock
+    // rate. Each transaction is S, address + ack, { byte + ack } for the
+    // bytes written, then for a register read Sr, address + ack, { byte +
+    // ack } for the bytes read, then P: 11 + 9 * bytes_wr bits, plus 11 + 9
+    // * bytes_rd bits if anything is read. The copy is taken without a lock,
+    // so from the other core it can be a transaction out of date.
+    struct BusStats {
+        uint32_t transactions; // register reads and writes started
+        uint32_t bytes_wr;     // including register address bytes
+        uint32_t bytes_rd;
+        uint64_t bits;         // on the wire, per the above
+        uint64_t bus_us;       // bits at the bus clock rate
+        uint32_t nacks;        // PICO_ERROR_GENERIC
+        uint32_t timeouts;     // PICO_ERROR_TIMEOUT
+        uint32_t mismatches;   // other errors, or not the bytes asked for
+        BusStats() :
+            transactions(0), bytes_wr(0), bytes_rd(0), bits(0), bus_us(0),
+            nacks(0), timeouts(0), mismatches(0)
+        {
+        }
+        uint32_t errors() const
+        {
+            return nacks + timeouts + mismatches;
+        }
+    };
+
+    BusStats bus_stats() const;
+
+    void bus_stats_reset()
+    {
+        _bus_stats = BusStats();
+    }
+
+    // Latency
+    //
+    // Every frame read by the event engine adds to int_to_status (INT edge to
+    // status register in hand; only when INT is used) and status_to_touch
+    // (status to the last point record in hand; 0 when they come in one
+    // read). Every event taken by get_events() adds to read_to_consume (data
+    // arrival to the caller having it), which is where a slow UI loop shows
+    // up. Callers of get_event() can measure their own from Event::time_us.
+    enum class Latency {
+        int_to_status,
+        status_to_touch,
+        read_to_consume,
+    };
+    static constexpr int latency_cnt = 3;
+
+    static const char *latency_name(Latency which);
+
+    const LatencyHist &latency(Latency which) const
+    {
+        return _latency[int(which)];
+    }
+
+    void latency_reset();
+
+    // one line per histogram
+    void latency_dump() const;
+
+    // Record bus traffic and INT edges (nullptr to stop); see touch_trace.h
+    void set_trace(TouchTrace *trace)
+    {
+        _trace = trace;
+    }
+
+    // Poll scheduling
+    //
+    // Without INT, the event engine polls the controller for new frames.
+    // It polls every min_us while anything is touched. Once nothing has been
+    // touched for idle_us it polls half as often, and half as often again
+    // after each further idle_us, down to every max_us. A frame with a
+    // touch in it puts it straight back to min_us. Slowing down takes a
+    // whole idle_us each step and speeding up takes one frame, so a
+    // flickering contact keeps it fast rather than bouncing it up and down.
+    // idle_us = 0, or max_us = min_us, polls at min_us always.
+    //
+    // Each driver sets defaults to suit its controller. The interval only
+    // decides when a poll may start; how long a read takes on the bus is
+    // separate. With INT, polling stops and each edge starts a read right
+    // away instead.
+    struct PollSched {
+        uint32_t min_us;
+        uint32_t max_us;
+        uint32_t idle_us;
+    };
+
+    void set_poll_sched(const PollSched &sched)
+    {
+        assert(0 < sched.min_us && sched.min_us <= sched.max_us);
+        _poll_sched = sched;
+    }
+
+    const PollSched &poll_sched() const
+    {
+        return _poll_sched;
+    }
+
+    // interval in use now
+    uint32_t poll_interval_us() const;
+
+    // Jitter filter
+    //
+    // A resting finger wanders a pixel or two from frame to frame, and
+    // without filtering every wander is a move event. With the filter on,
+    // each contact's (col, row) goes through a 1-Euro filter on the way
+    // from the transform to the events: a low-pass whose cutoff rises with
+    // the contact's speed, so it smooths hard at rest and hardly at all on
+    // a fast stroke. A move is reported once the filtered position is
+    // move_min pixels (either axis) from the one last reported. Downs are
+    // reported where they land, unfiltered; ups where the last event was.
+    // Integer only: a few multiplies and three divides per contact per
+    // frame.
+    //
+    // Cutoffs are in mHz; beta_mhz is how much the cutoff rises per pixel/sec
+    // of speed. Lower min_cutoff_mhz for less jitter, raise beta_mhz for less
+    // lag on fast strokes.
+    struct JitterFilter {
+        uint32_t min_cutoff_mhz = 1'000;
+        uint32_t beta_mhz = 100;
+        uint32_t d_cutoff_mhz = 5'000; // for the speed estimate
+        int move_min = 1;
+    };
+
+    // Takes effect from the next frame; contacts down now start filtering
+    // from where they are.
+    void set_jitter_filter(const JitterFilter &filter)
+    {
+        assert(filter.min_cutoff_mhz > 0 && filter.d_cutoff_mhz > 0);
+        assert(filter.move_min >= 1);
+        _jitter_filter = filter;
+        _jitter_on = true;
+    }
+
+    const JitterFilter &get_jitter_filter() const
+    {
+        return _jitter_filter;
+    }
+
+    void jitter_filter_off()
+    {
+        _jitter_on = false;
+    }
+
+    bool jitter_filter_on() const
+    {
+        return _jitter_on;
+    }
+
+    // Motion prediction
+    //
+    // Ink drawn from events trails the finger by the poll interval, the bus
+    // read and a display frame. With prediction on, an alpha-beta tracker
+    // follows each contact's reported positions by frame time, and after
+    // each frame, whenever it has changed, a move with predicted set says
+    // where the contact should be horizon_ms from the frame's time_us. A
+    // predicted point stands only until the next event for its contact,
+    // which replaces it: draw it provisionally and take it back then. When
+    // the contact stops, predictions come back to it. Downs and ups are
+    // never predicted. Prediction follows the jitter filter, if that is on.
+    //
+    // alpha and beta are 1/256ths: how far the position and the velocity
+    // follow each new sample. 256, 256 is plain linear extrapolation from
+    // the last two samples; lower is smoother but slower to turn.
+    struct Predictor {
+        int horizon_ms = 16;
+        int alpha = 256;
+        int beta = 128;
+    };
+
+    // Takes effect from the next frame.
+    void set_predictor(const Predictor &predictor)
+    {
+        assert(predictor.horizon_ms >= 0);
+        assert(0 < predictor.alpha && predictor.alpha <= 256);
+        assert(0 < predictor.beta && predictor.beta <= 256);
+        _predictor = predictor;
+        _predict_on = true;
+    }
+
+    const Predictor &get_predictor() const
+    {
+        return _predictor;
+    }
+
+    void predictor_off()
+    {
+        _predict_on = false;
+    }
+
+    bool predictor_on() const
+    {
+        return _predict_on;
+    }
+
+protected:
+
+    // Drivers call bus_start() with what they are about to write for each
+    // register read or write, and bus_result() with what the sync call or
+    // async check returned, the byte count expected back (-1 to only look
+    // for errors) and the bytes read. Every bus_start() gets a bus_result().
+    void bus_start(uint8_t i2c_addr, const uint8_t *wr_buf, int wr_len,
+                   int rd_len)
+    {
+        _bus_stats.transactions++;
+        _bus_stats.bytes_wr += wr_len;
+        _bus_stats.bytes_rd += rd_len;
+        _bus_stats.bits += 11 + 9 * wr_len;
+        if (rd_len > 0)
+            _bus_stats.bits += 11 + 9 * rd_len;
+        if (_trace != nullptr)
+            _trace->record_start(i2c_addr, wr_buf, wr_len, rd_len);
+    }
+
+    void bus_result(int result, int expected = -1,
+                    const uint8_t *rd_buf = nullptr);
+
+    // bus clock rate for BusStats::bus_us
+    void bus_baud(uint32_t baud)
+    {
+        _bus_baud = baud;
+    }
+
+    // INT pin interrupt
+    //
+    // irq_attach() installs a GPIO edge interrupt on int_gpio whose handler
+    // only counts edges. irq_take() returns true once for each batch of edges
+    // seen since the previous call. Only one Touchscreen can own the interrupt
+    // at a time.
+    void irq_attach(int int_gpio, bool rising);
+    void irq_detach();
+
+    bool irq_attached() const
+    {
+        return _irq_gpio >= 0;
+    }
+
+    bool irq_take();
+
+    // time_us_32() of the latest INT edge
+    uint32_t irq_us() const
+    {
+        return _irq_us;
+    }
+
+    // Event engine support
+    //
+    // Drivers hand each complete frame of contacts to contacts_update(),
+    // which compares it to the previous frame by id and queues up events
+    // (contacts gone), then down or move events. get_event() should return
+    // queued events (event_pop) before starting on the next frame, so the
+    // queue never needs more than one frame's worth.
+    //
+    // Around that, frame_start() goes when the status read is started and
+    // frame_status() when the status byte is in hand; contacts_update()
+    // takes the data arrival time itself. Events from the frame carry the
+    // times, and the latency histograms get one sample each.
+    void frame_start();
+    void frame_status();
+    void contacts_update(const Contact cur[], int cur_cnt);
+
+    bool event_pop(Event &event);
+
+    // (x, y) -> (col, row) in 16.16 fixed point, rounding included in the
+    // constant terms. Coordinates up to 4095 and scales up to 8 fit.
+    struct Xform {
+        int32_t col_x, col_y, col_0;
+        int32_t row_x, row_y, row_0;
+    };
+
+    // The map for a panel on a display phys_wid x phys_hgt (landscape) at a
+    // rotation, with a calibration. constexpr so a build with all of those
+    // fixed gets constants (see TouchscreenFixed).
+    static constexpr Xform xform_make(const Panel &panel, int phys_wid,
+                                      int phys_hgt, Rotation rotation,
+                                      const Calibration &cal);
+
+    // Two multiply-adds per coordinate and a clamp to width x height.
+    static void xform_apply(const Xform &t, int width, int height, int x,
+                            int y, int &col, int &row)
+    {
+        col = clamp((t.col_x * x + t.col_y * y + t.col_0) >> 16, width);
+        row = clamp((t.row_x * x + t.row_y * y + t.row_0) >> 16, height);
+    }
+
+    // Controller (x, y) to (col, row) for the current panel, calibration,
+    // grid and rotation.
+    void transform(int x, int y, int &col, int &row) const
+    {
+        xform_apply(_xform, _width, _height, x, y, col, row);
+        if (_grid_on)
+            grid_apply(col, row);
+    }
+
+    // Interpolate the four nodes around (col, row): 8-bit weights, so the
+    // sums stay in 32 bits.
+    void grid_apply(int &col, int &row) const
+    {
+        const GridXform &g = _grid_xform;
+        int gu = g.u_col * col + g.u_row * row + g.u_0;
+        int gv = g.v_col * col + g.v_row * row + g.v_0;
+        int iu = gu >> 16;
+        int iv = gv >> 16;
+        iu = iu < grid_u - 1 ? iu : grid_u - 2; // far edge: last cell
+        iv = iv < grid_v - 1 ? iv : grid_v - 2;
+        int fu = (gu >> 8) - (iu << 8); // 0..256
+        int fv = (gv >> 8) - (iv << 8);
+        const int8_t(*n0)[2] = &_grid.off[iv][iu];
+        const int8_t(*n1)[2] = &_grid.off[iv + 1][iu];
+        int w00 = (256 - fu) * (256 - fv);
+        int w10 = fu * (256 - fv);
+        int w01 = (256 - fu) * fv;
+        int w11 = fu * fv;
+        int du = (n0[0][0] * w00 + n0[1][0] * w10 + n1[0][0] * w01 +
+                  n1[1][0] * w11 + 0x8000) >> 16;
+        int dv = (n0[0][1] * w00 + n0[1][1] * w10 + n1[0][1] * w01 +
+                  n1[1][1] * w11 + 0x8000) >> 16;
+        col = clamp(col + g.col_u * du + g.col_v * dv, _width);
+        row = clamp(row + g.row_u * du + g.row_v * dv, _height);
+    }
+
+    // poll_due() says whether to start a frame read now: with INT attached,
+    // when there has been an edge; otherwise when the interval (see
+    // PollSched) has gone by since the last poll it said yes to.
+    // contacts_update() keeps track of when something was last touched;
+    // poll_wake() counts as a touch, e.g. at the end of init, and makes the
+    // next poll due at once.
+    bool poll_due();
+
+    void poll_wake()
+    {
+        _poll_touch_us = time_us_32();
+        _poll_next_us = _poll_touch_us;
+    }
+
 private:
 
     const int _phys_wid;
@@ -111,4 +778,218 @@ private:
     int _height;
 
     Rotation _rotation;
+
+    Panel _panel;
+    Calibration _cal;
+
+    Grid _grid;
+    bool _grid_on;
+
+    // (col, row) -> portrait grid coordinates in 16.16, and portrait
+    // offsets (du, dv) -> (dcol, drow), for the current rotation
+    struct GridXform {
+        int32_t u_col, u_row, u_0;
+        int32_t v_col, v_row, v_0;
+        int col_u, col_v;
+        int row_u, row_v;
+    } _grid_xform;
+
+    void grid_xform_build();
+
+    Xform _xform;
+
+    // (col, row) in the current rotation <-> (u, v) in portrait
+    void unrotate(int col, int row, int &u, int &v) const;
+    void rotate(int u, int v, int &col, int &row) const;
+
+    void xform_build()
+    {
+        _xform = xform_make(_panel, _phys_wid, _phys_hgt, _rotation, _cal);
+        grid_xform_build();
+    }
+
+    static int clamp(int v, int len)
+    {
+        return v < 0 ? 0 : v >= len ? len - 1 : v;
+    }
+
+    // Affine map in 16.16 fixed point: (x, y) -> (a x + b y + c, d x + e y + f)
+    struct Affine {
+        int64_t a, b, c;
+        int64_t d, e, f;
+    };
+
+    static constexpr int64_t fix_one = int64_t(1) << 16;
+
+    // outer(inner(x, y))
+    static constexpr Affine affine_compose(const Affine &o, const Affine &i)
+    {
+        return {
+            (o.a * i.a + o.b * i.d) >> 16,
+            (o.a * i.b + o.b * i.e) >> 16,
+            ((o.a * i.c + o.b * i.f) >> 16) + o.c,
+            (o.d * i.a + o.e * i.d) >> 16,
+            (o.d * i.b + o.e * i.e) >> 16,
+            ((o.d * i.c + o.e * i.f) >> 16) + o.f,
+        };
+    }
+
+    // 0..in_len-1 onto 0..out_len-1
+    static constexpr int64_t affine_scale(int in_len, int out_len)
+    {
+        return ((int64_t(out_len - 1) << 16) + (in_len - 1) / 2) /
+               (in_len - 1);
+    }
+
+    BusStats _bus_stats;
+    uint32_t _bus_baud;
+
+    TouchTrace *_trace;
+
+    Contact _contacts[contact_max];
+    int _contact_cnt;
+
+    JitterFilter _jitter_filter;
+    bool _jitter_on;
+
+    // Per contact, going with _contacts[]. Kept up to date with the filter
+    // off too, so turning it on mid-contact starts from the contact.
+    struct JitterState {
+        int32_t col, row;   // filtered, 1/256 pixel
+        int32_t dcol, drow; // filtered speed, 1/256 pixel/sec
+        uint32_t us;        // frame time of the last update
+    };
+    JitterState _jitter[contact_max];
+
+    void jitter_start(JitterState &state, const Contact &raw) const;
+    void jitter_step(JitterState &state, const Contact &raw,
+                     const Contact &prev, Contact &out) const;
+    static int32_t jitter_alpha(uint32_t cutoff_mhz, uint32_t dt_us);
+
+    Predictor _predictor;
+    bool _predict_on;
+
+    // Per contact, going with _contacts[], kept up to date like JitterState
+    struct PredictState {
+        int32_t col, row;   // tracked, 1/256 pixel
+        int32_t vcol, vrow; // tracked velocity, 1/256 pixel/sec
+        uint32_t us;        // frame time of the last update
+        int last_col, last_row; // last event out for the contact
+    };
+    PredictState _predict[contact_max];
+
+    void predict_start(PredictState &state, const Contact &cur) const;
+    // Returns true with (col, row) if there is a new prediction to report.
+    bool predict_step(PredictState &state, const Contact &cur, int &col,
+                      int &row) const;
+
+    // Up to contact_max ups and contact_max downs from one frame. A
+    // contact with a move (and maybe a prediction) has no up or down, so
+    // predictions don't add to that.
+    static constexpr int pend_max = 2 * contact_max;
+    Event _pending[pend_max + 1]; // one slot always empty
+    int _pend_head; // next to pop
+    int _pend_tail; // next to push
+
+    void event_push(Event event);
+
+    // times for the frame being read, see frame_start()
+    uint32_t _frame_int_us;
+    uint32_t _frame_poll_us;
+    uint32_t _frame_status_us;
+    uint32_t _frame_data_us;
+
+    LatencyHist _latency[latency_cnt];
+
+    EventRing<Event, event_ring_len, contact_max> _event_ring;
+
+    // consumer side, get_frame_events() only
+    FrameBatch<Event, event_ring_len> _frame_batch;
+
+    std::atomic<uint32_t> _snap_seq; // odd while _snap is being written
+    Snapshot _snap;
+
+    void snapshot_publish();
+
+    static Touchscreen *_irq_owner;
+    static void irq_handler();
+
+    int _irq_gpio; // -1 if not attached
+    uint32_t _irq_events;
+    volatile uint32_t _irq_cnt; // written only by irq_handler()
+    volatile uint32_t _irq_us;  // written only by irq_handler()
+    uint32_t _irq_seen;
+    bool _irq_sync; // next irq_take() is the one irq_attach() set up
+
+    PollSched _poll_sched;
+    uint32_t _poll_touch_us; // something was last touched
+    uint32_t _poll_next_us;  // next poll is due
 };
+
+
+// Controller (x, y) -> mirrored -> swapped -> portrait (u, v) on the
+// display, scaled -> calibrated -> rotated (col, row), composed into one map.
+constexpr Touchscreen::Xform Touchscreen::xform_make(const Panel &panel,
+                                                   int phys_wid, int phys_hgt,
+                                                   Rotation rotation,
+                                                   const Calibration &cal)
+{
+    const Panel &p = panel;
+    const int64_t wid = phys_hgt; // in portrait
+    const int64_t hgt = phys_wid;
+
+    Affine m = {fix_one, 0, 0, 0, fix_one, 0};
+    if (p.mirror_x) {
+        m.a = -fix_one;
+        m.c = (p.x_res - 1) * fix_one;
+    }
+    if (p.mirror_y) {
+        m.e = -fix_one;
+        m.f = (p.y_res - 1) * fix_one;
+    }
+
+    int x_res = p.x_res;
+    int y_res = p.y_res;
+    if (p.swap_xy) {
+        m = affine_compose({0, fix_one, 0, fix_one, 0, 0}, m);
+        x_res = p.y_res;
+        y_res = p.x_res;
+    }
+
+    if (x_res <= y_res) {
+        // portrait already
+        m = affine_compose({affine_scale(x_res, wid), 0, 0, //
+                            0, affine_scale(y_res, hgt), 0},
+                           m);
+    } else {
+        // landscape: u = row, v = (hgt - 1) - col
+        m = affine_compose({0, affine_scale(y_res, wid), 0,
+                            -affine_scale(x_res, hgt), 0, (hgt - 1) * fix_one},
+                           m);
+    }
+
+    m = affine_compose({cal.a, cal.b, cal.c, cal.d, cal.e, cal.f}, m);
+
+    Affine r{};
+    switch (rotation) {
+        case Rotation::portrait:
+            r = {fix_one, 0, 0, 0, fix_one, 0};
+            break;
+        case Rotation::landscape:
+            r = {0, -fix_one, (hgt - 1) * fix_one, fix_one, 0, 0};
+            break;
+        case Rotation::landscape2:
+            r = {0, fix_one, 0, -fix_one, 0, (wid - 1) * fix_one};
+            break;
+        case Rotation::portrait2:
+        default:
+            r = {-fix_one, 0, (wid - 1) * fix_one, //
+                 0, -fix_one, (hgt - 1) * fix_one};
+            break;
+    }
+    m = affine_compose(r, m);
+
+    // round to nearest rather than down
+    return {int32_t(m.a), int32_t(m.b), int32_t(m.c + fix_one / 2),
+            int32_t(m.d), int32_t(m.e), int32_t(m.f + fix_one / 2)};
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <utility>
+// touchscreen
+#include "touchscreen.h"
+
+
+// A driver with the display, panel and rotation fixed at build time
+//
+//   TouchscreenFixed<Gt911, 480, 320, Touchscreen::Rotation::landscape>
+//       ts(i2c, i2c_addr, rst_pin, int_pin);
+//
+// get_event() maps coordinates with constants the compiler folds into the
+// frame parsing, and since the class is final, calls made through it (not
+// through a Touchscreen &) are direct and can be inlined. The bus engine
+// and the contact tracker stay the driver's own out-of-line code, shared
+// with the plain driver; host_bench (bench=dispatch) times the parse and
+// map against it and prints both code sizes. It is still a Touchscreen, so
+// code that takes one works unchanged. set_rotation() to anything but
+// rotation asserts.
+//
+// x_res and y_res are the controller's, default the display in portrait
+// (the 3.5" GT911 and FT6336U panels). init() still reads the GT911's
+// XY_RES for get_touches(), but get_event() goes by x_res and y_res, and
+// does not apply a calibration (see Touchscreen::set_calibration()). It
+// does apply the edge grid (Touchscreen::set_grid()), after the constant
+// map, for one branch per point while the grid is off. The panel is taken
+// to be unswapped and unmirrored: set_panel() with any other geometry
+// asserts, and Gt911::config_write() refuses to change x2y, x2x or y2y.
+template <typename Driver, int width, int height,
+          Touchscreen::Rotation rotation, int x_res = height,
+          int y_res = width>
+class TouchscreenFixed final : public Driver
+{
+public:
+
+    // Driver's constructor arguments, less width and height
+    template <typename... Args>
+    TouchscreenFixed(Args &&...args) :
+        Driver(std::forward<Args>(args)..., width, height)
+    {
+        Driver::set_rotation(rotation);
+        Driver::set_panel(panel);
+    }
+
+    virtual void set_rotation(Touchscreen::Rotation r) override
+    {
+        assert(r == rotation);
+        Driver::set_rotation(r);
+    }
+
+    // Only the built-in geometry; the resolution may differ (see above).
+    virtual bool panel_allowed(const Touchscreen::Panel &p) const override
+    {
+        return p.swap_xy == panel.swap_xy && p.mirror_x == panel.mirror_x &&
+               p.mirror_y == panel.mirror_y;
+    }
+
+    virtual Touchscreen::Event get_event() override
+    {
+        return this->event_step([this](int x, int y, int &col, int &row) {
+            fixed_map(x, y, col, row);
+        });
+    }
+
+private:
+
+    friend struct FrameAccess; // host tests and benchmarks
+
+    // Driver::frame_events() with the same map (Gt911 only); not virtual,
+    // like the rest of the fixed flavor's calls it is made on the class
+    int frame_events(const uint8_t frame[], Touchscreen::Event events[],
+                     int event_cnt_max)
+    {
+        return this->frame_step(frame, events, event_cnt_max,
+                                [this](int x, int y, int &col, int &row) {
+                                    fixed_map(x, y, col, row);
+                                });
+    }
+
+    static constexpr Touchscreen::Panel panel = {x_res, y_res, false, false,
+                                                 false};
+
+    static constexpr bool landscape =
+        rotation == Touchscreen::Rotation::landscape ||
+        rotation == Touchscreen::Rotation::landscape2;
+
+    static constexpr int col_len = landscape ? width : height;
+    static constexpr int row_len = landscape ? height : width;
+
+    static constexpr Touchscreen::Xform xform =
+        Touchscreen::xform_make(panel, width, height, rotation,
+                                Touchscreen::Calibration());
+
+    void fixed_map(int x, int y, int &col, int &row) const
+    {
+        Touchscreen::xform_apply(xform, col_len, row_len, x, y, col, row);
+        if (this->grid_on())
+            this->grid_apply(col, row);
+    }
+};
@@ -4,27 +4,37 @@
 #include <cstdio>
 // pico
 #include "hardware/gpio.h"
-#include "hardware/i2c.h"
 #include "pico/stdlib.h"
+// misc
+#include "i2c_dev.h"
 // touchscreen
 #include "ft6336u.h"
 #include "touchscreen.h"
 
 
-Ft6336u::Ft6336u(i2c_inst_t *i2c, int scl_pin, int sda_pin, int rst_pin,
-                 int int_pin, int i2c_freq) :
-    Touchscreen(480, 320),
+Ft6336u::Ft6336u(I2cDev &i2c, int scl_pin, int sda_pin, int rst_pin,
+                 int int_pin, int width, int height) :
+    Touchscreen(width, height),
     _i2c(i2c),
     _scl_pin(scl_pin),
     _sda_pin(sda_pin),
     _rst_pin(rst_pin),
-    _int_pin(int_pin)
+    _int_pin(int_pin),
+    _init_state(InitState::none),
+    _init_verbosity(0),
+    _init_us(0),
+    _init_rd_busy(false),
+    _predictive_read(false),
+    _burst_cnt(0),
+    _i2c_state(I2cState::idle),
+    _regs_cnt(0),
+    _touch_cnt(0)
 {
-    assert(_i2c != nullptr);
-    _i2c_freq = i2c_init(_i2c, i2c_freq);
+    // Just drive the I2C signals low for now. Init will switch them back to
+    // I2C.
+    bus_baud(_i2c.baud());
+    set_poll_sched(poll_sched_def);
 
-    // Just drive the I2C signals low for now. The reset() method will switch
-    // them back to I2C.
     assert(_scl_pin >= 0);
     out_low(_scl_pin);
 
@@ -44,158 +54,272 @@ Ft6336u::Ft6336u(i2c_inst_t *i2c, int scl_pin, int sda_pin, int rst_pin,
 }
 
 
-void Ft6336u::reset()
+// verbosity:
+// 0 - never print anything
+// 1 - print message on error
+// 2 - print registers as read
+bool Ft6336u::init(int verbosity)
 {
-    // When coming out of reset, the data sheet says INT and the I2C lines
-    // should be low. INT is an input pulled low (constructor above) so it
-    // shoule bo okay. Set the I2C lines to be low outputs while driving
-    // reset, then switch them back to being I2C lines.
-
-    gpio_put(_rst_pin, false); // low
-
-    sleep_ms(1);
-
-    // I2C signals low
-    out_low(_scl_pin);
-    out_low(_sda_pin);
-
-    sleep_ms(TRST_ms);
-
-    gpio_put(_rst_pin, true); // high
+    init_start(verbosity);
+    while (!init_poll())
+        tight_loop_contents();
+    return ready();
+}
 
-    // The data sheet doesn't say what the timing is from releasing reset to
-    // having INT not driven and enabling I2C (letting the I2C lines go high).
 
-    sleep_ms(1);
+// Incremental Init
+//
+// Reset: when coming out of reset, the data sheet says INT and the I2C lines
+// should be low. INT is an input pulled low (constructor above) so it should
+// be okay. Set the I2C lines to be low outputs while driving reset, then
+// switch them back to being I2C lines. Then wait for the FT6336U to drive
+// INT high, and a while longer for it to be ready.
+//
+// After reset, FOCALTECH_ID and CIPHER_MID..CIPHER_HIGH are checked with
+// async reads, one per init_poll() state.
 
-    // INT should already be an input, pulled down (constructor).
+void Ft6336u::init_start(int verbosity)
+{
+    // reset puts the tuning registers back; go back to polling
+    irq_detach();
+    PollSched ps = poll_sched();
+    ps.min_us = poll_sched_def.min_us;
+    if (ps.max_us < ps.min_us)
+        ps.max_us = ps.min_us;
+    set_poll_sched(ps);
+    _i2c_state = I2cState::idle;
+
+    _init_verbosity = verbosity;
+    _init_rd_busy = false;
 
-    // Enable I2C. The internal GPIO pull-ups are only 50K - 80K, so let's
-    // just require external ones and not bother with the internal ones.
-    gpio_set_function(_scl_pin, GPIO_FUNC_I2C);
-    gpio_set_function(_sda_pin, GPIO_FUNC_I2C);
+    gpio_put(_rst_pin, false); // low
+    init_next(InitState::rst_low, 1'000);
+}
 
-    // We are pulling INT low until the FT6336 drives it high.
-    // Wait for INT to go high, then the first low pulse.
 
-    uint32_t start_us;
-    constexpr uint32_t max_wait_us = 1'000'000; // no idea
+bool Ft6336u::init_poll()
+{
+    const int verbosity = _init_verbosity;
+    int32_t late_us;
+
+    switch (_init_state) {
+
+        case InitState::rst_low:
+            if (!init_waited())
+                break;
+            // I2C signals low
+            out_low(_scl_pin);
+            out_low(_sda_pin);
+            init_next(InitState::i2c_low, TRST_ms * 1'000);
+            break;
+
+        case InitState::i2c_low:
+            if (!init_waited())
+                break;
+            gpio_put(_rst_pin, true); // high
+            // The data sheet doesn't say what the timing is from releasing
+            // reset to having INT not driven and enabling I2C (letting the
+            // I2C lines go high).
+            init_next(InitState::rst_high, 1'000);
+            break;
+
+        case InitState::rst_high:
+            if (!init_waited())
+                break;
+            // INT should already be an input, pulled down (constructor).
+
+            // Enable I2C. The internal GPIO pull-ups are only 50K - 80K, so
+            // let's just require external ones and not bother with the
+            // internal ones.
+            gpio_set_function(_scl_pin, GPIO_FUNC_I2C);
+            gpio_set_function(_sda_pin, GPIO_FUNC_I2C);
+
+            // We are pulling INT low until the FT6336 drives it high.
+            // Without INT, just wait as long as it usually takes.
+            if (_int_pin >= 0)
+                init_next(InitState::int_high, int_high_max_us);
+            else
+                init_next(InitState::settle, int_high_typ_us + settle_us);
+            break;
+
+        case InitState::int_high:
+            // wait for INT high
+            // measured to be ~125 msec
+            if (gpio_get(_int_pin)) {
+                if (verbosity >= 2) {
+                    late_us = time_us_32() - _init_us;
+                    printf("Ft6336u: INT high %ld usec after reset\n",
+                           long(late_us + int32_t(int_high_max_us)));
+                }
+                // wait more after INT goes high
+                init_next(InitState::settle, settle_us);
+            } else if (init_waited()) {
+                if (verbosity >= 1)
+                    printf("Ft6336u: ERROR: INT not high after reset\n");
+                _init_state = InitState::failed;
+            }
+            break;
+
+        case InitState::settle:
+            if (!init_waited())
+                break;
+            init_next(InitState::focaltech_id);
+            break;
+
+        case InitState::focaltech_id:
+            if (!init_read(Reg::FOCALTECH_ID, 1))
+                break;
+            if (verbosity >= 2) {
+                printf("Ft6336u: register 0x%02x = 0x%02x\n",
+                       int(Reg::FOCALTECH_ID), int(_init_buf[0]));
+            }
+            if (_init_buf[0] != 0x11) {
+                if (verbosity >= 1)
+                    printf("Ft6336u: ERROR: register 0x%02x = 0x%02x,"
+                           " expected 0x%02x\n",
+                           int(Reg::FOCALTECH_ID), int(_init_buf[0]), 0x11);
+                _init_state = InitState::failed; // incorrect ID
+                break;
+            }
+            init_next(InitState::cipher);
+            break;
+
+        case InitState::cipher:
+            if (!init_read(Reg::CIPHER_MID, 5))
+                break;
+            if (verbosity >= 2) {
+                printf("Ft6336u: registers 0x%02x..0x%02x =",
+                       int(Reg::CIPHER_MID), int(Reg::CIPHER_MID) + 4);
+                for (int i = 0; i < 5; i++)
+                    printf(" 0x%02x", int(_init_buf[i]));
+                printf("\n");
+            }
+            if (_init_buf[0] != 0x26) {
+                if (verbosity >= 1)
+                    printf("Ft6336u: ERROR: register 0x%02x = 0x%02x,"
+                           " expected 0x%02x\n",
+                           int(Reg::CIPHER_MID), int(_init_buf[0]), 0x26);
+                _init_state = InitState::failed; // incorrect CIPHER_MID
+                break;
+            }
+            if (_init_buf[1] != 0x00 && _init_buf[1] != 0x01 &&
+                _init_buf[1] != 0x02) {
+                if (verbosity >= 1)
+                    printf("Ft6336u: ERROR: register 0x%02x = 0x%02x,"
+                           " expected 0x%02x, 0x%02x, or 0x%02x\n",
+                           int(Reg::CIPHER_MID) + 1, int(_init_buf[1]), 0x00,
+                           0x01, 0x02);
+                _init_state = InitState::failed; // incorrect CIPHER_LOW
+                break;
+            }
+            if (_init_buf[4] != 0x64) {
+                if (verbosity >= 1)
+                    printf("Ft6336u: ERROR: register 0x%02x = 0x%02x,"
+                           " expected 0x%02x\n",
+                           int(Reg::CIPHER_MID) + 4, int(_init_buf[4]), 0x64);
+                _init_state = InitState::failed; // incorrect CIPHER_HIGH
+                break;
+            }
+            poll_wake();
+            _init_state = InitState::ready;
+            break;
+
+        case InitState::none:
+            return false; // init_start() not called yet
+
+        case InitState::ready:
+        case InitState::failed:
+            return true;
+
+        default:
+            assert(false);
+            break;
+
+    } // switch (_init_state)
+
+    return _init_state == InitState::ready || _init_state == InitState::failed;
+}
 
-    // wait for INT high
-    // measured to be ~125 msec
-    start_us = time_us_32();
-    while (!gpio_get(_int_pin) && (time_us_32() - start_us) <= max_wait_us)
-        ;
-    assert(gpio_get(_int_pin));
-    printf("INT high %lu usec after reset\n", time_us_32() - start_us);
 
-#if 0
-    // wait for INT low
-    start_us = time_us_32();
-    while (gpio_get(_int_pin) && (time_us_32() - start_us) <= max_wait_us)
-        ;
-    assert(!gpio_get(_int_pin));
-    printf("INT low %lu usec after INT high\n", time_us_32() - start_us);
-#else
-    // sleep more after INT goes high
-    sleep_ms(600);
-#endif
+void Ft6336u::init_next(InitState state, uint32_t wait_us)
+{
+    _init_state = state;
+    _init_us = time_us_32() + wait_us;
 }
 
 
-// verbosity:
-// 0 - never print anything
-// 1 - print message on error
-// 2 - print registers as read
-bool Ft6336u::init(int verbosity)
+bool Ft6336u::init_waited() const
 {
-    reset();
+    int32_t late_us = time_us_32() - _init_us; // rollover-safe
+    return late_us >= 0;
+}
 
-    uint8_t buf[5];
 
-    if (read(Reg::FOCALTECH_ID, buf, 1) != 1) {
-        if (verbosity >= 1)
-            printf("Ft6336u: ERROR: reading 0x%02x\n", int(Reg::FOCALTECH_ID));
-        return false; // error reading ID
-    }
-    if (verbosity >= 2) {
-        printf("Ft6336u: register 0x%02x = 0x%02x\n", int(Reg::FOCALTECH_ID),
-               int(buf[0]));
-    }
-    if (buf[0] != 0x11) {
-        if (verbosity >= 1)
-            printf(
-                "Ft6336u: ERROR: register 0x%02x = 0x%02x, expected 0x%02x\n",
-                int(Reg::FOCALTECH_ID), int(buf[0]), 0x11);
-        return false; // incorrect ID
+// The first call starts an async read of reg into _init_buf; later calls
+// check on it. Returns true once the data is there. On error, the init
+// state goes to failed.
+bool Ft6336u::init_read(Reg reg, int buf_len)
+{
+    assert(buf_len <= int(sizeof(_init_buf)));
+
+    if (!_init_rd_busy) {
+        const uint8_t wr_buf[] = {reg};
+        bus_start(i2c_adrs, wr_buf, sizeof(wr_buf), buf_len);
+        _i2c.write_read_async_start(i2c_adrs, wr_buf, sizeof(wr_buf), //
+                                    _init_buf, buf_len);
+        _init_rd_busy = true;
+        return false;
     }
 
-    if (read(Reg::CIPHER_MID, buf, 5) != 5) {
-        if (verbosity >= 1)
-            printf("Ft6336u: ERROR: reading 0x%02x..0x%02x\n",
-                   int(Reg::CIPHER_MID), int(Reg::CIPHER_MID) + 4);
-        return false; // error reading IDs
-    }
-    if (verbosity >= 2) {
-        printf("Ft6336u: registers 0x%02x..0x%02x =", int(Reg::FOCALTECH_ID),
-               int(Reg::FOCALTECH_ID) + 4);
-        for (int i = 0; i < 5; i++)
-            printf(" 0x%02x", int(buf[i]));
-        printf("\n");
-    }
-    if (buf[0] != 0x26) {
-        if (verbosity >= 1)
-            printf(
-                "Ft6336u: ERROR: register 0x%02x = 0x%02x, expected 0x%02x\n",
-                int(Reg::CIPHER_MID), int(buf[0]), 0x26);
-        return false; // incorrect CIPHER_MID
-    }
-    if (buf[1] != 0x00 && buf[1] != 0x01 && buf[1] != 0x02) {
-        if (verbosity >= 1)
-            printf(
-                "Ft6336u: ERROR: register 0x%02x = 0x%02x,"
-                " expected 0x%02x, 0x%02x, or 0x%02x\n",
-                int(Reg::CIPHER_MID) + 1, int(buf[1]), 0x00, 0x01, 0x02);
-        return false; // incorrect CIPHER_LOW
-    }
-    if (buf[4] != 0x64) {
-        if (verbosity >= 1)
-            printf(
-                "Ft6336u: ERROR: register 0x%02x = 0x%02x, expected 0x%02x\n",
-                int(Reg::CIPHER_MID) + 4, int(buf[4]), 0x64);
-        return false; // incorrect CIPHER_HIGH
+    if (_i2c.busy())
+        return false;
+
+    _init_rd_busy = false;
+    int rd_len = _i2c.write_read_async_check();
+    bus_result(rd_len, buf_len, _init_buf);
+    if (rd_len != buf_len) {
+        if (_init_verbosity >= 1)
+            printf("Ft6336u: ERROR: reading 0x%02x\n", int(reg));
+        _init_state = InitState::failed;
+        return false;
     }
     return true;
 }
 
 
-void Ft6336u::set_rotation(Rotation r)
-{
-    Touchscreen::set_rotation(r);
-    // TBD
-}
-
-
-int Ft6336u::get_touches(int *col, int *row, int touch_cnt_max, int verbosity)
+int Ft6336u::get_touches(Contact contacts[], int touch_cnt_max,
+                         int verbosity)
 {
-    constexpr int buf_len = 13;
-    uint8_t buf[buf_len];
+    uint8_t buf[regs_len(touch_max)];
 
     // Read:
     //   TD_STATUS,
     //   P1_XH, P1_XL, P1_YH, P1_YL, P1_WEIGHT, P1_MISC,
     //   P2_XH, P2_XL, P2_YH, P2_YL, P2_WEIGHT, P2_MISC
     // Each read takes [adrs/w, reg/w, adrs/r, data/r, data/r...] on i2c,
-    // or 3 + n_bytes. Doing three reads (TD_STATUS, P1_*, P2_*) where we
-    // ignore WEIGHT and MISC takes 4 + 7 + 7 = 18 i2c bytes. Just reading
-    // everything at once takes 16 i2c bytes and is more fun.
-    // But we usually only need the status register (touch count = 0) or it
-    // plus four more (touch count = 1).
+    // or 3 + n_bytes. Reading everything every time takes 16 i2c bytes,
+    // but we usually only need the status register (touch count = 0) or it
+    // plus one point (touch count = 1), so read as many points as we saw
+    // last time (see set_predictive_read) and go back for more if needed.
+    int buf_len = regs_len(_burst_cnt);
     if (read(Reg::TD_STATUS, buf, buf_len) != buf_len) {
         if (verbosity >= 1)
             printf("Ft6336::get_touch: ERROR: reading registers\n");
         return -1;
     }
+
+    int touch_cnt = buf[0] & 0x0f;
+    if (_burst_cnt < touch_cnt && touch_cnt <= touch_max) {
+        int rd_len = regs_len(touch_cnt) - buf_len;
+        if (read(Reg(Reg::TD_STATUS + buf_len), buf + buf_len, rd_len) !=
+            rd_len) {
+            if (verbosity >= 1)
+                printf("Ft6336::get_touch: ERROR: reading registers\n");
+            return -1;
+        }
+        buf_len += rd_len;
+    }
+
     if (verbosity >= 2) {
         printf("Ft6336u::get_touch:");
         for (int i = 0; i < buf_len; i++)
@@ -203,45 +327,54 @@ int Ft6336u::get_touches(int *col, int *row, int touch_cnt_max, int verbosity)
         printf("\n");
     }
 
-    int touch_cnt = buf[0] & 0x0f;
-    // should be 0, 1, or 2
-    if (touch_cnt < 0 || touch_cnt > 2) {
+    Contact touches[touch_max];
+    touch_cnt = parse_touches(buf, touches,
+                              [this](int x, int y, int &col, int &row) {
+                                  transform(x, y, col, row);
+                              });
+    if (touch_cnt < 0) {
         if (verbosity >= 1)
             printf("Ft6336::get_touch: ERROR: TD_STATUS=0x%02x invalid\n",
                    int(buf[0]));
         return -1;
     }
+    burst_update(touch_cnt);
 
-    if (touch_cnt >= 1 && touch_cnt_max >= 1) {
-        //int e = (buf[1] >> 6) & 0x03;
-        int x = (int(buf[1] & 0x0f) << 8) | buf[2];
-        int y = (int(buf[3] & 0x0f) << 8) | buf[4];
-        rotate(x, y, col[0], row[0]);
-        // buf[5], buf[6] not yet used
-        if (touch_cnt >= 2 && touch_cnt_max >= 2) {
-            //e = (buf[7] >> 6) & 0x03;
-            x = (int(buf[7] & 0x0f) << 8) | buf[8];
-            y = (int(buf[9] & 0x0f) << 8) | buf[10];
-            rotate(x, y, col[1], row[1]);
-            // buf[11], buf[12] not yet used
-        }
-    }
+    for (int t = 0; t < touch_cnt && t < touch_cnt_max; t++)
+        contacts[t] = touches[t];
 
     return touch_cnt;
 }
 
-// Both i2c_write and i2c_read return:
+
+void Ft6336u::burst_update(int touch_cnt)
+{
+    if (_predictive_read && touch_cnt > 0 && touch_cnt < _burst_cnt)
+        return; // gesture still going; keep the longer read
+    _burst_cnt = touch_cnt;
+}
+
+
+// Both write_sync and read_sync return:
 //   number of bytes on success
 //   PICO_ERROR_GENERIC if no ack
 //   PICO_ERROR_TIMEOUT if timeout
 int Ft6336u::read(Ft6336u::Reg reg, uint8_t *buf, int buf_len)
 {
+    constexpr int xbuf_len = sizeof(reg);
+    const uint8_t xbuf[xbuf_len] = {reg};
+
+    bus_start(i2c_adrs, xbuf, xbuf_len, buf_len);
+
     constexpr uint timeout_us = 10'000;
-    int err = i2c_write_timeout_us(_i2c, i2c_adrs, (const uint8_t *)(&reg), 1,
-                                   true, timeout_us);
-    if (err != 1)
+    int err = _i2c.write_sync(i2c_adrs, xbuf, xbuf_len, true, timeout_us);
+    if (err != xbuf_len) {
+        bus_result(err, xbuf_len);
         return err;
-    return i2c_read_timeout_us(_i2c, i2c_adrs, buf, buf_len, false, timeout_us);
+    }
+    int ret = _i2c.read_sync(i2c_adrs, buf, buf_len, false, timeout_us);
+    bus_result(ret, buf_len, buf);
+    return ret;
 }
 
 
@@ -257,32 +390,271 @@ int Ft6336u::write(Ft6336u::Reg reg, const uint8_t *buf, int buf_len)
         xbuf[i + 1] = buf[i];
     }
 
+    bus_start(i2c_adrs, xbuf, buf_len + 1, 0);
+
     constexpr uint timeout_us = 10'000;
-    int ret = 0;
-    ret = i2c_write_timeout_us(_i2c, i2c_adrs, xbuf, buf_len + 1, false,
-                               timeout_us);
+    int ret = _i2c.write_sync(i2c_adrs, xbuf, buf_len + 1, false, timeout_us);
+    bus_result(ret, buf_len + 1);
     if (ret >= 0)
-        return ret + 1;
+        return ret - 1; // return buf_len if everything went ok
     else
         return ret; // negative, error code
 }
 
 
-// Given a reading (x, y) from the chip, use its physical x_res and y_res
-// along with the touchscreen's rotation to adjust (x, y) to the correct
-// coordinates.
-void Ft6336u::rotate(int x, int y, int &col, int &row) const
+// Event State Machine
+
+
+Touchscreen::Event Ft6336u::get_event()
 {
-    // TBD
-    col = x;
-    row = y;
+    return event_step([this](int x, int y, int &col, int &row) {
+        transform(x, y, col, row);
+    });
 }
 
 
-Touchscreen::Event Ft6336u::get_event()
+// Returns true when a complete read is in _regs.
+bool Ft6336u::engine_step()
+{
+    if (!ready() || _i2c.busy())
+        return false; // nothing new
+
+    switch (_i2c_state) {
+
+        case I2cState::idle:
+            // wait for the next poll time, or in INT trigger mode, for the
+            // FT6336U to pulse INT
+            if (poll_due())
+                start_status_read();
+            break;
+
+        case I2cState::status_read:
+            return check_status_read();
+
+        case I2cState::touch_read:
+            return check_touch_read();
+
+        default:
+            assert(false);
+            break;
+
+    } // switch (_i2c_state)
+
+    return false;
+}
+
+
+// TD_STATUS and the points we expect (see set_predictive_read)
+void Ft6336u::start_status_read()
+{
+    const uint8_t wr_buf[] = {Reg::TD_STATUS};
+    frame_start();
+    _regs_cnt = _burst_cnt;
+    int rd_len = regs_len(_regs_cnt);
+    bus_start(i2c_adrs, wr_buf, sizeof(wr_buf), rd_len);
+    _i2c.write_read_async_start(i2c_adrs, wr_buf, sizeof(wr_buf), //
+                                _regs, rd_len);
+    _i2c_state = I2cState::status_read;
+}
+
+
+// the points that did not come with TD_STATUS
+void Ft6336u::start_touch_read()
 {
-    Touchscreen::Event event;
-    return event;
+    assert(_touch_cnt > _regs_cnt);
+    const uint8_t wr_buf[] = {uint8_t(Reg::P1_XH + touch_reg_cnt * _regs_cnt)};
+    int rd_len = regs_len(_touch_cnt) - regs_len(_regs_cnt);
+    bus_start(i2c_adrs, wr_buf, sizeof(wr_buf), rd_len);
+    _i2c.write_read_async_start(i2c_adrs, wr_buf, sizeof(wr_buf), //
+                                _regs + regs_len(_regs_cnt), rd_len);
+    _i2c_state = I2cState::touch_read;
+}
+
+
+bool Ft6336u::check_status_read()
+{
+    int result = _i2c.write_read_async_check();
+    bus_result(result, regs_len(_regs_cnt), _regs);
+    if (result == regs_len(_regs_cnt)) {
+        frame_status();
+        _touch_cnt = _regs[0] & 0x0f;
+        if (_touch_cnt <= _regs_cnt) {
+            _i2c_state = I2cState::idle;
+            return true; // have everything (or no touches)
+        } else if (_touch_cnt <= touch_max) {
+            start_touch_read();
+            return false;
+        }
+    }
+    // bad read or bad TD_STATUS: wait for the next poll
+    _i2c_state = I2cState::idle;
+    return false;
+}
+
+
+bool Ft6336u::check_touch_read()
+{
+    int rd_len = regs_len(_touch_cnt) - regs_len(_regs_cnt);
+    int result = _i2c.write_read_async_check();
+    bus_result(result, rd_len, _regs + regs_len(_regs_cnt));
+    _i2c_state = I2cState::idle;
+    return result == rd_len;
+}
+
+
+// Tuning registers are in three runs: TH_GROUP; TH_DIFF through
+// PERIODMONITOR; and G_MODE.
+bool Ft6336u::tuning_read(Tuning &tuning, int verbosity)
+{
+    if (!ready() || _i2c_state != I2cState::idle) {
+        if (verbosity >= 1)
+            printf("Ft6336u::tuning_read: ERROR: event engine busy\n");
+        return false;
+    }
+
+    uint8_t th_group;
+    uint8_t th_diff[5]; // TH_DIFF, CTRL, ..., PERIODMONITOR
+    uint8_t g_mode;
+    static_assert(Reg::PERIODMONITOR - Reg::TH_DIFF + 1 == sizeof(th_diff));
+    if (read(Reg::TH_GROUP, &th_group, 1) != 1 ||
+        read(Reg::TH_DIFF, th_diff, sizeof(th_diff)) != sizeof(th_diff) ||
+        read(Reg::G_MODE, &g_mode, 1) != 1) {
+        if (verbosity >= 1)
+            printf("Ft6336u::tuning_read: ERROR: reading registers\n");
+        return false;
+    }
+
+    tuning.touch_thresh = th_group;
+    tuning.filter_coef = th_diff[0];
+    tuning.monitor_auto = th_diff[1] != 0;
+    tuning.monitor_wait_s = th_diff[2];
+    tuning.period_active = th_diff[3];
+    tuning.period_monitor = th_diff[4];
+    tuning.int_trigger = g_mode != 0;
+
+    if (verbosity >= 2)
+        printf("Ft6336u: th_group=%d th_diff=%d ctrl=%d timeentermonitor=%d "
+               "periodactive=%d periodmonitor=%d g_mode=%d\n",
+               int(th_group), int(th_diff[0]), int(th_diff[1]),
+               int(th_diff[2]), int(th_diff[3]), int(th_diff[4]),
+               int(g_mode));
+    return true;
+}
+
+
+bool Ft6336u::tuning_write(const Tuning &tuning, int verbosity)
+{
+    if (!ready() || _i2c_state != I2cState::idle) {
+        if (verbosity >= 1)
+            printf("Ft6336u::tuning_write: ERROR: event engine busy\n");
+        return false;
+    }
+
+    if (tuning.period_active < period_active_min ||
+        tuning.period_active > period_active_max) {
+        if (verbosity >= 1)
+            printf("Ft6336u::tuning_write: ERROR: period_active=%d not in"
+                   " %d..%d\n",
+                   int(tuning.period_active), period_active_min,
+                   period_active_max);
+        return false;
+    }
+
+    const uint8_t th_group = tuning.touch_thresh;
+    const uint8_t th_diff[] = {
+        tuning.filter_coef,
+        uint8_t(tuning.monitor_auto ? 1 : 0),
+        tuning.monitor_wait_s,
+        tuning.period_active,
+        tuning.period_monitor,
+    };
+    const uint8_t g_mode = tuning.int_trigger ? 1 : 0;
+    if (write(Reg::TH_GROUP, &th_group, 1) != 1 ||
+        write(Reg::TH_DIFF, th_diff, sizeof(th_diff)) != sizeof(th_diff) ||
+        write(Reg::G_MODE, &g_mode, 1) != 1) {
+        if (verbosity >= 1)
+            printf("Ft6336u::tuning_write: ERROR: writing registers\n");
+        return false;
+    }
+
+    // poll at the new report rate, or let INT say when
+    PollSched ps = poll_sched();
+    ps.min_us = tuning.period_active * 1'000;
+    if (ps.max_us < ps.min_us)
+        ps.max_us = ps.min_us;
+    set_poll_sched(ps);
+    if (tuning.int_trigger && _int_pin >= 0) {
+        if (!irq_attached())
+            irq_attach(_int_pin, false); // pulses low
+    } else {
+        irq_detach();
+    }
+
+    Tuning back;
+    if (!tuning_read(back, verbosity))
+        return false;
+    if (back.touch_thresh != tuning.touch_thresh ||
+        back.filter_coef != tuning.filter_coef ||
+        back.monitor_auto != tuning.monitor_auto ||
+        back.monitor_wait_s != tuning.monitor_wait_s ||
+        back.period_active != tuning.period_active ||
+        back.period_monitor != tuning.period_monitor ||
+        back.int_trigger != tuning.int_trigger) {
+        if (verbosity >= 1)
+            printf("Ft6336u::tuning_write: ERROR: read back differs\n");
+        return false;
+    }
+    return true;
+}
+
+
+bool Ft6336u::set_profile(Profile profile, int verbosity)
+{
+    Tuning tuning;
+    if (!tuning_read(tuning, verbosity))
+        return false;
+
+    switch (profile) {
+
+        case Profile::low_latency:
+            tuning.monitor_auto = false;
+            tuning.period_active = period_active_min;
+            break;
+
+        case Profile::balanced:
+            tuning.monitor_auto = true;
+            tuning.monitor_wait_s = 30;
+            tuning.period_active = 10;
+            tuning.period_monitor = 40;
+            break;
+
+        case Profile::low_power:
+        default:
+            tuning.monitor_auto = true;
+            tuning.monitor_wait_s = 2;
+            tuning.period_active = period_active_max;
+            tuning.period_monitor = 100;
+            break;
+
+    } // switch (profile)
+
+    tuning.int_trigger = true;
+    return tuning_write(tuning, verbosity);
+}
+
+
+const char *Ft6336u::profile_name(Profile profile)
+{
+    switch (profile) {
+        case Profile::low_latency:
+            return "low_latency";
+        case Profile::balanced:
+            return "balanced";
+        case Profile::low_power:
+            return "low_power";
+        default:
+            return "?";
+    }
 }
 
 
@@ -0,0 +1,342 @@
+
+#include <cstdint>
+#include <cstdlib>
+// touchscreen
+#include "gesture.h"
+#include "touchscreen.h"
+
+
+using EventType = Touchscreen::Event::Type;
+
+
+GestureRecognizer::GestureRecognizer() :
+    _config(),
+    _queue_head(0),
+    _queue_tail(0)
+{
+    reset();
+}
+
+
+void GestureRecognizer::reset()
+{
+    _track_cnt = 0;
+    _single = false;
+    _moved = false;
+    _long_pressed = false;
+    _tap_pend = false;
+    _tap_col = 0;
+    _tap_row = 0;
+    _tap_us = 0;
+    _pinch_armed = false;
+    _pinching = false;
+    _pinch_id[0] = _pinch_id[1] = -1;
+    _pinch_dx = _pinch_dy = 0;
+    _pinch_d2 = 1;
+    _queue_tail = _queue_head;
+}
+
+
+const char *GestureRecognizer::Gesture::type_name(Type type)
+{
+    switch (type) {
+        case Type::none:       return "none";
+        case Type::tap:        return "tap";
+        case Type::double_tap: return "double_tap";
+        case Type::long_press: return "long_press";
+        case Type::swipe:      return "swipe";
+        case Type::pinch:      return "pinch";
+        default:               return "unknown";
+    }
+}
+
+
+void GestureRecognizer::event(const Touchscreen::Event &event)
+{
+    switch (event.type) {
+        case EventType::down:
+            down(event);
+            break;
+        case EventType::move:
+            if (!event.predicted) // a guess, taken back by the next event
+                move(event);
+            break;
+        case EventType::up:
+            up(event);
+            break;
+        default:
+            break;
+    }
+    // a finger held still long enough, whether or not others moved
+    poll(event.time_us);
+}
+
+
+void GestureRecognizer::poll(uint32_t now_us)
+{
+    if (_tap_pend && now_us - _tap_us > _config.double_tap_us)
+        tap_flush();
+
+    if (_single && _track_cnt == 1 && !_moved && !_long_pressed &&
+        now_us - _tracks[0].down_us >= _config.long_press_us) {
+        tap_flush();
+        const Track &t = _tracks[0];
+        push(make(Gesture::Type::long_press, t.col0, t.row0, now_us));
+        _long_pressed = true;
+    }
+}
+
+
+bool GestureRecognizer::pop(Gesture &gesture)
+{
+    if (_queue_tail == _queue_head)
+        return false;
+    gesture = _queue[_queue_tail++ % queue_len];
+    return true;
+}
+
+
+GestureRecognizer::Track *GestureRecognizer::track_find(int id)
+{
+    for (int i = 0; i < _track_cnt; i++)
+        if (_tracks[i].id == id)
+            return &_tracks[i];
+    return nullptr;
+}
+
+
+void GestureRecognizer::down(const Touchscreen::Event &event)
+{
+    if (track_find(event.id) != nullptr ||
+        _track_cnt >= Touchscreen::contact_max)
+        return; // missed the up, or too many; keep what we have
+
+    // A pending tap that this cannot make a double tap of goes now.
+    if (_tap_pend &&
+        (event.time_us - _tap_us > _config.double_tap_us ||
+         abs(event.col - _tap_col) > _config.double_tap_slop ||
+         abs(event.row - _tap_row) > _config.double_tap_slop))
+        tap_flush();
+
+    Track &t = _tracks[_track_cnt++];
+    t.id = event.id;
+    t.col0 = t.col = event.col;
+    t.row0 = t.row = event.row;
+    t.down_us = event.time_us;
+
+    if (_track_cnt == 1) {
+        _single = true;
+        _moved = false;
+        _long_pressed = false;
+    } else {
+        _single = false;
+        if (_track_cnt == 2)
+            pinch_start();
+    }
+}
+
+
+void GestureRecognizer::move(const Touchscreen::Event &event)
+{
+    Track *t = track_find(event.id);
+    if (t == nullptr)
+        return;
+    t->col = event.col;
+    t->row = event.row;
+
+    if (_single && !_moved &&
+        (abs(t->col - t->col0) >= _config.tap_slop ||
+         abs(t->row - t->row0) >= _config.tap_slop))
+        _moved = true;
+
+    if (_pinch_armed &&
+        (event.id == _pinch_id[0] || event.id == _pinch_id[1]))
+        pinch_move(event.time_us);
+}
+
+
+void GestureRecognizer::up(const Touchscreen::Event &event)
+{
+    Track *t = track_find(event.id);
+    if (t == nullptr)
+        return;
+    t->col = event.col;
+    t->row = event.row;
+
+    if (_single && _track_cnt == 1)
+        single_up(*t, event.time_us);
+
+    if (event.id == _pinch_id[0] || event.id == _pinch_id[1]) {
+        _pinch_armed = false;
+        _pinching = false;
+        _pinch_id[0] = _pinch_id[1] = -1;
+    }
+
+    *t = _tracks[--_track_cnt]; // order does not matter
+}
+
+
+void GestureRecognizer::single_up(const Track &t, uint32_t time_us)
+{
+    if (_long_pressed)
+        return;
+
+    const uint32_t dt_us = time_us - t.down_us;
+
+    if (!_moved) {
+        if (dt_us > _config.tap_us)
+            return; // held, but not long enough for a long press
+        if (_tap_pend) {
+            // down() already let go of a tap this could not pair with
+            _tap_pend = false;
+            push(make(Gesture::Type::double_tap, t.col0, t.row0, time_us));
+        } else if (_config.double_tap_us == 0) {
+            push(make(Gesture::Type::tap, t.col0, t.row0, time_us));
+        } else {
+            _tap_pend = true;
+            _tap_col = t.col0;
+            _tap_row = t.row0;
+            _tap_us = time_us;
+        }
+        return;
+    }
+
+    const int dx = t.col - t.col0;
+    const int dy = t.row - t.row0;
+    const bool horz = abs(dx) >= abs(dy);
+    const int dist = horz ? abs(dx) : abs(dy);
+    if (dist < _config.swipe_min)
+        return;
+    const int speed =
+        int(uint64_t(dist) * 1'000'000 / (dt_us > 0 ? dt_us : 1));
+    if (speed < _config.swipe_speed_min)
+        return;
+
+    Gesture g = make(Gesture::Type::swipe, t.col0, t.row0, time_us);
+    if (horz)
+        g.dir = dx > 0 ? Gesture::Dir::right : Gesture::Dir::left;
+    else
+        g.dir = dy > 0 ? Gesture::Dir::down : Gesture::Dir::up;
+    g.speed = speed;
+    push(g);
+}
+
+
+void GestureRecognizer::pinch_start()
+{
+    const Track &a = _tracks[0];
+    const Track &b = _tracks[1];
+    _pinch_armed = true;
+    _pinching = false;
+    _pinch_id[0] = a.id;
+    _pinch_id[1] = b.id;
+    _pinch_dx = b.col - a.col;
+    _pinch_dy = b.row - a.row;
+    _pinch_d2 = uint32_t(_pinch_dx * _pinch_dx + _pinch_dy * _pinch_dy);
+    if (_pinch_d2 == 0)
+        _pinch_d2 = 1;
+}
+
+
+void GestureRecognizer::pinch_move(uint32_t time_us)
+{
+    const Track *a = track_find(_pinch_id[0]);
+    const Track *b = track_find(_pinch_id[1]);
+    if (a == nullptr || b == nullptr)
+        return;
+
+    const int dx = b->col - a->col;
+    const int dy = b->row - a->row;
+    const uint32_t d2 = uint32_t(dx * dx + dy * dy);
+    const int scale = int(isqrt((uint64_t(d2) << 16) / _pinch_d2));
+    // now against start: cross and dot give the turn
+    const int cross = _pinch_dx * dy - _pinch_dy * dx;
+    const int dot = _pinch_dx * dx + _pinch_dy * dy;
+    const int turn = angle(dot, cross);
+
+    if (!_pinching && (abs(scale - 256) >= _config.pinch_scale_min ||
+                       abs(turn) >= _config.pinch_angle_min))
+        _pinching = true;
+    if (!_pinching)
+        return;
+
+    Gesture g = make(Gesture::Type::pinch, (a->col + b->col) / 2,
+                     (a->row + b->row) / 2, time_us);
+    g.scale = scale;
+    g.angle = turn;
+    push(g);
+}
+
+
+void GestureRecognizer::tap_flush()
+{
+    if (!_tap_pend)
+        return;
+    _tap_pend = false;
+    push(make(Gesture::Type::tap, _tap_col, _tap_row, _tap_us));
+}
+
+
+// When full, the oldest goes; a stream of pinches matters for its latest.
+void GestureRecognizer::push(const Gesture &gesture)
+{
+    if (_queue_head - _queue_tail >= uint32_t(queue_len))
+        _queue_tail++;
+    _queue[_queue_head++ % queue_len] = gesture;
+}
+
+
+GestureRecognizer::Gesture GestureRecognizer::make(Gesture::Type type,
+                                                   int col, int row,
+                                                   uint32_t time_us)
+{
+    Gesture g;
+    g.type = type;
+    g.dir = Gesture::Dir::none;
+    g.col = col;
+    g.row = row;
+    g.speed = 0;
+    g.scale = 256;
+    g.angle = 0;
+    g.time_us = time_us;
+    return g;
+}
+
+
+// atan on one octant, r = min/max in 0..1 (q15), in 1/100 degree:
+//   4500 r + r (1 - r) (1402 + 380 r)
+int GestureRecognizer::angle(int x, int y)
+{
+    if (x == 0 && y == 0)
+        return 0;
+    const int64_t ax = x < 0 ? -int64_t(x) : x;
+    const int64_t ay = y < 0 ? -int64_t(y) : y;
+    const bool steep = ay > ax;
+    const int64_t r = ((steep ? ax : ay) << 15) / (steep ? ay : ax);
+    const int64_t rr = (r * (32768 - r)) >> 15;
+    int a = int((4500 * r + ((rr * (1402 + ((380 * r) >> 15))))) >> 15);
+    if (steep)
+        a = 9000 - a;
+    if (x < 0)
+        a = 18000 - a;
+    return y < 0 ? -a : a;
+}
+
+
+uint32_t GestureRecognizer::isqrt(uint64_t n)
+{
+    uint64_t root = 0;
+    uint64_t bit = uint64_t(1) << 62;
+    while (bit > n)
+        bit >>= 2;
+    while (bit != 0) {
+        if (n >= root + bit) {
+            n -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return uint32_t(root);
+}
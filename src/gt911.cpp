@@ -14,44 +14,29 @@
 #include "touchscreen.h"
 
 
-Gt911::Gt911(I2cDev &i2c, uint8_t i2c_addr, int rst_pin, int int_pin) :
-    Touchscreen(480, 320),
+Gt911::Gt911(I2cDev &i2c, uint8_t i2c_addr, int rst_pin, int int_pin,
+             int width, int height) :
+    Touchscreen(width, height),
     _i2c(i2c),
     _i2c_addr(i2c_addr),
     _rst_pin(rst_pin),
     _int_pin(int_pin),
-    _poll_us(0),
-    _i2c_state(I2cState::idle)
+    _init_state(InitState::none),
+    _init_verbosity(0),
+    _init_us(0),
+    _init_rd_busy(false),
+    _switch_1(0),
+    _burst_cnt(0),
+    _i2c_state(I2cState::idle),
+    _frame_cnt(0),
+    _touch_cnt(0)
 {
     assert(_i2c_addr == i2c_addr_0 || _i2c_addr == i2c_addr_1);
+    bus_baud(_i2c.baud());
+    set_poll_sched(poll_sched_def);
     out_low(_rst_pin);
-    out_low(_int_pin);
-}
-
-
-void Gt911::reset(uint8_t i2c_addr)
-{
-    // See datasheet: INT pin is temporarily an output around reset time, and
-    // whether it is hi or lo determines the i2c address.
-    //     ____            _____________
-    // RST     \__________/
-    // INT ZZZZ_____/XXXXXXXXX\____ZZZZ
-    //         | T1 | T2 | T3 | T4 |
-    //
-    // X: INT is hi or lo to set i2c address
-    // Z: INT is changed to input
-    assert(i2c_addr == i2c_addr_0 || i2c_addr == i2c_addr_1);
-    out_low(_rst_pin);
-    out_low(_int_pin);
-    sleep_us(reset_T1_us);
-    if (i2c_addr == i2c_addr_1)
-        gpio_put(_int_pin, gpio_hi);
-    sleep_us(reset_T2_us);
-    gpio_put(_rst_pin, gpio_hi);
-    sleep_us(reset_T3_us);
-    gpio_put(_int_pin, gpio_lo);
-    sleep_us(reset_T4_us);
-    gpio_set_dir(_int_pin, false); // in
+    if (_int_pin >= 0)
+        out_low(_int_pin);
 }
 
 
@@ -61,122 +46,256 @@ void Gt911::reset(uint8_t i2c_addr)
 // 2 - print registers as read
 bool Gt911::init(int verbosity)
 {
-    reset(_i2c_addr);
+    init_start(verbosity);
+    while (!init_poll())
+        tight_loop_contents();
+    return ready();
+}
 
-    // check vendor ID
-    uint32_t vendor_id;
-    if (!get_vendor_id(vendor_id, verbosity))
-        return false;
-    if (vendor_id != vendor_id_exp) {
-        if (verbosity >= 1)
-            printf("Gt911::init: ERROR: vendor id incorrect\n");
-        return false;
-    }
 
-    // check resolution
-    if (!read_resolution(verbosity))
-        return false;
-    if (verbosity >= 2)
-        printf("Gt911::init: resolution = (x_res=%d, y_res=%d)\n", _x_res,
-               _y_res);
+// Incremental Init
+//
+// Reset (see datasheet): INT pin is temporarily an output around reset time,
+// and whether it is hi or lo determines the i2c address.
+//     ____            _____________
+// RST     \__________/
+// INT ZZZZ_____/XXXXXXXXX\____ZZZZ
+//         | T1 | T2 | T3 | T4 |
+//
+// X: INT is hi or lo to set i2c address
+// Z: INT is changed to input
+//
+// If INT is not wired, only RST is driven and _i2c_addr has to match
+// whatever address the board ends up with.
+//
+// After reset, the vendor ID, resolution, SWITCH_1, and thresholds are read
+// with async reads, one per init_poll() state.
 
-    // check INT trigger mode, x/y reverse (0x804d)
-    uint8_t switch_1;
-    if (read_checked(Reg::SWITCH_1, &switch_1, 1, "switch_1", verbosity) != 1)
-        return false;
-    if (verbosity >= 2) {
-        char buf[64];
-        printf("Gt911::init: %s\n", show_switch_1(switch_1, buf, sizeof(buf)));
-    }
+void Gt911::init_start(int verbosity)
+{
+    // INT is an output during reset; don't count those edges
+    irq_detach();
+    _i2c_state = I2cState::idle;
 
-    assert(_x_res == 320 && _y_res == 480);
-    assert((switch_1 & 0xc0) == 0x80); // y2y=1, x2x=0
-
-    // The following interpretations of (x,y) could be generalized.
-    //
-    // We can look at the display in landscape mode:
-    //     y=479               y=0
-    //     +---------------------+ x=0
-    //     |                     |
-    //     |                     |
-    // conn|                     |
-    //     |                     |
-    //     |                     |
-    //     +---------------------+ x=319
-    //
-    // Or in portrait mode:
-    //   x=0        x=319
-    //   +--------------+ y=0
-    //   |              |
-    //   |              |
-    //   |              |
-    //   |              |
-    //   |              |
-    //   |              |
-    //   |              |
-    //   |              |
-    //   +--------------+ y=479
-    //         conn
-    //
-    // Default rotation in class Touchscreen is landscape, and (0,0) is
-    // always at the top-left. A straightforward mapping from (x,y) from
-    // the GT911 to reported coordinates is to use y as the column (0..419)
-    // but reverse it horizontally, and x as the row, with no reversal.
-    //
-    //             col      row
-    // landscape:  479-y    x
-    // landscape2: y        319-x
-    // portrait:   x        y
-    // portrait2:  319-x    479-y
-
-    // check screen touch/leave thresholds (0x8053-0x8054)
-    uint8_t buf[2];
-    if (!read_checked(Reg::THRESH, buf, 2, "thresh", verbosity))
-        return false;
-    if (verbosity >= 2)
-        printf("Gt911::init: touch=%d leave=%d\n", int(buf[0]), int(buf[1]));
+    _init_verbosity = verbosity;
+    _init_rd_busy = false;
 
-    return true;
+    out_low(_rst_pin);
+    if (_int_pin >= 0)
+        out_low(_int_pin);
+    init_next(InitState::reset_t1, reset_T1_us);
 }
 
 
-bool Gt911::get_vendor_id(uint32_t &vendor_id, int verbosity)
+bool Gt911::init_poll()
 {
-    uint8_t buf[4];
-    if (!read_checked(Reg::VENDOR_ID, buf, 4, "vendor_id", verbosity))
-        return false;
-    vendor_id = (uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) |
-                (uint32_t(buf[2]) << 8) | (uint32_t(buf[3]) << 0);
-    return true;
+    const int verbosity = _init_verbosity;
+
+    switch (_init_state) {
+
+        case InitState::reset_t1:
+            if (!init_waited())
+                break;
+            if (_int_pin >= 0 && _i2c_addr == i2c_addr_1)
+                gpio_put(_int_pin, gpio_hi);
+            init_next(InitState::reset_t2, reset_T2_us);
+            break;
+
+        case InitState::reset_t2:
+            if (!init_waited())
+                break;
+            gpio_put(_rst_pin, gpio_hi);
+            init_next(InitState::reset_t3, reset_T3_us);
+            break;
+
+        case InitState::reset_t3:
+            if (!init_waited())
+                break;
+            if (_int_pin >= 0)
+                gpio_put(_int_pin, gpio_lo);
+            init_next(InitState::reset_t4, reset_T4_us);
+            break;
+
+        case InitState::reset_t4:
+            if (!init_waited())
+                break;
+            if (_int_pin >= 0)
+                gpio_set_dir(_int_pin, false); // in
+            init_next(InitState::vendor_id);
+            break;
+
+        case InitState::vendor_id:
+            // check vendor ID
+            if (!init_read(Reg::VENDOR_ID, 4, "vendor_id"))
+                break;
+            if (((uint32_t(_init_buf[0]) << 24) |
+                 (uint32_t(_init_buf[1]) << 16) |
+                 (uint32_t(_init_buf[2]) << 8) |
+                 (uint32_t(_init_buf[3]) << 0)) != vendor_id_exp) {
+                if (verbosity >= 1)
+                    printf("Gt911::init: ERROR: vendor id incorrect\n");
+                _init_state = InitState::failed;
+                break;
+            }
+            init_next(InitState::xy_res);
+            break;
+
+        case InitState::xy_res:
+            // check resolution
+            if (!init_read(Reg::XY_RES, 4, "xy_res"))
+                break;
+            _x_res = (int(_init_buf[1]) << 8) | _init_buf[0];
+            _y_res = (int(_init_buf[3]) << 8) | _init_buf[2];
+            if (verbosity >= 2)
+                printf("Gt911::init: resolution = (x_res=%d, y_res=%d)\n",
+                       _x_res, _y_res);
+            init_next(InitState::switch_1);
+            break;
+
+        case InitState::switch_1:
+            // check INT trigger mode, x/y reverse (0x804d)
+            if (!init_read(Reg::SWITCH_1, 1, "switch_1"))
+                break;
+            _switch_1 = _init_buf[0];
+            if (verbosity >= 2) {
+                char buf[64];
+                printf("Gt911::init: %s\n",
+                       show_switch_1(_switch_1, buf, sizeof(buf)));
+            }
+
+            // Take (x, y) as the GT911 reports them, whatever the reset
+            // config says about x2y, x2x and y2y. On the 3.5" 320x480 panels
+            // this was written for (y2y=1, x2x=0), that is the display in
+            // portrait, connector at the bottom:
+            //   x=0        x=319
+            //   +--------------+ y=0
+            //   |              |
+            //   |              |
+            //   |              |
+            //   +--------------+ y=479
+            //         conn
+            // Touchscreen's transform maps that to the display's resolution
+            // and rotation (default landscape, (0,0) at the top-left).
+            set_panel({_x_res, _y_res, false, false, false});
+
+            init_next(InitState::thresh);
+            break;
+
+        case InitState::thresh:
+            // check screen touch/leave thresholds (0x8053-0x8054)
+            if (!init_read(Reg::THRESH, 2, "thresh"))
+                break;
+            if (verbosity >= 2)
+                printf("Gt911::init: touch=%d leave=%d\n", int(_init_buf[0]),
+                       int(_init_buf[1]));
+
+            // If INT is wired, get_event() waits for the GT911 to signal new
+            // data instead of polling the status register. SWITCH_1[1:0]
+            // selects how it signals; the level modes are treated as the
+            // edge into that level.
+            if (_int_pin >= 0) {
+                irq_attach(_int_pin, int_rising(_switch_1));
+                if (verbosity >= 2)
+                    printf("Gt911::init: event engine is INT-driven\n");
+            }
+            poll_wake();
+            _init_state = InitState::ready;
+            break;
+
+        case InitState::none:
+            return false; // init_start() not called yet
+
+        case InitState::ready:
+        case InitState::failed:
+            return true;
+
+        default:
+            assert(false);
+            break;
+
+    } // switch (_init_state)
+
+    return _init_state == InitState::ready || _init_state == InitState::failed;
 }
 
 
-bool Gt911::read_resolution(int verbosity)
+void Gt911::init_next(InitState state, uint32_t wait_us)
 {
-    uint8_t buf[4];
-    if (!read_checked(Reg::XY_RES, buf, 4, "xy_res", verbosity))
+    _init_state = state;
+    _init_us = time_us_32() + wait_us;
+}
+
+
+bool Gt911::init_waited() const
+{
+    int32_t late_us = time_us_32() - _init_us; // rollover-safe
+    return late_us >= 0;
+}
+
+
+// The first call starts an async read of reg into _init_buf; later calls
+// check on it. Returns true once the data is there. On error, the init
+// state goes to failed.
+bool Gt911::init_read(Reg reg, int buf_len, const char *label)
+{
+    assert(buf_len <= int(sizeof(_init_buf)));
+
+    if (!_init_rd_busy) {
+        const uint8_t wr_buf[] = {uint8_t(reg >> 8), uint8_t(reg)};
+        bus_start(_i2c_addr, wr_buf, sizeof(wr_buf), buf_len);
+        _i2c.write_read_async_start(_i2c_addr, wr_buf, sizeof(wr_buf), //
+                                    _init_buf, buf_len);
+        _init_rd_busy = true;
+        return false;
+    }
+
+    if (_i2c.busy())
+        return false;
+
+    _init_rd_busy = false;
+    int rd_len = _i2c.write_read_async_check();
+    bus_result(rd_len, buf_len, _init_buf);
+    if (rd_len != buf_len) {
+        if (_init_verbosity >= 1)
+            printf("Gt911: ERROR: reading %s\n", label);
+        _init_state = InitState::failed;
         return false;
-    _x_res = (int(buf[1]) << 8) | buf[0];
-    _y_res = (int(buf[3]) << 8) | buf[2];
+    }
+    if (_init_verbosity >= 2) {
+        printf("Gt911: %s = {", label);
+        for (int i = 0; i < buf_len; i++) //
+            printf(" %02x", _init_buf[i]);
+        printf(" }\n");
+    }
     return true;
 }
 
 
+// Status and point records are read in one burst sized by the touch count
+// from the previous call (_burst_cnt). If there turn out to be more touches
+// than that, the rest are read in a second burst.
+//
 // Theoretical timing:
-//   read status: 122.5 usec
-//   read one touch point: 190.0 usec
+//   read status + n records: 100 + 22.5 * (1 + 8n) usec
 //   write status: 95.0 usec
-// At the very least (no touches), this takes 122.5 usec.
-// With 1 touch, 407.5 usec; with 2 touches, 597.5 usec; etc.
-int Gt911::get_touches(int col[], int row[], int touch_cnt_max, int verbosity)
+// With no touches, this takes 122.5 usec. With a steady touch count, 1 touch
+// takes 397.5 usec, 2 touches 577.5 usec, 5 touches 1117.5 usec (instead of
+// 407.5, 597.5, and 1167.5 usec reading each point separately).
+int Gt911::get_touches(Contact contacts[], int touch_cnt_max, int verbosity)
 {
+    uint8_t frame[frame_len];
+
     // Status register indicates whether there are any touches to read.
-    uint8_t status;
-    if (read(Reg::TOUCH_STAT, &status, sizeof(status)) != sizeof(status)) {
+    int rec_cnt = _burst_cnt < touch_cnt_max ? _burst_cnt : touch_cnt_max;
+    if (rec_cnt < 0)
+        rec_cnt = 0;
+    int rd_len = 1 + rec_cnt * touch_rec_len;
+    if (read(Reg::TOUCH_STAT, frame, rd_len) != rd_len) {
         if (verbosity >= 1)
             printf("Gt911::get_touches: ERROR: reading status register\n");
         return -1;
     }
+    uint8_t status = frame[0];
     if (verbosity >= 2)
         printf("Gt911::get_touches: status=0x%02x", int(status));
 
@@ -186,33 +305,39 @@ int Gt911::get_touches(int col[], int row[], int touch_cnt_max, int verbosity)
     // data and the different fields of the status register, so let's be
     // pedantic about it.
     int touch_cnt = 0;
-    if ((status & 0x80) != 0)
+    if ((status & 0x80) != 0) {
         touch_cnt = status & 0x0f; // touch_cnt can still be 0
-
-    constexpr int buf_len = 4;
-    uint8_t buf[buf_len];
-
-    Reg base = Reg::TOUCH_1;
+        if (touch_cnt > touch_max)
+            touch_cnt = touch_max;
+        _burst_cnt = touch_cnt;
+    }
 
     // Read touch points up to the number reported in status or the size of
-    // the col[] and row[] arrays, whichever is smaller.
-    for (int t = 0; t < touch_cnt && t < touch_cnt_max; t++) {
-
-        if (read(base, buf, buf_len) != buf_len) {
+    // the contacts[] array, whichever is smaller. Any we did not get
+    // along with status come in one more burst.
+    int want_cnt = touch_cnt < touch_cnt_max ? touch_cnt : touch_cnt_max;
+    if (want_cnt > rec_cnt) {
+        uint8_t *rec = frame + 1 + rec_cnt * touch_rec_len;
+        rd_len = (want_cnt - rec_cnt) * touch_rec_len;
+        if (read(Reg::TOUCH_REC + rec_cnt * touch_rec_len, rec, rd_len) !=
+            rd_len) {
             if (verbosity >= 1)
-                printf("Gt911::get_touches: ERROR: reading point %d\n", t + 1);
+                printf("Gt911::get_touches: ERROR: reading points %d..%d\n",
+                       rec_cnt + 1, want_cnt);
             return -1;
         }
-        int x = (int(buf[1]) << 8) | buf[0];
-        int y = (int(buf[3]) << 8) | buf[2];
-        rotate(x, y, col[t], row[t]);
-        if (verbosity >= 2)
-            printf(" {%02x %02x %02x %02x}", int(buf[0]), int(buf[1]),
-                   int(buf[2]), int(buf[3]));
-
-        base += 8;
+    }
 
-    } // for (int t...)
+    for (int t = 0; t < want_cnt; t++) {
+        const uint8_t *rec = frame + 1 + t * touch_rec_len;
+        rec_contact(rec, contacts[t], [this](int x, int y, int &col, int &row) {
+            transform(x, y, col, row);
+        });
+        if (verbosity >= 2)
+            printf(" {%02x %02x %02x %02x %02x %02x %02x}", int(rec[0]),
+                   int(rec[1]), int(rec[2]), int(rec[3]), int(rec[4]),
+                   int(rec[5]), int(rec[6]));
+    }
 
     if (verbosity >= 2)
         printf("\n");
@@ -245,6 +370,7 @@ int Gt911::get_touches(int col[], int row[], int touch_cnt_max, int verbosity)
 //      S, A+W, A, RHI, A, RLO, A, S = 29 bits
 //      S, A+R, A, { DAT, A }n, S = 11 + 9n bits
 //      total = 40 + 9n bits = 100 + 22.5n usec
+// BusStats counts bits the same way.
 
 int Gt911::read(Gt911::Reg reg, uint8_t *buf, int buf_len)
 {
@@ -254,11 +380,17 @@ int Gt911::read(Gt911::Reg reg, uint8_t *buf, int buf_len)
     constexpr int xbuf_len = sizeof(reg);
     const uint8_t xbuf[xbuf_len] = {uint8_t(reg >> 8), uint8_t(reg)};
 
+    bus_start(_i2c_addr, xbuf, xbuf_len, buf_len);
+
     constexpr uint timeout_us = 10'000;
     int err = _i2c.write_sync(_i2c_addr, xbuf, xbuf_len, true, timeout_us);
-    if (err != xbuf_len)
+    if (err != xbuf_len) {
+        bus_result(err, xbuf_len);
         return err;
-    return _i2c.read_sync(_i2c_addr, buf, buf_len, false, timeout_us);
+    }
+    int ret = _i2c.read_sync(_i2c_addr, buf, buf_len, false, timeout_us);
+    bus_result(ret, buf_len, buf);
+    return ret;
 }
 
 
@@ -266,19 +398,23 @@ int Gt911::write(Gt911::Reg reg, const uint8_t *buf, int buf_len)
 {
     static_assert(sizeof(reg) == 2);
 
-    constexpr int xbuf_len = 32;
+    // the config block, checksum, and fresh flag is the longest write
+    constexpr int xbuf_len = sizeof(reg) + Config::len + 2;
     uint8_t xbuf[xbuf_len];
 
-    assert(buf_len < (xbuf_len - static_cast<int>(sizeof(reg))));
+    assert(buf_len <= (xbuf_len - static_cast<int>(sizeof(reg))));
 
     xbuf[0] = uint8_t(reg >> 8); // hi byte
     xbuf[1] = uint8_t(reg);      // lo byte
     for (int i = 0; i < buf_len; i++)
         xbuf[sizeof(reg) + i] = buf[i];
 
+    bus_start(_i2c_addr, xbuf, sizeof(reg) + buf_len, 0);
+
     constexpr uint timeout_us = 10'000;
     int ret = _i2c.write_sync(_i2c_addr, xbuf, sizeof(reg) + buf_len, false,
                               timeout_us);
+    bus_result(ret, sizeof(reg) + buf_len);
     if (ret >= 0)
         return ret - sizeof(reg); // return buf_len if everything went ok
     else
@@ -329,38 +465,53 @@ bool Gt911::write_checked(Reg reg, uint8_t *buf, int buf_len, //
 
 Touchscreen::Event Gt911::get_event()
 {
-    Touchscreen::Event event; // default: type=none
+    return event_step([this](int x, int y, int &col, int &row) {
+        transform(x, y, col, row);
+    });
+}
 
-    if (_i2c.busy())
-        return event; // nothing new
 
-    uint32_t now_us;
-    int32_t late_us;
+int Gt911::frame_events(const uint8_t frame[], Event events[],
+                        int event_cnt_max)
+{
+    return frame_step(frame, events, event_cnt_max,
+                      [this](int x, int y, int &col, int &row) {
+                          transform(x, y, col, row);
+                      });
+}
+
+
+// Returns true when a complete frame is in _frame; the caller turns it into
+// events and then starts the status write.
+bool Gt911::engine_step()
+{
+    if (!ready() || _i2c.busy())
+        return false; // nothing new
 
     switch (_i2c_state) {
 
         case I2cState::idle:
-            // Initial state, and where we delay for 1 msec between polls of
-            // the status register (per "GT911 Programming Guide v0.1").
-            now_us = time_us_32();
-            // when now_us reaches _poll_us, we can poll
-            late_us = now_us - _poll_us; // rollover-safe
-            if (late_us >= 0) {
+            // With INT, don't touch the bus until the GT911 says there is
+            // something new. Without INT, this is the initial state, and
+            // where we wait between polls of the status register (at least
+            // 1 msec per "GT911 Programming Guide v0.1", longer when idle).
+            if (poll_due())
                 start_status_read();
-                _poll_us = now_us + 1'000; // next poll time
-            }
             break;
 
         case I2cState::status_read:
-            check_status_read(event);
-            break;
+            return check_status_read();
 
         case I2cState::touch_read:
-            check_touch_read(event);
-            break;
+            return check_touch_read();
 
         case I2cState::status_write:
-            start_status_read();
+            bus_result(_i2c.write_read_async_check());
+            // With INT, the next status read waits for the next edge.
+            if (irq_attached())
+                _i2c_state = I2cState::idle;
+            else
+                start_status_read();
             break;
 
         default:
@@ -369,16 +520,24 @@ Touchscreen::Event Gt911::get_event()
 
     } // switch (_i2c_state)
 
-    return event;
+    return false;
 }
 
 
+// With INT, a status read is (nearly) always answered with a frame, so the
+// point records we expect are read in the same burst. When polling, most
+// status reads come back not-ready, so only the status byte is read and the
+// points follow in one burst when there is something there.
 void Gt911::start_status_read()
 {
     const uint8_t wr_buf[] = {uint8_t(Reg::TOUCH_STAT >> 8),
                               uint8_t(Reg::TOUCH_STAT)};
+    frame_start();
+    _frame_cnt = irq_attached() ? _burst_cnt : 0;
+    int rd_len = 1 + _frame_cnt * touch_rec_len;
+    bus_start(_i2c_addr, wr_buf, sizeof(wr_buf), rd_len);
     _i2c.write_read_async_start(_i2c_addr, wr_buf, sizeof(wr_buf), //
-                                _status, sizeof(_status));
+                                _frame, rd_len);
     _i2c_state = I2cState::status_read;
 }
 
@@ -387,128 +546,165 @@ void Gt911::start_status_write()
 {
     const uint8_t wr_buf[] = {uint8_t(Reg::TOUCH_STAT >> 8),
                               uint8_t(Reg::TOUCH_STAT), 0};
+    bus_start(_i2c_addr, wr_buf, sizeof(wr_buf), 0);
     _i2c.write_read_async_start(_i2c_addr, wr_buf, sizeof(wr_buf));
     _i2c_state = I2cState::status_write;
 }
 
 
+// Read the point records that did not come with the status byte.
 void Gt911::start_touch_read()
 {
-    uint8_t wr_buf[] = {uint8_t(Reg::TOUCH_1 >> 8), uint8_t(Reg::TOUCH_1)};
+    assert(_touch_cnt > _frame_cnt);
+    const Reg reg = Reg::TOUCH_REC + _frame_cnt * touch_rec_len;
+    const uint8_t wr_buf[] = {uint8_t(reg >> 8), uint8_t(reg)};
+    int rd_len = (_touch_cnt - _frame_cnt) * touch_rec_len;
+    bus_start(_i2c_addr, wr_buf, sizeof(wr_buf), rd_len);
     _i2c.write_read_async_start(_i2c_addr, wr_buf, sizeof(wr_buf), //
-                                _touch, sizeof(_touch));
+                                _frame + 1 + _frame_cnt * touch_rec_len,
+                                rd_len);
     _i2c_state = I2cState::touch_read;
 }
 
 
-void Gt911::check_status_read(Event &event)
+bool Gt911::check_status_read()
 {
-    if (_i2c.write_read_async_check() == sizeof(_status)) {
-        // got the status byte
-        bool touch_count_valid = (_status[0] & 0x80) != 0;
+    int rd_len = 1 + _frame_cnt * touch_rec_len;
+    int result = _i2c.write_read_async_check();
+    bus_result(result, rd_len, _frame);
+    if (result == rd_len) {
+        // got the status byte (and maybe some points)
+        frame_status();
+        bool touch_count_valid = (_frame[0] & 0x80) != 0;
         if (touch_count_valid) {
-            int touch_count = _status[0] & 0x0f;
-            if (touch_count > 0) {
-                start_touch_read(); // go get the touch
-            } else {
-                // no touches
-                if (_last_event.type == Event::Type::down ||
-                    _last_event.type == Event::Type::move) {
-                    _last_event.type = Event::Type::up;
-                    // leave col, row unchanged from down or move
-                } else {
-                    _last_event.reset(); // type=none, col=0, row=0
-                }
-                event = _last_event;
-                start_status_write(); // clear status
+            _touch_cnt = _frame[0] & 0x0f;
+            if (_touch_cnt > touch_max)
+                _touch_cnt = touch_max;
+            _burst_cnt = _touch_cnt;
+            if (_touch_cnt > _frame_cnt) {
+                start_touch_read(); // go get the rest
+                return false;
             }
-            return;
+            return true; // have the frame
         }
     }
     // One of:
-    //   did not get exactly one byte back from the status read; or
+    //   did not get everything we asked for from the status read; or
     //   touch count not valid.
-    // In either case, delay and continue polling status read.
+    // In either case, delay and continue polling status read (or wait for
+    // the next INT edge).
     _i2c_state = I2cState::idle;
+    return false;
 }
 
-void Gt911::check_touch_read(Event &event)
+
+bool Gt911::check_touch_read()
 {
-    if (_i2c.write_read_async_check() == sizeof(_touch)) {
-        // got a touch
-        int x = (int(_touch[1]) << 8) | _touch[0];
-        int y = (int(_touch[3]) << 8) | _touch[2];
-        int col, row;
-        rotate(x, y, col, row);
-        // _last_event.type is none only on the first call;
-        // thereafter it is up, down, or move
-        if (_last_event.type == Event::Type::none ||
-            _last_event.type == Event::Type::up) {
-            _last_event.type = Event::Type::down;
-            _last_event.col = col;
-            _last_event.row = row;
-            event = _last_event;
-        } else {
-            assert(_last_event.type == Event::Type::down ||
-                   _last_event.type == Event::Type::move);
-            // only report a move if the touch actually moved
-            if (_last_event.col != col || _last_event.row != row) {
-                _last_event.type = Event::Type::move;
-                _last_event.col = col;
-                _last_event.row = row;
-                event = _last_event;
-            }
-        }
-    }
-    // in either case, go clear status and continue polling
+    int rd_len = (_touch_cnt - _frame_cnt) * touch_rec_len;
+    int result = _i2c.write_read_async_check();
+    bus_result(result, rd_len, _frame + 1 + _frame_cnt * touch_rec_len);
+    if (result == rd_len)
+        return true; // have the frame
+    // go clear status and continue polling
     start_status_write();
+    return false;
 }
 
 
-// Given a reading (x, y) from the chip, use its physical x_res and y_res
-// along with the touchscreen's rotation to adjust (x, y) to the correct
-// coordinates.
-void Gt911::rotate(int x, int y, int &col, int &row) const
+// The block is read with its checksum, and a read that does not add up is
+// an error (a garbled transfer, or the chip still loading its config).
+bool Gt911::config_read(Config &config, int verbosity)
 {
-    // Need trickier code if this is not true or if the assert on switch_1 in
-    // init() fails.
-    assert(_x_res == 320 && _y_res == 480);
-
-    // clamp inputs (have not observed out of range, but it's a cheap check)
-    if (x < 0)
-        x = 0;
-    if (x >= _x_res)
-        x = _x_res - 1;
-
-    if (y < 0)
-        y = 0;
-    if (y >= _y_res)
-        y = _y_res - 1;
-
-    switch (get_rotation()) {
-
-        case Rotation::landscape:
-            col = (_y_res - 1) - y;
-            row = x;
-            break;
+    if (!ready() || _i2c_state != I2cState::idle) {
+        if (verbosity >= 1)
+            printf("Gt911::config_read: ERROR: event engine busy\n");
+        return false;
+    }
 
-        case Rotation::portrait:
-            col = x;
-            row = y;
-            break;
+    uint8_t buf[Config::len + 1]; // block, checksum
+    if (!read_checked(Reg::CONFIG, buf, sizeof(buf), "config", verbosity))
+        return false;
+    memcpy(config.regs, buf, Config::len);
+    if (config.checksum() != buf[Config::len]) {
+        if (verbosity >= 1)
+            printf("Gt911::config_read: ERROR: checksum 0x%02x, expected "
+                   "0x%02x\n",
+                   int(buf[Config::len]), int(config.checksum()));
+        return false;
+    }
+    return true;
+}
 
-        case Rotation::landscape2:
-            col = y;
-            row = (_x_res - 1) - x;
-            break;
 
-        default:
-            assert(get_rotation() == Rotation::portrait2);
-            col = (_x_res - 1) - x;
-            row = (_y_res - 1) - y;
-            break;
+// The GT911 only loads a config whose version is not less than the one it
+// has, so config.version() should be left as config_read() found it.
+//
+// Theoretical timing @ 400 KHz: 29 + 9 * 186 bits = 4257.5 usec
+bool Gt911::config_write(const Config &config, int verbosity)
+{
+    if (!ready() || _i2c_state != I2cState::idle) {
+        if (verbosity >= 1)
+            printf("Gt911::config_write: ERROR: event engine busy\n");
+        return false;
+    }
 
-    } // switch
+    // A change of x2y, x2x or y2y has to be followed so (col, row) stays
+    // put; refuse it where the panel cannot change.
+    uint8_t switch_1 = config.regs[Config::SWITCH_1];
+    const bool panel_change = ((switch_1 ^ _switch_1) & 0xc8) != 0;
+    const Panel panel = panel_follow(get_panel(), _switch_1, switch_1);
+    if (panel_change && !panel_allowed(panel)) {
+        if (verbosity >= 1)
+            printf("Gt911::config_write: ERROR: x2y, x2x or y2y change,"
+                   " but the panel is fixed\n");
+        return false;
+    }
+
+    uint8_t buf[Config::len + 2]; // block, checksum, fresh
+    memcpy(buf, config.regs, Config::len);
+    buf[Config::len] = config.checksum();
+    buf[Config::len + 1] = 1;
+    static_assert(int(Reg::CONFIG) + Config::len == Reg::CONFIG_CHKSUM);
+    static_assert(int(Reg::CONFIG_CHKSUM) + 1 == Reg::CONFIG_FRESH);
+    if (!write_checked(Reg::CONFIG, buf, sizeof(buf), "config", verbosity))
+        return false;
+
+    // Follow a change of INT mode; the next edge comes from the new config.
+    if (irq_attached() && ((switch_1 ^ _switch_1) & 0x03) != 0)
+        irq_attach(_int_pin, int_rising(switch_1));
+    if (panel_change)
+        set_panel(panel);
+    _switch_1 = switch_1;
+    return true;
+}
+
+
+// The GT911 swaps x and y (x2y), then reverses them (x2x, y2y). Given the
+// panel geometry that was right with SWITCH_1 at was, return the one that
+// is right with it at now: the old geometry after the old bits, after the
+// new bits undone. Swaps and reversals are their own inverses, and a
+// reversal moves to the other axis when it crosses a swap, so it all
+// collects into one pair of reversals followed by one swap.
+Touchscreen::Panel Gt911::panel_follow(Panel panel, uint8_t was, uint8_t now)
+{
+    const bool swap = ((was ^ now) & 0x08) != 0;
+
+    // the new reversals undone
+    bool mirror_x = (now & 0x40) != 0;
+    bool mirror_y = (now & 0x80) != 0;
+    // the swaps, then the old reversals
+    mirror_x ^= ((swap ? was & 0x80 : was & 0x40) != 0);
+    mirror_y ^= ((swap ? was & 0x40 : was & 0x80) != 0);
+    // the old geometry
+    mirror_x ^= swap ? panel.mirror_y : panel.mirror_x;
+    mirror_y ^= swap ? panel.mirror_x : panel.mirror_y;
+
+    panel.swap_xy = panel.swap_xy != swap;
+    panel.mirror_x = mirror_x;
+    panel.mirror_y = mirror_y;
+    if (swap)
+        std::swap(panel.x_res, panel.y_res); // as now reported
+    return panel;
 }
 
 
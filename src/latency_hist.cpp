@@ -0,0 +1,59 @@
+
+#include <cstdint>
+#include <cstdio>
+// touchscreen
+#include "latency_hist.h"
+
+
+void LatencyHist::reset()
+{
+    for (uint32_t &b : _buckets)
+        b = 0;
+    _count = 0;
+    _sum = 0;
+    _min = UINT32_MAX;
+    _max = 0;
+}
+
+
+uint32_t LatencyHist::bucket_lo(int b)
+{
+    if (b < 4)
+        return uint32_t(b);
+    int e = b / 4 + 1;
+    return uint32_t(4 + b % 4) << (e - 2);
+}
+
+
+uint32_t LatencyHist::percentile(int pct) const
+{
+    if (_count == 0)
+        return 0;
+
+    // rank of the sample we want, 1.._count
+    uint32_t rank = uint32_t((uint64_t(_count) * pct + 99) / 100);
+    if (rank < 1)
+        rank = 1;
+
+    uint32_t seen = 0;
+    for (int b = 0; b < bucket_cnt; b++) {
+        seen += _buckets[b];
+        if (seen >= rank) {
+            if (b == bucket_cnt - 1)
+                return _max;
+            uint32_t hi = bucket_lo(b + 1) - 1;
+            return hi < _max ? hi : _max;
+        }
+    }
+    return _max;
+}
+
+
+void LatencyHist::dump(const char *name) const
+{
+    printf("%s: n=%lu min=%lu p50=%lu p90=%lu p99=%lu max=%lu mean=%lu us\n",
+           name, (unsigned long)count(), (unsigned long)min(),
+           (unsigned long)percentile(50), (unsigned long)percentile(90),
+           (unsigned long)percentile(99), (unsigned long)max(),
+           (unsigned long)mean());
+}
@@ -0,0 +1,99 @@
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+// pico
+#include "pico/stdlib.h"
+#if PICO_ON_DEVICE
+#include "pico/multicore.h"
+#else
+#include <thread>
+#endif
+// touchscreen
+#include "touch_service.h"
+#include "touchscreen.h"
+
+
+namespace {
+
+Touchscreen *svc_ts = nullptr;
+std::atomic<bool> svc_stop(false);
+std::atomic<bool> svc_running(false);
+std::atomic<uint32_t> svc_loops(0);
+
+#if !PICO_ON_DEVICE
+std::thread svc_thread;
+#endif
+
+
+void svc_loop()
+{
+    svc_running.store(true, std::memory_order_release);
+    while (!svc_stop.load(std::memory_order_acquire)) {
+        svc_ts->service();
+        svc_loops.store(svc_loops.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+#if PICO_ON_DEVICE
+        tight_loop_contents();
+#else
+        std::this_thread::yield();
+#endif
+    }
+    svc_running.store(false, std::memory_order_release);
+}
+
+} // namespace
+
+
+void TouchService::start(Touchscreen &ts)
+{
+    assert(svc_ts == nullptr);
+
+    svc_ts = &ts;
+    svc_stop.store(false, std::memory_order_relaxed);
+    svc_loops.store(0, std::memory_order_relaxed);
+
+#if PICO_ON_DEVICE
+    // The INT handler is registered on whichever core called irq_attach()
+    // (core 0, in init()); that is fine, it only bumps a counter that
+    // service() picks up on core 1.
+    multicore_reset_core1();
+    multicore_launch_core1(svc_loop);
+#else
+    svc_thread = std::thread(svc_loop);
+#endif
+
+    while (!svc_running.load(std::memory_order_acquire))
+        tight_loop_contents();
+}
+
+
+void TouchService::stop()
+{
+    if (svc_ts == nullptr)
+        return;
+
+    svc_stop.store(true, std::memory_order_release);
+
+#if PICO_ON_DEVICE
+    while (svc_running.load(std::memory_order_acquire))
+        tight_loop_contents();
+    multicore_reset_core1();
+#else
+    svc_thread.join();
+#endif
+
+    svc_ts = nullptr;
+}
+
+
+bool TouchService::running()
+{
+    return svc_running.load(std::memory_order_acquire);
+}
+
+
+uint32_t TouchService::loops()
+{
+    return svc_loops.load(std::memory_order_relaxed);
+}
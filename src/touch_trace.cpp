@@ -0,0 +1,192 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+// pico
+#include "pico/stdlib.h"
+// touchscreen
+#include "touch_trace.h"
+
+
+TouchTrace::TouchTrace(uint8_t *buf, int buf_len) :
+    _buf(buf),
+    _buf_len(buf_len),
+    _head(0),
+    _tail(0),
+    _used(0),
+    _recording(false),
+    _dropped(0),
+    _pend_active(false)
+{
+    assert(buf != nullptr && buf_len >= rec_max);
+}
+
+
+static void put_hdr(uint8_t *rec, TouchTrace::Type type, uint8_t i2c_addr,
+                    int wr_len, int rd_len, int result, uint32_t time_us)
+{
+    rec[0] = type;
+    rec[1] = i2c_addr;
+    rec[2] = uint8_t(wr_len);
+    rec[3] = uint8_t(rd_len);
+    rec[4] = uint8_t(result);
+    rec[5] = uint8_t(result >> 8);
+    rec[6] = uint8_t(time_us);
+    rec[7] = uint8_t(time_us >> 8);
+    rec[8] = uint8_t(time_us >> 16);
+    rec[9] = uint8_t(time_us >> 24);
+}
+
+
+void TouchTrace::record_irq(uint32_t time_us)
+{
+    if (!_recording)
+        return;
+    uint8_t rec[hdr_len];
+    put_hdr(rec, Type::irq, 0, 0, 0, 0, time_us);
+    put(rec, hdr_len);
+}
+
+
+// The header is finished in record_end(), once the result is known. rd_len
+// is kept in the header meanwhile as the most that can come back.
+void TouchTrace::record_start(uint8_t i2c_addr, const uint8_t *wr, int wr_len,
+                              int rd_len)
+{
+    _pend_active = _recording;
+    if (!_pend_active)
+        return;
+    assert(wr_len <= wr_max && rd_len <= rd_max);
+    if (wr_len > wr_max)
+        wr_len = wr_max;
+    if (rd_len > rd_max)
+        rd_len = rd_max;
+    put_hdr(_pend, Type::xfer, i2c_addr, wr_len, rd_len, 0, time_us_32());
+    memcpy(_pend + hdr_len, wr, wr_len);
+}
+
+
+void TouchTrace::record_end(int result, const uint8_t *rd)
+{
+    if (!_pend_active)
+        return;
+    _pend_active = false;
+
+    int wr_len = _pend[2];
+    int rd_len = _pend[3];
+    if (rd == nullptr || result < 0)
+        rd_len = 0;
+    else if (rd_len > result)
+        rd_len = result;
+    _pend[3] = uint8_t(rd_len);
+    _pend[4] = uint8_t(result);
+    _pend[5] = uint8_t(result >> 8);
+    if (rd_len > 0)
+        memcpy(_pend + hdr_len + wr_len, rd, rd_len);
+    put(_pend, hdr_len + wr_len + rd_len);
+}
+
+
+void TouchTrace::put(const uint8_t *rec, int rec_len)
+{
+    // make room by dropping the oldest records
+    while (_used + rec_len > _buf_len) {
+        int len = hdr_len + at(2) + at(3);
+        _tail = (_tail + len) % _buf_len;
+        _used -= len;
+        _dropped++;
+    }
+    for (int i = 0; i < rec_len; i++) {
+        _buf[_head] = rec[i];
+        _head = (_head + 1) % _buf_len;
+    }
+    _used += rec_len;
+}
+
+
+int TouchTrace::take(uint8_t *buf, int buf_len)
+{
+    int cnt = 0;
+    while (_used > 0) {
+        int len = hdr_len + at(2) + at(3);
+        if (cnt + len > buf_len)
+            break;
+        for (int i = 0; i < len; i++)
+            buf[cnt++] = at(i);
+        _tail = (_tail + len) % _buf_len;
+        _used -= len;
+    }
+    return cnt;
+}
+
+
+int TouchTrace::stream()
+{
+    int recs = 0;
+    uint8_t rec[rec_max];
+    while (_used > 0) {
+        int len = take(rec, hdr_len + at(2) + at(3)); // just the oldest
+        printf("tt ");
+        for (int i = 0; i < len; i++)
+            printf("%02x", rec[i]);
+        printf("\n");
+        recs++;
+    }
+    return recs;
+}
+
+
+int TouchTrace::parse(const uint8_t *buf, int buf_len, Record &rec)
+{
+    if (buf_len < hdr_len)
+        return 0;
+    if (buf[0] != Type::xfer && buf[0] != Type::irq)
+        return 0;
+    int len = hdr_len + buf[2] + buf[3];
+    if (len > buf_len)
+        return 0;
+    rec.type = Type(buf[0]);
+    rec.i2c_addr = buf[1];
+    rec.wr_len = buf[2];
+    rec.rd_len = buf[3];
+    rec.result = int16_t(buf[4] | (buf[5] << 8));
+    rec.time_us = uint32_t(buf[6]) | (uint32_t(buf[7]) << 8) |
+                  (uint32_t(buf[8]) << 16) | (uint32_t(buf[9]) << 24);
+    rec.wr = buf + hdr_len;
+    rec.rd = buf + hdr_len + rec.wr_len;
+    return len;
+}
+
+
+static int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+int TouchTrace::unhex(const char *line, uint8_t *buf, int buf_len)
+{
+    if (strncmp(line, "tt ", 3) != 0)
+        return 0;
+    line += 3;
+    int cnt = 0;
+    while (cnt < buf_len) {
+        int hi = hex_digit(line[0]);
+        if (hi < 0)
+            break;
+        int lo = hex_digit(line[1]);
+        if (lo < 0)
+            return 0;
+        buf[cnt++] = uint8_t((hi << 4) | lo);
+        line += 2;
+    }
+    Record rec;
+    return parse(buf, cnt, rec) == cnt ? cnt : 0;
+}
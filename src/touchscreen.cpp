@@ -0,0 +1,831 @@
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+// pico
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "pico/stdlib.h"
+// touchscreen
+#include "touchscreen.h"
+
+
+Touchscreen *Touchscreen::_irq_owner = nullptr;
+
+
+// Calibration
+
+static constexpr uint8_t cal_magic = 0xca;
+static constexpr uint8_t cal_version = 1;
+
+
+void Touchscreen::Calibration::save(uint8_t blob[blob_len]) const
+{
+    const int32_t words[] = {a, b, c, d, e, f};
+    uint8_t *p = blob;
+    *p++ = cal_magic;
+    *p++ = cal_version;
+    for (int32_t w : words)
+        for (int i = 0; i < 4; i++)
+            *p++ = uint8_t(uint32_t(w) >> (8 * i));
+    uint8_t sum = 0;
+    for (int i = 0; i < blob_len - 1; i++)
+        sum += blob[i];
+    *p = uint8_t(-sum);
+}
+
+
+bool Touchscreen::Calibration::load(const uint8_t blob[blob_len])
+{
+    uint8_t sum = 0;
+    for (int i = 0; i < blob_len; i++)
+        sum += blob[i];
+    if (blob[0] != cal_magic || blob[1] != cal_version || sum != 0)
+        return false;
+    int32_t words[6];
+    const uint8_t *p = blob + 2;
+    for (int32_t &w : words) {
+        uint32_t u = 0;
+        for (int i = 0; i < 4; i++)
+            u |= uint32_t(*p++) << (8 * i);
+        w = int32_t(u);
+    }
+    a = words[0];
+    b = words[1];
+    c = words[2];
+    d = words[3];
+    e = words[4];
+    f = words[5];
+    return true;
+}
+
+
+void Touchscreen::calibration_targets(CalPoint targets[], int n) const
+{
+    assert(n == 3 || n == 5);
+    const int c0 = _width / 10;
+    const int c1 = _width - 1 - c0;
+    const int r0 = _height / 10;
+    const int r1 = _height - 1 - r0;
+    if (n == 3) {
+        targets[0] = {c0, r0};
+        targets[1] = {c1, _height / 2};
+        targets[2] = {_width / 2, r1};
+    } else {
+        targets[0] = {c0, r0};
+        targets[1] = {c1, r0};
+        targets[2] = {c1, r1};
+        targets[3] = {c0, r1};
+        targets[4] = {_width / 2, _height / 2};
+    }
+}
+
+
+// Between the controller's reports get_touch() says 0, so a touch has only
+// lifted when there has been none for longer than any report interval.
+bool Touchscreen::calibration_capture(CalPoint &touch, int timeout_ms)
+{
+    constexpr uint32_t poll_ms = 10;
+    constexpr uint32_t lift_us = 100'000;
+    const uint32_t timeout_us = uint32_t(timeout_ms) * 1'000;
+    const uint32_t start_us = time_us_32();
+
+    int col_sum = 0;
+    int row_sum = 0;
+    int cnt = 0;
+    while (cnt < cal_samples) {
+        if (time_us_32() - start_us > timeout_us)
+            return false;
+        int col, row;
+        if (get_touch(col, row) == 1) {
+            col_sum += col;
+            row_sum += row;
+            cnt++;
+        }
+        sleep_ms(poll_ms);
+    }
+
+    uint32_t touch_us = time_us_32();
+    while (time_us_32() - touch_us < lift_us) {
+        if (time_us_32() - start_us > timeout_us)
+            return false;
+        int col, row;
+        if (get_touch(col, row) > 0)
+            touch_us = time_us_32();
+        sleep_ms(poll_ms);
+    }
+
+    touch = {(col_sum + cnt / 2) / cnt, (row_sum + cnt / 2) / cnt};
+    return true;
+}
+
+
+// (col, row) in the current rotation to the portrait frame the
+// calibration works in
+void Touchscreen::unrotate(int col, int row, int &u, int &v) const
+{
+    const int wid = _phys_hgt; // in portrait
+    const int hgt = _phys_wid;
+    switch (_rotation) {
+        case Rotation::portrait:
+            u = col;
+            v = row;
+            break;
+        case Rotation::landscape:
+            u = row;
+            v = (hgt - 1) - col;
+            break;
+        case Rotation::landscape2:
+            u = (wid - 1) - row;
+            v = col;
+            break;
+        case Rotation::portrait2:
+        default:
+            u = (wid - 1) - col;
+            v = (hgt - 1) - row;
+            break;
+    }
+}
+
+
+// the other way
+void Touchscreen::rotate(int u, int v, int &col, int &row) const
+{
+    const int wid = _phys_hgt; // in portrait
+    const int hgt = _phys_wid;
+    switch (_rotation) {
+        case Rotation::portrait:
+            col = u;
+            row = v;
+            break;
+        case Rotation::landscape:
+            col = (hgt - 1) - v;
+            row = u;
+            break;
+        case Rotation::landscape2:
+            col = v;
+            row = (wid - 1) - u;
+            break;
+        case Rotation::portrait2:
+        default:
+            col = (wid - 1) - u;
+            row = (hgt - 1) - v;
+            break;
+    }
+}
+
+
+// (num << 16) / den, rounded; num is scaled down first if that would
+// overflow. den > 0.
+static int64_t fix_div(int64_t num, int64_t den)
+{
+    constexpr int64_t num_max = int64_t(1) << 46;
+    while (num > num_max || num < -num_max) {
+        num /= 2;
+        den /= 2;
+    }
+    if (den == 0)
+        return 0;
+    num *= 65536;
+    return (num >= 0 ? num + den / 2 : num - den / 2) / den;
+}
+
+
+// Least squares t = a u + b v + c over n points, done about the means
+// (scaled by n to stay in integers) so a, b separate from c. Sums stay in
+// range for displays up to 2048 pixels.
+static bool cal_fit(const int u[], const int v[], const int t[], int n,
+                    int32_t &a, int32_t &b, int32_t &c)
+{
+    int64_t su = 0, sv = 0, st = 0;
+    for (int i = 0; i < n; i++) {
+        su += u[i];
+        sv += v[i];
+        st += t[i];
+    }
+    int64_t suu = 0, suv = 0, svv = 0, sut = 0, svt = 0;
+    for (int i = 0; i < n; i++) {
+        int64_t du = n * u[i] - su;
+        int64_t dv = n * v[i] - sv;
+        int64_t dt = n * t[i] - st;
+        suu += du * du;
+        suv += du * dv;
+        svv += dv * dv;
+        sut += du * dt;
+        svt += dv * dt;
+    }
+    int64_t det = suu * svv - suv * suv;
+    // too near a line: sine of the spread's angle under 1/8
+    if (det <= 0 || det < suu / 64 * svv)
+        return false;
+    int64_t fa = fix_div(sut * svv - svt * suv, det);
+    int64_t fb = fix_div(svt * suu - sut * suv, det);
+    int64_t fc = (st * 65536 - fa * su - fb * sv);
+    fc = (fc >= 0 ? fc + n / 2 : fc - n / 2) / n;
+    a = int32_t(fa);
+    b = int32_t(fb);
+    c = int32_t(fc);
+    return true;
+}
+
+
+bool Touchscreen::calibration_solve(const CalPoint targets[],
+                                   const CalPoint touches[], int n)
+{
+    if (n < 3 || n > cal_points_max)
+        return false;
+
+    int u[cal_points_max], v[cal_points_max];
+    int tu[cal_points_max], tv[cal_points_max];
+    for (int i = 0; i < n; i++) {
+        unrotate(touches[i].col, touches[i].row, u[i], v[i]);
+        unrotate(targets[i].col, targets[i].row, tu[i], tv[i]);
+    }
+
+    Calibration fit;
+    if (!cal_fit(u, v, tu, n, fit.a, fit.b, fit.c) ||
+        !cal_fit(u, v, tv, n, fit.d, fit.e, fit.f))
+        return false;
+
+    // the touches came through the old calibration, so the new one is the
+    // fit after it
+    const Calibration &o = _cal;
+    auto mul = [](int64_t x, int64_t y) { return int32_t((x * y) >> 16); };
+    Calibration cal;
+    cal.a = mul(fit.a, o.a) + mul(fit.b, o.d);
+    cal.b = mul(fit.a, o.b) + mul(fit.b, o.e);
+    cal.c = mul(fit.a, o.c) + mul(fit.b, o.f) + fit.c;
+    cal.d = mul(fit.d, o.a) + mul(fit.e, o.d);
+    cal.e = mul(fit.d, o.b) + mul(fit.e, o.e);
+    cal.f = mul(fit.d, o.c) + mul(fit.e, o.f) + fit.f;
+    set_calibration(cal);
+    return true;
+}
+
+
+// Edge correction grid
+
+
+void Touchscreen::grid_clear()
+{
+    _grid = Grid();
+    _grid_on = false;
+}
+
+
+int Touchscreen::grid_targets(CalPoint targets[]) const
+{
+    const int wid = _phys_hgt; // in portrait
+    const int hgt = _phys_wid;
+    int t = 0;
+    for (int iv = 0; iv < grid_v; iv++) {
+        for (int iu = 0; iu < grid_u; iu++) {
+            int u = (iu * (wid - 1) + (grid_u - 1) / 2) / (grid_u - 1);
+            int v = (iv * (hgt - 1) + (grid_v - 1) / 2) / (grid_v - 1);
+            rotate(u, v, targets[t].col, targets[t].row);
+            t++;
+        }
+    }
+    return t;
+}
+
+
+void Touchscreen::grid_learn(const CalPoint &target, const CalPoint &touch)
+{
+    const int wid = _phys_hgt; // in portrait
+    const int hgt = _phys_wid;
+    int ut, vt, u, v;
+    unrotate(target.col, target.row, ut, vt);
+    unrotate(touch.col, touch.row, u, v);
+    int iu = (ut * (grid_u - 1) + (wid - 1) / 2) / (wid - 1);
+    int iv = (vt * (grid_v - 1) + (hgt - 1) / 2) / (hgt - 1);
+    iu = iu < 0 ? 0 : iu >= grid_u ? grid_u - 1 : iu;
+    iv = iv < 0 ? 0 : iv >= grid_v ? grid_v - 1 : iv;
+    const int d[2] = {ut - u, vt - v};
+    for (int k = 0; k < 2; k++) {
+        int n = _grid.off[iv][iu][k] + d[k];
+        _grid.off[iv][iu][k] = int8_t(n < -128 ? -128 : n > 127 ? 127 : n);
+    }
+    _grid_on = true;
+}
+
+
+// Grid coordinates are truncated so they never pass the last node.
+void Touchscreen::grid_xform_build()
+{
+    const int32_t wid = _phys_hgt; // in portrait
+    const int32_t hgt = _phys_wid;
+    const int32_t su = ((grid_u - 1) << 16) / (wid - 1);
+    const int32_t sv = ((grid_v - 1) << 16) / (hgt - 1);
+    GridXform &g = _grid_xform;
+    switch (_rotation) {
+        case Rotation::portrait:
+            // u = col, v = row
+            g = {su, 0, 0, 0, sv, 0, 1, 0, 0, 1};
+            break;
+        case Rotation::landscape:
+            // u = row, v = (hgt - 1) - col
+            g = {0, su, 0, -sv, 0, (hgt - 1) * sv, 0, -1, 1, 0};
+            break;
+        case Rotation::landscape2:
+            // u = (wid - 1) - row, v = col
+            g = {0, -su, (wid - 1) * su, sv, 0, 0, 0, 1, -1, 0};
+            break;
+        case Rotation::portrait2:
+        default:
+            // u = (wid - 1) - col, v = (hgt - 1) - row
+            g = {-su, 0, (wid - 1) * su, 0, -sv, (hgt - 1) * sv, -1, 0, 0, -1};
+            break;
+    }
+}
+
+
+int Touchscreen::get_touches(int col[], int row[], int touch_cnt_max,
+                             int verbosity)
+{
+    Contact contacts[contact_max];
+    if (touch_cnt_max > contact_max)
+        touch_cnt_max = contact_max;
+    int touch_cnt = get_touches(contacts, touch_cnt_max, verbosity);
+    for (int t = 0; t < touch_cnt && t < touch_cnt_max; t++) {
+        col[t] = contacts[t].col;
+        row[t] = contacts[t].row;
+    }
+    return touch_cnt;
+}
+
+
+int Touchscreen::get_contacts(Contact contacts[], int contact_cnt_max) const
+{
+    int cnt = 0;
+    for (int c = 0; c < _contact_cnt && cnt < contact_cnt_max; c++)
+        contacts[cnt++] = _contacts[c];
+    return _contact_cnt;
+}
+
+
+void Touchscreen::service()
+{
+    while (true) {
+        Event event = get_event();
+        if (event.type == Event::Type::none)
+            break;
+        _event_ring.push(event);
+    }
+    _event_ring.flush();
+}
+
+
+int Touchscreen::get_events(Event events[], int event_cnt_max)
+{
+    int cnt = _event_ring.pop(events, event_cnt_max);
+    if (cnt > 0) {
+        uint32_t now_us = time_us_32();
+        LatencyHist &hist = _latency[int(Latency::read_to_consume)];
+        for (int e = 0; e < cnt; e++)
+            hist.add(now_us - events[e].time_us);
+    }
+    return cnt;
+}
+
+
+int Touchscreen::get_frame_events(Event events[], int event_cnt_max)
+{
+    // Everything in the ring goes into the batch, merging as it goes. When
+    // the batch is full (only if the caller takes less than it is given),
+    // the rest waits in the ring.
+    Event event;
+    while (!_frame_batch.full() && _event_ring.pop(&event, 1) == 1)
+        _frame_batch.add(event);
+
+    int cnt = _frame_batch.take(events, event_cnt_max);
+    if (cnt > 0) {
+        uint32_t now_us = time_us_32();
+        LatencyHist &hist = _latency[int(Latency::read_to_consume)];
+        for (int e = 0; e < cnt; e++)
+            hist.add(now_us - events[e].time_us);
+    }
+    return cnt;
+}
+
+
+const char *Touchscreen::latency_name(Latency which)
+{
+    switch (which) {
+        case Latency::int_to_status:
+            return "int_to_status";
+        case Latency::status_to_touch:
+            return "status_to_touch";
+        case Latency::read_to_consume:
+            return "read_to_consume";
+        default:
+            return "unknown";
+    }
+}
+
+
+void Touchscreen::latency_reset()
+{
+    for (LatencyHist &hist : _latency)
+        hist.reset();
+}
+
+
+void Touchscreen::latency_dump() const
+{
+    for (int l = 0; l < latency_cnt; l++)
+        _latency[l].dump(latency_name(Latency(l)));
+}
+
+
+Touchscreen::BusStats Touchscreen::bus_stats() const
+{
+    BusStats stats = _bus_stats;
+    if (_bus_baud != 0)
+        stats.bus_us = (stats.bits * 1'000'000 + _bus_baud - 1) / _bus_baud;
+    return stats;
+}
+
+
+void Touchscreen::bus_result(int result, int expected, const uint8_t *rd_buf)
+{
+    if (_trace != nullptr)
+        _trace->record_end(result, rd_buf);
+
+    if (result == PICO_ERROR_GENERIC)
+        _bus_stats.nacks++;
+    else if (result == PICO_ERROR_TIMEOUT)
+        _bus_stats.timeouts++;
+    else if (result < 0 || (expected >= 0 && result != expected))
+        _bus_stats.mismatches++;
+}
+
+
+void Touchscreen::frame_start()
+{
+    _frame_poll_us = time_us_32();
+    _frame_int_us = irq_attached() ? _irq_us : 0;
+    _frame_status_us = _frame_poll_us;
+}
+
+
+void Touchscreen::frame_status()
+{
+    _frame_status_us = time_us_32();
+    if (_frame_int_us != 0) {
+        _latency[int(Latency::int_to_status)].add(_frame_status_us -
+                                                  _frame_int_us);
+    }
+}
+
+
+void Touchscreen::contacts_update(const Contact cur[], int cur_cnt)
+{
+    if (cur_cnt > contact_max)
+        cur_cnt = contact_max;
+
+    _frame_data_us = time_us_32();
+    _latency[int(Latency::status_to_touch)].add(_frame_data_us -
+                                                _frame_status_us);
+
+    // contacts that went away
+    for (int p = 0; p < _contact_cnt; p++) {
+        const Contact &prev = _contacts[p];
+        bool found = false;
+        for (int c = 0; c < cur_cnt && !found; c++)
+            found = cur[c].id == prev.id;
+        if (!found) // up at its last position
+            event_push(Event(Event::Type::up, prev));
+    }
+
+    // new and moved contacts
+    Contact next[contact_max];
+    JitterState next_jitter[contact_max];
+    PredictState next_predict[contact_max];
+    for (int c = 0; c < cur_cnt; c++) {
+        int p = 0;
+        while (p < _contact_cnt && _contacts[p].id != cur[c].id)
+            p++;
+        next[c] = cur[c];
+        if (p == _contact_cnt) {
+            jitter_start(next_jitter[c], cur[c]);
+            predict_start(next_predict[c], cur[c]);
+            event_push(Event(Event::Type::down, cur[c]));
+            continue;
+        }
+        const Contact &prev = _contacts[p];
+        if (_jitter_on) {
+            next_jitter[c] = _jitter[p];
+            jitter_step(next_jitter[c], cur[c], prev, next[c]);
+        } else {
+            jitter_start(next_jitter[c], cur[c]);
+        }
+        PredictState &ps = next_predict[c];
+        ps = _predict[p];
+        if (prev.col != next[c].col || prev.row != next[c].row) {
+            // only report a move if the touch actually moved
+            event_push(Event(Event::Type::move, next[c]));
+            ps.last_col = next[c].col;
+            ps.last_row = next[c].row;
+        }
+        int col, row;
+        if (!_predict_on) {
+            predict_start(ps, next[c]);
+        } else if (predict_step(ps, next[c], col, row)) {
+            Event event(Event::Type::move, next[c]);
+            event.col = col;
+            event.row = row;
+            event.predicted = true;
+            event_push(event);
+        }
+    }
+
+    for (int c = 0; c < cur_cnt; c++) {
+        _contacts[c] = next[c];
+        _jitter[c] = next_jitter[c];
+        _predict[c] = next_predict[c];
+    }
+    _contact_cnt = cur_cnt;
+
+    if (cur_cnt > 0)
+        _poll_touch_us = _frame_data_us;
+
+    snapshot_publish();
+}
+
+
+void Touchscreen::jitter_start(JitterState &state, const Contact &raw) const
+{
+    state.col = raw.col << 8;
+    state.row = raw.row << 8;
+    state.dcol = 0;
+    state.drow = 0;
+    state.us = _frame_data_us;
+}
+
+
+// 1-Euro: the speed is estimated from the raw sample against the filtered
+// position and smoothed at d_cutoff, then sets the position's cutoff.
+void Touchscreen::jitter_step(JitterState &state, const Contact &raw,
+                              const Contact &prev, Contact &out) const
+{
+    const JitterFilter &f = _jitter_filter;
+    JitterState &s = state;
+
+    uint32_t dt_us = _frame_data_us - s.us;
+    if (dt_us < 1'000)
+        dt_us = 1'000; // no controller reports faster; keeps speeds in 32 bits
+    s.us = _frame_data_us;
+
+    const int32_t col = raw.col << 8;
+    const int32_t row = raw.row << 8;
+
+    const int32_t vcol = int32_t(int64_t(col - s.col) * 1'000'000 / dt_us);
+    const int32_t vrow = int32_t(int64_t(row - s.row) * 1'000'000 / dt_us);
+    const int32_t a_d = jitter_alpha(f.d_cutoff_mhz, dt_us);
+    s.dcol += int32_t((int64_t(vcol - s.dcol) * a_d) >> 16);
+    s.drow += int32_t((int64_t(vrow - s.drow) * a_d) >> 16);
+
+    // |(dcol, drow)| to within 12%: max + min / 2
+    const uint32_t ac = s.dcol < 0 ? -s.dcol : s.dcol;
+    const uint32_t ar = s.drow < 0 ? -s.drow : s.drow;
+    const uint32_t speed = ac > ar ? ac + ar / 2 : ar + ac / 2;
+
+    const uint32_t cutoff_mhz =
+        f.min_cutoff_mhz + uint32_t((uint64_t(f.beta_mhz) * speed) >> 8);
+    const int32_t a = jitter_alpha(cutoff_mhz, dt_us);
+    s.col += int32_t((int64_t(col - s.col) * a) >> 16);
+    s.row += int32_t((int64_t(row - s.row) * a) >> 16);
+
+    // hold the reported position until the filtered one is move_min away
+    const int32_t min = f.move_min << 8;
+    const int32_t dc = s.col - (prev.col << 8);
+    const int32_t dr = s.row - (prev.row << 8);
+    if (dc <= -min || dc >= min || dr <= -min || dr >= min) {
+        out.col = (s.col + 128) >> 8;
+        out.row = (s.row + 128) >> 8;
+    } else {
+        out.col = prev.col;
+        out.row = prev.row;
+    }
+}
+
+
+// Smoothing factor for a low-pass at cutoff_mhz over dt_us, 16.16:
+// dt / (dt + tau), tau = 1 / (2 pi cutoff)
+int32_t Touchscreen::jitter_alpha(uint32_t cutoff_mhz, uint32_t dt_us)
+{
+    const uint32_t tau_us = 159'154'943 / cutoff_mhz;
+    return int32_t((uint64_t(dt_us) << 16) / (uint64_t(dt_us) + tau_us));
+}
+
+
+void Touchscreen::predict_start(PredictState &state, const Contact &cur) const
+{
+    state.col = cur.col << 8;
+    state.row = cur.row << 8;
+    state.vcol = 0;
+    state.vrow = 0;
+    state.us = _frame_data_us;
+    state.last_col = cur.col;
+    state.last_row = cur.row;
+}
+
+
+// Alpha-beta: project the track to this frame's time, correct it by alpha
+// and the velocity by beta of the miss, then project horizon_ms ahead.
+bool Touchscreen::predict_step(PredictState &state, const Contact &cur,
+                               int &col, int &row) const
+{
+    const Predictor &pr = _predictor;
+    PredictState &s = state;
+
+    uint32_t dt_us = _frame_data_us - s.us;
+    if (dt_us > 100'000) {
+        // a gap: whatever the velocity was, it is stale
+        s.vcol = 0;
+        s.vrow = 0;
+        s.col = cur.col << 8;
+        s.row = cur.row << 8;
+    }
+    if (dt_us < 1'000)
+        dt_us = 1'000; // as for the jitter filter
+    s.us = _frame_data_us;
+
+    const int32_t pcol = s.col + int32_t(int64_t(s.vcol) * dt_us / 1'000'000);
+    const int32_t prow = s.row + int32_t(int64_t(s.vrow) * dt_us / 1'000'000);
+    const int32_t rcol = (cur.col << 8) - pcol;
+    const int32_t rrow = (cur.row << 8) - prow;
+    s.col = pcol + ((rcol * pr.alpha) >> 8);
+    s.row = prow + ((rrow * pr.alpha) >> 8);
+    s.vcol += int32_t(int64_t(rcol) * pr.beta * 1'000'000 / dt_us >> 8);
+    s.vrow += int32_t(int64_t(rrow) * pr.beta * 1'000'000 / dt_us >> 8);
+
+    const int64_t h_ms = pr.horizon_ms;
+    col = clamp((s.col + int32_t(s.vcol * h_ms / 1'000) + 128) >> 8, _width);
+    row = clamp((s.row + int32_t(s.vrow * h_ms / 1'000) + 128) >> 8, _height);
+    if (col == s.last_col && row == s.last_row)
+        return false;
+    s.last_col = col;
+    s.last_row = row;
+    return true;
+}
+
+
+uint32_t Touchscreen::poll_interval_us() const
+{
+    const PollSched &ps = _poll_sched;
+    if (ps.idle_us == 0)
+        return ps.min_us;
+    uint32_t idle_us = time_us_32() - _poll_touch_us; // rollover-safe
+    uint32_t interval_us = ps.min_us;
+    for (uint32_t n = idle_us / ps.idle_us; n > 0; n--) {
+        if (interval_us >= ps.max_us / 2)
+            return ps.max_us;
+        interval_us *= 2;
+    }
+    return interval_us;
+}
+
+
+bool Touchscreen::poll_due()
+{
+    if (irq_attached())
+        return irq_take();
+    uint32_t now_us = time_us_32();
+    int32_t late_us = now_us - _poll_next_us; // rollover-safe
+    if (late_us < 0)
+        return false;
+    // keep the time since the last touch from wrapping (about 18 minutes
+    // is long past backed off all the way)
+    constexpr uint32_t idle_cap_us = 0x4000'0000;
+    if (now_us - _poll_touch_us > idle_cap_us)
+        _poll_touch_us = now_us - idle_cap_us;
+    _poll_next_us = now_us + poll_interval_us();
+    return true;
+}
+
+
+void Touchscreen::snapshot_publish()
+{
+    uint32_t seq = _snap_seq.load(std::memory_order_relaxed);
+    _snap_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    _snap.frame++;
+    _snap.time_us = time_us_32();
+    _snap.contact_cnt = _contact_cnt;
+    for (int c = 0; c < _contact_cnt; c++)
+        _snap.contacts[c] = _contacts[c];
+
+    _snap_seq.store(seq + 2, std::memory_order_release);
+}
+
+
+void Touchscreen::get_snapshot(Snapshot &snap) const
+{
+    while (true) {
+        uint32_t seq = _snap_seq.load(std::memory_order_acquire);
+        if ((seq & 1) != 0)
+            continue; // update in progress
+        snap = _snap;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_snap_seq.load(std::memory_order_relaxed) == seq)
+            return;
+    }
+}
+
+
+void Touchscreen::event_push(Event event)
+{
+    event.time_us = _frame_data_us;
+    event.int_us = _frame_int_us;
+    event.poll_us = _frame_poll_us;
+
+    int next = (_pend_tail + 1) % (pend_max + 1);
+    assert(next != _pend_head); // see contacts_update()
+    if (next == _pend_head)
+        return;
+    _pending[_pend_tail] = event;
+    _pend_tail = next;
+}
+
+
+bool Touchscreen::event_pop(Event &event)
+{
+    if (_pend_head == _pend_tail)
+        return false;
+    event = _pending[_pend_head];
+    _pend_head = (_pend_head + 1) % (pend_max + 1);
+    return true;
+}
+
+
+void Touchscreen::irq_attach(int int_gpio, bool rising)
+{
+    assert(int_gpio >= 0);
+    assert(_irq_owner == nullptr || _irq_owner == this);
+
+    irq_detach();
+
+    _irq_owner = this;
+    _irq_gpio = int_gpio;
+    _irq_events = rising ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+
+    // Make the first irq_take() return true so the caller syncs up with
+    // whatever the controller already has, even if we missed its edge.
+    _irq_seen = _irq_cnt - 1;
+    _irq_sync = true;
+
+    gpio_acknowledge_irq(_irq_gpio, _irq_events); // discard stale edge
+    gpio_add_raw_irq_handler(_irq_gpio, &Touchscreen::irq_handler);
+    gpio_set_irq_enabled(_irq_gpio, _irq_events, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
+}
+
+
+void Touchscreen::irq_detach()
+{
+    if (_irq_gpio < 0)
+        return;
+
+    assert(_irq_owner == this);
+
+    gpio_set_irq_enabled(_irq_gpio, _irq_events, false);
+    gpio_remove_raw_irq_handler(_irq_gpio, &Touchscreen::irq_handler);
+
+    _irq_gpio = -1;
+    _irq_events = 0;
+    _irq_owner = nullptr;
+}
+
+
+bool Touchscreen::irq_take()
+{
+    uint32_t cnt = _irq_cnt;
+    if (cnt == _irq_seen)
+        return false;
+    _irq_seen = cnt;
+    if (_irq_sync)
+        _irq_sync = false; // not a real edge
+    else if (_trace != nullptr)
+        _trace->record_irq(_irq_us);
+    return true;
+}
+
+
+// Raw handler shared with anything else on IO_IRQ_BANK0, so only look at
+// (and acknowledge) our own pin.
+void Touchscreen::irq_handler()
+{
+    Touchscreen *ts = _irq_owner;
+    if (ts == nullptr)
+        return;
+
+    if ((gpio_get_irq_event_mask(ts->_irq_gpio) & ts->_irq_events) == 0)
+        return;
+
+    gpio_acknowledge_irq(ts->_irq_gpio, ts->_irq_events);
+    ts->_irq_us = time_us_32();
+    ts->_irq_cnt = ts->_irq_cnt + 1;
+}
@@ -7,6 +7,7 @@
 #include "pico/stdio_usb.h"
 #include "pico/stdlib.h"
 // misc
+#include "i2c_dev.h"
 #include "sys_led.h"
 // touchscreen
 #include "ft6336u.h"
@@ -14,9 +15,10 @@
 //
 #include "ts_gpio_cfg.h"
 
-static const int ts_i2c_freq = 100'000;
+static const int ts_i2c_baud = 100'000;
 
 static void test_1(Touchscreen &ts);
+static void profiles(Ft6336u &ft6336u);
 
 
 int main()
@@ -36,10 +38,12 @@ int main()
 
     SysLed::off();
 
-    Ft6336u ft6336u(i2c0, ts_i2c_sda_gpio, ts_i2c_scl_gpio, ts_rst_gpio,
-                    ts_int_gpio, ts_i2c_freq);
+    I2cDev i2c_dev(ts_i2c_inst, ts_i2c_scl_gpio, ts_i2c_sda_gpio, ts_i2c_baud);
 
-    printf("Ft6336u: i2c running at %u Hz\n", ft6336u.i2c_freq());
+    printf("Ft6336u: i2c running at %u Hz\n", i2c_dev.baud());
+
+    Ft6336u ft6336u(i2c_dev, ts_i2c_scl_gpio, ts_i2c_sda_gpio, ts_rst_gpio,
+                    ts_int_gpio);
 
     if (!ft6336u.init(2)) {
         printf("Ft6336u: ERROR initializing\n");
@@ -53,6 +57,8 @@ int main()
 
     sleep_ms(1000);
 
+    profiles(ft6336u);
+
     test_1(ft6336u);
 
     sleep_ms(100); // let prints finish
@@ -65,16 +71,37 @@ int main()
 static void test_1(Touchscreen &ts)
 {
     while (true) {
-        int x[2], y[2];
-        int cnt = ts.get_touches(x, y, 2);
+        Touchscreen::Contact c[2];
+        int cnt = ts.get_touches(c, 2);
         printf("cnt=%d", cnt);
-        if (cnt >= 1) {
-            printf(" (%d,%d)", x[0], y[0]);
-            if (cnt >= 2) {
-                printf(" (%d,%d)", x[1], y[1]);
-            }
-        }
+        for (int t = 0; t < cnt && t < 2; t++)
+            printf(" id=%d (%d,%d) weight=%d area=%d", int(c[t].id),
+                   int(c[t].col), int(c[t].row), int(c[t].size),
+                   int(c[t].area));
         printf("\n");
         sleep_ms(1000);
     }
 }
+
+
+// Count moves for 5 seconds in each tuning profile.
+static void profiles(Ft6336u &ft6336u)
+{
+    constexpr Ft6336u::Profile profiles[] = {
+        Ft6336u::Profile::low_latency,
+        Ft6336u::Profile::balanced,
+        Ft6336u::Profile::low_power,
+    };
+    for (Ft6336u::Profile profile : profiles) {
+        const char *name = Ft6336u::profile_name(profile);
+        if (!ft6336u.set_profile(profile, 2))
+            continue;
+        printf("%s: drag a finger for the next 5 seconds\n", name);
+        int moves = 0;
+        uint32_t start_us = time_us_32();
+        while ((time_us_32() - start_us) < 5'000'000)
+            if (ft6336u.get_event().type == Touchscreen::Event::Type::move)
+                moves++;
+        printf("%s: %d moves (%.1f/sec)\n", name, moves, moves / 5.0);
+    }
+}
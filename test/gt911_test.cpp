@@ -14,6 +14,8 @@
 #include "sys_led.h"
 // touchscreen
 #include "gt911.h"
+#include "touch_service.h"
+#include "touch_trace.h"
 #include "touchscreen.h"
 //
 #include "ts_gpio_cfg.h"
@@ -24,6 +26,13 @@ static const uint8_t ts_addr = 0x14; // 0x14 or 0x5d
 static void touches(Touchscreen &ts);
 static void rotations(Touchscreen &ts);
 static void poll_events(Touchscreen &ts);
+static void ring_events(Touchscreen &ts);
+static void core1_events(Touchscreen &ts);
+static void latency(Touchscreen &ts);
+static void bus_stats(Touchscreen &ts);
+static void trace(Touchscreen &ts);
+static void report_rate(Touchscreen &ts);
+static void calibrate(Touchscreen &ts);
 
 static struct {
     const char *name;
@@ -32,6 +41,13 @@ static struct {
     {"touches", touches},
     {"rotations", rotations},
     {"poll_events", poll_events},
+    {"ring_events", ring_events},
+    {"core1_events", core1_events},
+    {"latency", latency},
+    {"bus_stats", bus_stats},
+    {"trace", trace},
+    {"report_rate", report_rate},
+    {"calibrate", calibrate},
 };
 static const int num_tests = sizeof(tests) / sizeof(tests[0]);
 
@@ -226,7 +242,178 @@ static void poll_events(Touchscreen &ts)
     while (true) {
         Touchscreen::Event event(ts.get_event());
         if (event.type != Touchscreen::Event::Type::none)
-            printf("poll_events: type=%s (%d, %d)\n", //
-                   event.type_name(), event.col, event.row);
+            printf("poll_events: type=%s id=%d (%d, %d)\n", //
+                   event.type_name(), event.id, event.col, event.row);
     }
 }
+
+
+// same as poll_events, but through service() and the event ring
+static void ring_events(Touchscreen &ts)
+{
+    while (true) {
+        ts.service();
+        Touchscreen::Event events[8];
+        int cnt = ts.get_events(events, 8);
+        for (int i = 0; i < cnt; i++) {
+            const Touchscreen::Event &event = events[i];
+            printf("ring_events: t=%lu type=%s id=%d (%d, %d) dropped=%lu\n",
+                   (unsigned long)event.time_us, event.type_name(), event.id,
+                   event.col, event.row, (unsigned long)ts.events_dropped());
+        }
+    }
+}
+
+
+// Event engine on core 1; this core prints events from the ring plus the
+// latest snapshot whenever it changes.
+static void core1_events(Touchscreen &ts)
+{
+    TouchService::start(ts);
+    uint32_t frame = 0;
+    while (true) {
+        Touchscreen::Event events[8];
+        int cnt = ts.get_events(events, 8);
+        for (int i = 0; i < cnt; i++) {
+            const Touchscreen::Event &event = events[i];
+            printf("core1_events: t=%lu type=%s id=%d (%d, %d)\n",
+                   (unsigned long)event.time_us, event.type_name(), event.id,
+                   event.col, event.row);
+        }
+        Touchscreen::Snapshot snap;
+        ts.get_snapshot(snap);
+        if (snap.frame != frame) {
+            frame = snap.frame;
+            printf("core1_events: frame=%lu t=%lu contacts=%d loops=%lu\n",
+                   (unsigned long)snap.frame, (unsigned long)snap.time_us,
+                   snap.contact_cnt, (unsigned long)TouchService::loops());
+        }
+        sleep_ms(16); // pretend to render a frame
+    }
+}
+
+
+// Run the ring for 10 seconds with a UI-like consumer, then show where the
+// time goes.
+static void latency(Touchscreen &ts)
+{
+    printf("latency: touch the screen for the next 10 seconds\n");
+    ts.latency_reset();
+    uint32_t start_us = time_us_32();
+    while ((time_us_32() - start_us) < 10'000'000) {
+        ts.service();
+        Touchscreen::Event events[8];
+        ts.get_events(events, 8);
+        sleep_us(500);
+    }
+    ts.latency_dump();
+}
+
+
+// Run the event engine for 10 seconds, then show how much of the bus it used.
+static void bus_stats(Touchscreen &ts)
+{
+    printf("bus_stats: touch the screen (or not) for the next 10 seconds\n");
+    ts.bus_stats_reset();
+    uint32_t start_us = time_us_32();
+    while ((time_us_32() - start_us) < 10'000'000)
+        ts.get_event();
+    Touchscreen::BusStats bs = ts.bus_stats();
+    printf("bus_stats: transactions=%lu wr=%lu rd=%lu bus_us=%llu (%.2f%%)\n",
+           (unsigned long)bs.transactions, (unsigned long)bs.bytes_wr,
+           (unsigned long)bs.bytes_rd, (unsigned long long)bs.bus_us,
+           double(bs.bus_us) / 100'000.0);
+    printf("bus_stats: nacks=%lu timeouts=%lu mismatches=%lu\n",
+           (unsigned long)bs.nacks, (unsigned long)bs.timeouts,
+           (unsigned long)bs.mismatches);
+}
+
+
+// Record 10 seconds of bus traffic, then print it as "tt" lines for
+// test/host/replay. The ring keeps the last 64K if there is more.
+static void trace(Touchscreen &ts)
+{
+    static uint8_t trace_buf[64 * 1024];
+    TouchTrace trace(trace_buf, sizeof(trace_buf));
+
+    printf("trace: touch the screen for the next 10 seconds\n");
+    ts.set_trace(&trace);
+    trace.start();
+    uint32_t start_us = time_us_32();
+    while ((time_us_32() - start_us) < 10'000'000)
+        ts.get_event();
+    trace.stop();
+    ts.set_trace(nullptr);
+
+    printf("trace: begin (%lu dropped)\n", (unsigned long)trace.dropped());
+    int recs = trace.stream();
+    printf("trace: end (%d records)\n", recs);
+}
+
+
+// Count events for 5 seconds at the fastest and slowest report rates, then
+// put the config back the way it was.
+static void report_rate(Touchscreen &ts)
+{
+    Gt911 &gt911 = static_cast<Gt911 &>(ts);
+    constexpr int verbosity = 1;
+
+    Gt911::Config orig;
+    if (!gt911.config_read(orig, verbosity))
+        return;
+    printf("report_rate: version=0x%02x touch_max=%d report_ms=%d "
+           "touch=%d leave=%d\n",
+           orig.version(), orig.touch_max(), orig.report_ms(),
+           orig.touch_thresh(), orig.leave_thresh());
+
+    for (int ms : {5, 20}) {
+        Gt911::Config cfg = orig;
+        cfg.set_report_ms(ms);
+        if (!gt911.config_write(cfg, verbosity))
+            return;
+        printf("report_rate: %d msec: drag a finger for the next 5 seconds\n",
+               ms);
+        int moves = 0;
+        uint32_t start_us = time_us_32();
+        while ((time_us_32() - start_us) < 5'000'000)
+            if (ts.get_event().type == Touchscreen::Event::Type::move)
+                moves++;
+        printf("report_rate: %d msec: %d moves (%.1f/sec)\n", ms, moves,
+               moves / 5.0);
+    }
+
+    // the engine may be partway through a frame
+    while (!gt911.config_write(orig))
+        ts.get_event();
+}
+
+
+// No display here, so the targets are printed; touch where each would be
+// drawn. The touches test then shows the result.
+static void calibrate(Touchscreen &ts)
+{
+    constexpr int n = 5;
+    Touchscreen::CalPoint targets[n], touches[n];
+    ts.calibration_targets(targets, n);
+    for (int i = 0; i < n; i++) {
+        printf("calibrate: touch (%d, %d)\n", targets[i].col, targets[i].row);
+        if (!ts.calibration_capture(touches[i])) {
+            printf("calibrate: timed out\n");
+            return;
+        }
+        printf("calibrate: got (%d, %d)\n", touches[i].col, touches[i].row);
+    }
+    if (!ts.calibration_solve(targets, touches, n)) {
+        printf("calibrate: touches do not fit\n");
+        return;
+    }
+    const Touchscreen::Calibration &cal = ts.get_calibration();
+    printf("calibrate: a=%ld b=%ld c=%ld d=%ld e=%ld f=%ld\n", long(cal.a),
+           long(cal.b), long(cal.c), long(cal.d), long(cal.e), long(cal.f));
+    uint8_t blob[Touchscreen::Calibration::blob_len];
+    cal.save(blob);
+    printf("calibrate: blob");
+    for (uint8_t b : blob)
+        printf(" %02x", int(b));
+    printf("\n");
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+// touchscreen
+#include "touchscreen.h"
+
+
+// Reaches the protected Gt911::frame_events() (and TouchscreenFixed's) for
+// host tests and benchmarks, which feed frames straight to the driver
+// without the bus. Ts is the class to call it on: Gt911 for the driver's
+// own map, TouchscreenFixed<Gt911, ...> for the fixed one.
+struct FrameAccess {
+    template <typename Ts>
+    static int frame_events(Ts &ts, const uint8_t frame[],
+                            Touchscreen::Event events[], int event_cnt_max)
+    {
+        return ts.frame_events(frame, events, event_cnt_max);
+    }
+};
@@ -0,0 +1,1202 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sched.h>
+#include <unistd.h>
+#include <vector>
+// host stand-ins
+#include "i2c_dev.h"
+#include "pico/stdlib.h"
+// touchscreen
+#include "frame_batch.h"
+#include "ft6336u.h"
+#include "gesture.h"
+#include "gt911.h"
+#include "touch_trace.h"
+#include "touchscreen.h"
+#include "touchscreen_fixed.h"
+//
+#include "frame_access.h"
+#include "sim.h"
+#include "sim_ft6336u.h"
+#include "sim_gt911.h"
+#include "trace_replay.h"
+
+// Benchmarks print one line per result:
+//   bench=<name> <key>=<value> ...
+//
+// CPU times are host nanoseconds with bus timing off, so they measure the
+// driver's own work (plus the simulated device's, which is small) and not
+// waiting on the bus. Compare them between builds on the same machine.
+
+static constexpr int rst_gpio = 2;
+static constexpr int int_gpio = 3;
+
+
+// Touch count per 10 msec poll
+struct Trace {
+    const char *name;
+    const char *counts;
+};
+
+static const Trace traces[] = {
+    {"idle", "0000000000000000000000000000000000000000"},
+    {"tap", "0000011111111110000000000111111111100000"},
+    {"drag", "0111111111111111111111111111111111111110"},
+    {"pinch", "0112222222222122222221222222222222221110"},
+    {"flicker", "0122121212122212121221212122121212121210"},
+};
+
+
+static void ft6336u_read_len(const Trace &trace, bool predictive)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    ts.init();
+    ts.set_predictive_read(predictive);
+    // read length only: poll at the minimum, never backing off when idle
+    uint32_t min_us = ts.poll_sched().min_us;
+    ts.set_poll_sched({min_us, min_us, 0});
+    ts.bus_stats_reset();
+
+    int polls = 0;
+    for (const char *c = trace.counts; *c != '\0'; c++) {
+        int n = *c - '0';
+        SimFt6336u::Point p[2] = {{0, 100 + polls, 100, 5, 1},
+                                  {1, 200, 200 + polls, 5, 1}};
+        dev.frame(p, n);
+        uint64_t end_us = sim::now_us() + 10'000;
+        while (sim::now_us() < end_us)
+            ts.get_event();
+        polls++;
+    }
+
+    Touchscreen::BusStats bs = ts.bus_stats();
+    // reading all 13 registers every poll
+    uint32_t fixed_bits = polls * (22 + 9 * (1 + 13));
+    printf("bench=ft6336u_read_len trace=%s predictive=%d polls=%d"
+           " transactions=%u bits=%u bits_per_poll=%.1f fixed_bits=%u"
+           " bus_us=%u\n",
+           trace.name, predictive ? 1 : 0, polls, bs.transactions,
+           unsigned(bs.bits), double(bs.bits) / polls, fixed_bits,
+           unsigned(bs.bus_us));
+}
+
+
+// Stay on one CPU, so timings are not mixed across cores and their clocks.
+static void cpu_pin()
+{
+    int cpu = sched_getcpu();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    bool ok = cpu >= 0 && sched_setaffinity(0, sizeof(set), &set) == 0;
+    printf("bench=cpu pinned=%d cpu=%d\n", ok ? 1 : 0, cpu);
+}
+
+
+static uint64_t now_ns()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch())
+                        .count());
+}
+
+
+// cost of timing a call, subtracted from each timed call
+static uint64_t timer_ns = 0;
+
+static void timer_calibrate()
+{
+    std::vector<uint64_t> ns(100'000);
+    for (uint64_t &n : ns) {
+        uint64_t t0 = now_ns();
+        n = now_ns() - t0;
+    }
+    std::sort(ns.begin(), ns.end());
+    timer_ns = ns[ns.size() / 2];
+    printf("bench=timer ns_per_call=%lu\n", (unsigned long)timer_ns);
+}
+
+
+// Per-call times, reported as median and mean
+struct Samples {
+    std::vector<uint64_t> ns;
+
+    void add(uint64_t t)
+    {
+        ns.push_back(t > timer_ns ? t - timer_ns : 0);
+    }
+
+    void print(const char *prefix, const char *key)
+    {
+        if (ns.size() < 100)
+            return; // start-up transient, not a step this run exercises
+        std::sort(ns.begin(), ns.end());
+        uint64_t sum = 0;
+        for (uint64_t n : ns)
+            sum += n;
+        printf("%s %s calls=%zu ns_per_call=%lu ns_p50=%lu ns_p90=%lu\n",
+               prefix, key, ns.size(), (unsigned long)(sum / ns.size()),
+               (unsigned long)ns[ns.size() / 2],
+               (unsigned long)ns[ns.size() * 9 / 10]);
+    }
+};
+
+
+// What one get_event() call did, going by its effect on the bus (a new
+// transfer started), on the contact tracker (a frame parsed, seen as the
+// snapshot frame count moving), and whether it returned an event. Bus timing
+// is off, so every transfer is done by the next call that looks at it.
+enum Step {
+    start_status_read,
+    check_status_read,
+    check_touch_read,
+    event_pop,
+    status_write_done,
+    idle,
+    step_cnt,
+};
+
+static const char *step_names[step_cnt] = {
+    "start_status_read", "check_status_read", "check_touch_read",
+    "event_pop",         "status_write_done", "idle",
+};
+
+
+// Run frame_cnt frames through ts: present(f) puts frame f on the device,
+// then get_event() is called and timed until the cycle is over (quiet for a
+// while), then wait(f) moves the clock to the next frame. Returns events;
+// busy_ns is the time in calls that did something (not idle).
+static int step_frames(Touchscreen &ts, int frame_cnt,
+                       const std::function<void(int)> &present,
+                       const std::function<void(int)> &wait,
+                       Samples steps[step_cnt], uint64_t &busy_ns)
+{
+    enum class Xfer { none, status, touch, write };
+    Xfer xfer = Xfer::none; // transfer in flight
+    int events = 0;
+    busy_ns = 0;
+    for (int f = 0; f < frame_cnt; f++) {
+        present(f);
+        int quiet = 0;
+        while (quiet < 4) {
+            uint32_t tx = ts.bus_stats().transactions;
+            Touchscreen::Snapshot snap;
+            ts.get_snapshot(snap);
+            uint32_t frame = snap.frame;
+            uint64_t t0 = now_ns();
+            Touchscreen::Event e = ts.get_event();
+            uint64_t t = now_ns() - t0;
+            bool started = ts.bus_stats().transactions != tx;
+            ts.get_snapshot(snap);
+            bool parsed = snap.frame != frame;
+            bool got = e.type != Touchscreen::Event::Type::none;
+            Step step = idle;
+            if (xfer == Xfer::none && started) {
+                step = start_status_read;
+                xfer = Xfer::status;
+            } else if (xfer == Xfer::status && (started || parsed)) {
+                step = check_status_read;
+                xfer = !started ? Xfer::none
+                       : parsed ? Xfer::write
+                                : Xfer::touch;
+            } else if (xfer == Xfer::touch && (started || parsed)) {
+                step = check_touch_read;
+                xfer = started ? Xfer::write : Xfer::none;
+            } else if (got) {
+                step = event_pop;
+            } else if (xfer == Xfer::write) {
+                step = status_write_done;
+                xfer = started ? Xfer::status : Xfer::none;
+            } else if (xfer == Xfer::status) {
+                step = check_status_read; // not ready, back to idle
+                xfer = Xfer::none;
+            }
+            quiet = (step == idle) ? quiet + 1 : 0;
+            if (step != idle)
+                busy_ns += t > timer_ns ? t - timer_ns : 0;
+            steps[step].add(t);
+            if (got)
+                events++;
+        }
+        wait(f);
+    }
+    return events;
+}
+
+
+static const char *rotation_name(Touchscreen::Rotation r)
+{
+    switch (r) {
+        case Touchscreen::Rotation::portrait:
+            return "portrait";
+        case Touchscreen::Rotation::landscape:
+            return "landscape";
+        case Touchscreen::Rotation::portrait2:
+            return "portrait2";
+        default:
+            return "landscape2";
+    }
+}
+
+
+static const Touchscreen::Rotation rotations[] = {
+    Touchscreen::Rotation::portrait,
+    Touchscreen::Rotation::landscape,
+    Touchscreen::Rotation::portrait2,
+    Touchscreen::Rotation::landscape2,
+};
+
+
+// GT911 with INT, bus timing off. touches alternates between lo and hi so
+// frames going up need the touch read; every frame moves every touch.
+static void gt911_steps(Touchscreen::Rotation rotation, int lo, int hi)
+{
+    constexpr uint8_t addr = 0x14;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr, int_gpio);
+    Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+    ts.init();
+    while (ts.get_event().type != Touchscreen::Event::Type::none)
+        ;
+    i2c.bus_timing(false);
+    ts.set_rotation(rotation);
+
+    Samples steps[step_cnt];
+    uint64_t busy_ns;
+    constexpr int frame_cnt = 10'000;
+    int events = step_frames(
+        ts, frame_cnt,
+        [&](int f) {
+            SimGt911::Point p[5];
+            int n = (f & 1) ? hi : lo;
+            for (int t = 0; t < n; t++)
+                p[t] = {t, 10 + 50 * t + (f % 100), 10 + (f % 200), 10};
+            dev.frame(p, n);
+        },
+        [&](int) { sim::advance_us(1'000); }, steps, busy_ns);
+
+    char prefix[96];
+    snprintf(prefix, sizeof(prefix),
+             "bench=gt911_step rotation=%s touches=%d/%d",
+             rotation_name(rotation), lo, hi);
+    for (int s = 0; s < step_cnt; s++) {
+        char key[32];
+        snprintf(key, sizeof(key), "step=%s", step_names[s]);
+        steps[s].print(prefix, key);
+    }
+    printf("%s frames=%d events=%d ns_per_frame=%lu\n", prefix, frame_cnt,
+           events, (unsigned long)(busy_ns / frame_cnt));
+}
+
+
+// FT6336U polled every 10 msec, bus timing off.
+static void ft6336u_steps(Touchscreen::Rotation rotation, int lo, int hi)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    ts.init();
+    i2c.bus_timing(false);
+    ts.set_rotation(rotation);
+
+    Samples steps[step_cnt];
+    uint64_t busy_ns;
+    constexpr int frame_cnt = 10'000;
+    int events = step_frames(
+        ts, frame_cnt,
+        [&](int f) {
+            SimFt6336u::Point p[2];
+            int n = (f & 1) ? hi : lo;
+            for (int t = 0; t < n; t++)
+                p[t] = {t, 10 + 50 * t + (f % 100), 10 + (f % 200), 5, 1};
+            dev.frame(p, n);
+        },
+        [&](int) { sim::advance_us(10'000); }, steps, busy_ns);
+
+    char prefix[96];
+    snprintf(prefix, sizeof(prefix),
+             "bench=ft6336u_step rotation=%s touches=%d/%d",
+             rotation_name(rotation), lo, hi);
+    for (int s = 0; s < step_cnt; s++) {
+        if (s == status_write_done)
+            continue; // no status clear on FT6336U
+        char key[32];
+        snprintf(key, sizeof(key), "step=%s", step_names[s]);
+        steps[s].print(prefix, key);
+    }
+    printf("%s frames=%d events=%d ns_per_frame=%lu\n", prefix, frame_cnt,
+           events, (unsigned long)(busy_ns / frame_cnt));
+}
+
+
+// Ft6336u::get_touches(): one sync read and the parse, bus timing off.
+static void ft6336u_get_touches()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    ts.init();
+    i2c.bus_timing(false);
+
+    SimFt6336u::Point p[2] = {{0, 100, 100, 5, 1}, {1, 200, 200, 5, 1}};
+    dev.frame(p, 2);
+    Samples samples;
+    int col[2], row[2];
+    for (int i = 0; i < 100'000; i++) {
+        uint64_t t0 = now_ns();
+        ts.get_touches(col, row, 2);
+        samples.add(now_ns() - t0);
+    }
+    samples.print("bench=ft6336u_get_touches", "touches=2");
+}
+
+
+// Scripts: frame f -> touch count and positions
+struct Script {
+    const char *name;
+    int frame_cnt;
+    int (*frame)(int f, int x[], int y[]); // returns touch count
+};
+
+// one finger across the screen and back, lifting every 100 frames
+static int swipe(int f, int x[], int y[])
+{
+    if (f % 100 >= 95)
+        return 0;
+    x[0] = 20 + 3 * (f % 100);
+    y[0] = 240;
+    return 1;
+}
+
+// down for 5 frames, up for 5
+static int tap(int f, int x[], int y[])
+{
+    if (f % 10 >= 5)
+        return 0;
+    x[0] = 100 + (f / 10) % 50;
+    y[0] = 200;
+    return 1;
+}
+
+// two fingers pinching in and out
+static int multi(int f, int x[], int y[])
+{
+    int d = f % 100 < 50 ? f % 50 : 50 - f % 50;
+    x[0] = 100 + d;
+    y[0] = 200 + d;
+    x[1] = 220 - d;
+    y[1] = 320 - d;
+    return 2;
+}
+
+static const Script scripts[] = {
+    {"swipe", 20'000, swipe},
+    {"tap", 20'000, tap},
+    {"multi", 20'000, multi},
+};
+
+
+// Events per CPU second through the whole engine, bus timing off
+static void events_print(const char *driver, const Script &script,
+                         int events, uint64_t busy_ns)
+{
+    printf("bench=events driver=%s script=%s frames=%d events=%d"
+           " ns_per_event=%lu events_per_sec=%.0f\n",
+           driver, script.name, script.frame_cnt, events,
+           (unsigned long)(busy_ns / (events > 0 ? events : 1)),
+           busy_ns > 0 ? events * 1e9 / double(busy_ns) : 0.0);
+}
+
+
+static void gt911_events(const Script &script)
+{
+    constexpr uint8_t addr = 0x14;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr, int_gpio);
+    Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+    ts.init();
+    while (ts.get_event().type != Touchscreen::Event::Type::none)
+        ;
+    i2c.bus_timing(false);
+
+    Samples steps[step_cnt];
+    uint64_t busy_ns;
+    int events = step_frames(
+        ts, script.frame_cnt,
+        [&](int f) {
+            int x[2], y[2];
+            int n = script.frame(f, x, y);
+            SimGt911::Point p[2];
+            for (int t = 0; t < n; t++)
+                p[t] = {t, x[t], y[t], 10};
+            dev.frame(p, n);
+        },
+        [&](int) { sim::advance_us(1'000); }, steps, busy_ns);
+    events_print("gt911", script, events, busy_ns);
+}
+
+
+static void ft6336u_events(const Script &script)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    ts.init();
+    i2c.bus_timing(false);
+
+    Samples steps[step_cnt];
+    uint64_t busy_ns;
+    int events = step_frames(
+        ts, script.frame_cnt,
+        [&](int f) {
+            int x[2], y[2];
+            int n = script.frame(f, x, y);
+            SimFt6336u::Point p[2];
+            for (int t = 0; t < n; t++)
+                p[t] = {t, x[t], y[t], 5, 1};
+            dev.frame(p, n);
+        },
+        [&](int) { sim::advance_us(10'000); }, steps, busy_ns);
+    events_print("ft6336u", script, events, busy_ns);
+}
+
+
+// Touchscreen with no controller, to time transform() alone
+class XformOnly : public Touchscreen
+{
+public:
+
+    XformOnly() : Touchscreen(480, 320)
+    {
+    }
+
+    int get_touches(Contact[], int, int) override
+    {
+        return 0;
+    }
+
+    Event get_event() override
+    {
+        return Event();
+    }
+
+    using Touchscreen::transform;
+};
+
+
+// Per-point cost of the panel transform, without and with the edge grid,
+// over a sweep of the panel.
+static void transform_cost(bool grid)
+{
+    XformOnly ts;
+    if (grid) {
+        Touchscreen::Grid g;
+        for (int v = 0; v < Touchscreen::grid_v; v++)
+            for (int u = 0; u < Touchscreen::grid_u; u++)
+                for (int k = 0; k < 2; k++)
+                    g.off[v][u][k] = int8_t((u * 7 + v * 3 + k) % 9 - 4);
+        ts.set_grid(g);
+    }
+
+    constexpr int pass_cnt = 20;
+    int points = 0;
+    uint32_t sum = 0;
+    uint64_t t0 = now_ns();
+    for (int pass = 0; pass < pass_cnt; pass++) {
+        for (int y = pass; y < 480; y += 3) {
+            for (int x = 0; x < 320; x++) {
+                int col, row;
+                ts.transform(x, y, col, row);
+                sum += uint32_t(col + row);
+                points++;
+            }
+        }
+    }
+    uint64_t ns = now_ns() - t0;
+    printf("bench=transform grid=%d points=%d ns_per_point=%.2f sum=%u\n",
+           int(grid), points, double(ns) / points, unsigned(sum));
+}
+
+
+// Per-event cost of the gesture recognizer, over a stream of taps, swipes
+// and two-finger pinches at 100 frames/sec.
+static void gesture_cost()
+{
+    using Type = Touchscreen::Event::Type;
+    std::vector<Touchscreen::Event> events;
+    uint32_t us = 0;
+    auto add = [&](Type type, int id, int col, int row) {
+        Touchscreen::Event e(type, col, row, id);
+        e.time_us = us;
+        events.push_back(e);
+    };
+    for (int rep = 0; rep < 200; rep++) {
+        add(Type::down, 0, 100, 100); // tap
+        us += 50'000;
+        add(Type::up, 0, 100, 100);
+        us += 500'000;
+        add(Type::down, 0, 40, 160); // swipe
+        for (int f = 1; f <= 20; f++) {
+            us += 10'000;
+            add(Type::move, 0, 40 + 20 * f, 160 + f);
+        }
+        add(Type::up, 0, 440, 180);
+        us += 500'000;
+        add(Type::down, 0, 200, 160); // pinch
+        add(Type::down, 1, 280, 160);
+        for (int f = 1; f <= 20; f++) {
+            us += 10'000;
+            add(Type::move, 0, 200 - 2 * f, 160 - f);
+            add(Type::move, 1, 280 + 2 * f, 160 + f);
+        }
+        add(Type::up, 0, 160, 140);
+        add(Type::up, 1, 320, 180);
+        us += 500'000;
+    }
+
+    GestureRecognizer gr;
+    GestureRecognizer::Gesture g;
+    int gestures = 0;
+    uint64_t t0 = now_ns();
+    for (const Touchscreen::Event &e : events) {
+        gr.event(e);
+        while (gr.pop(g))
+            gestures++;
+    }
+    uint64_t ns = now_ns() - t0;
+    printf("bench=gesture events=%d gestures=%d ns_per_event=%.2f\n",
+           int(events.size()), gestures, double(ns) / events.size());
+}
+
+
+// One finger on a GT911 at 100 frames/sec: resting at (160, 240) with
+// uniform noise of +/- noise, or, with speed > 0, stroking along x at speed
+// pixels per frame. Counts move events and redraws (frames with any event
+// out of them), and keeps the reported position after each frame.
+static void jitter_run(bool filter, int noise, int speed, int &moves,
+                       int &redraws, std::vector<Touchscreen::Contact> &track)
+{
+    constexpr uint8_t addr = 0x14;
+    constexpr int frame_cnt = 300;
+    constexpr int calls_per_frame = 16;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr, int_gpio);
+    Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+    ts.init();
+    while (ts.get_event().type != Touchscreen::Event::Type::none)
+        ;
+    i2c.bus_timing(false);
+    if (filter)
+        ts.set_jitter_filter(Touchscreen::JitterFilter());
+
+    uint32_t seed = 12345;
+    auto rand_noise = [&]() {
+        seed = seed * 1'103'515'245 + 12'345;
+        return int((seed >> 16) % (2 * noise + 1)) - noise;
+    };
+
+    moves = 0;
+    redraws = 0;
+    track.clear();
+    for (int f = 0; f < frame_cnt; f++) {
+        int x = speed > 0 ? 10 + (f * speed) % 300 : 160;
+        SimGt911::Point p = {0, x + rand_noise(), 240 + rand_noise(), 10};
+        dev.frame(&p, 1);
+        int events = 0;
+        for (int c = 0; c < calls_per_frame; c++) {
+            Touchscreen::Event e = ts.get_event();
+            if (e.type == Touchscreen::Event::Type::move)
+                moves++;
+            if (e.type != Touchscreen::Event::Type::none)
+                events++;
+        }
+        if (events > 0)
+            redraws++;
+        Touchscreen::Contact c;
+        if (ts.get_contacts(&c, 1) == 1)
+            track.push_back(c);
+        sim::advance_us(10'000);
+    }
+}
+
+
+// Jitter filter: moves and redraws from a resting finger with and without
+// it, and how far behind a clean stroke it reports (mean and worst pixels,
+// against the unfiltered position, frames while the finger is moving).
+static void jitter_filter()
+{
+    std::vector<Touchscreen::Contact> track;
+    for (int noise : {1, 2, 3}) {
+        for (bool filter : {false, true}) {
+            int moves, redraws;
+            jitter_run(filter, noise, 0, moves, redraws, track);
+            printf("bench=jitter_rest filter=%d noise=%d frames=300 moves=%d"
+                   " redraws=%d\n",
+                   int(filter), noise, moves, redraws);
+        }
+    }
+    for (int speed : {1, 3, 10, 30}) {
+        std::vector<Touchscreen::Contact> ref;
+        int moves, redraws;
+        jitter_run(false, 0, speed, moves, redraws, ref);
+        jitter_run(true, 0, speed, moves, redraws, track);
+        int n = 0, sum = 0, worst = 0;
+        for (size_t f = 1; f < track.size() && f < ref.size(); f++) {
+            int step = abs(ref[f].col - ref[f - 1].col) +
+                       abs(ref[f].row - ref[f - 1].row);
+            if (step > 2 * speed)
+                continue; // wrapped back to the start
+            int lag = std::max(abs(ref[f].col - track[f].col),
+                               abs(ref[f].row - track[f].row));
+            sum += lag;
+            worst = std::max(worst, lag);
+            n++;
+        }
+        printf("bench=jitter_lag speed_px_per_sec=%d lag_mean=%.2f"
+               " lag_max=%d\n",
+               speed * 100, n > 0 ? double(sum) / n : 0.0, worst);
+    }
+}
+
+
+// Strokes for prediction, portrait (x, y) at t seconds
+struct Stroke {
+    const char *name;
+    void (*at)(double t, double &x, double &y);
+};
+
+static const Stroke strokes[] = {
+    {"circle", // 100 pixel radius, once a second: 630 pixels/sec
+     [](double t, double &x, double &y) {
+         x = 160 + 100 * cos(2 * M_PI * t);
+         y = 240 + 100 * sin(2 * M_PI * t);
+     }},
+    {"scribble",
+     [](double t, double &x, double &y) {
+         x = 160 + 120 * sin(2 * M_PI * 1.3 * t);
+         y = 240 + 180 * sin(2 * M_PI * 0.7 * t);
+     }},
+    {"flick", // 360 pixels in 0.4 sec, easing in and out, a rest, back
+     [](double t, double &x, double &y) {
+         double s = std::min(fmod(t, 0.6) / 0.4, 1.0);
+         if (fmod(t, 1.2) >= 0.6)
+             s = 1 - s;
+         x = 160;
+         y = 60 + 360 * (1 - cos(M_PI * s)) / 2;
+     }},
+};
+
+
+// A GT911 in portrait at 100 frames/sec following the stroke for three
+// seconds. After each frame, compares where the UI would draw the contact
+// (the latest event, predicted or not) and where it would without
+// prediction (the latest real event) with where the finger is horizon_ms
+// after the frame was sampled.
+static void predict_run(const Stroke &stroke, int horizon_ms, bool linear)
+{
+    static const int noise[] = {0, 1, -1, 0, 1, 0, -1, -1, 1, 0, 0, -1, 1};
+    constexpr uint8_t addr = 0x14;
+    constexpr int frame_cnt = 300;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr, int_gpio);
+    Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+    ts.init();
+    while (ts.get_event().type != Touchscreen::Event::Type::none)
+        ;
+    ts.set_rotation(Touchscreen::Rotation::portrait); // (col, row) = (x, y)
+    Touchscreen::Predictor pr;
+    pr.horizon_ms = horizon_ms;
+    if (linear)
+        pr.alpha = pr.beta = 256;
+    ts.set_predictor(pr);
+
+    const uint64_t start_us = sim::now_us();
+    std::vector<double> err, err_none;
+    int shown_col = 0, shown_row = 0;
+    int real_col = 0, real_row = 0;
+    int predicted = 0;
+    for (int f = 0; f < frame_cnt; f++) {
+        const uint64_t frame_us = sim::now_us();
+        double x, y;
+        stroke.at((frame_us - start_us) / 1e6, x, y);
+        // a pixel of jitter, as from a real panel
+        SimGt911::Point p = {0, int(lround(x)) + noise[f % 13],
+                             int(lround(y)) + noise[(f + 5) % 11], 10};
+        dev.frame(&p, 1);
+        while (sim::now_us() < frame_us + 10'000) {
+            Touchscreen::Event e = ts.get_event();
+            if (e.type == Touchscreen::Event::Type::none)
+                continue;
+            shown_col = e.col;
+            shown_row = e.row;
+            if (e.predicted) {
+                predicted++;
+            } else {
+                real_col = e.col;
+                real_row = e.row;
+            }
+        }
+        if (f < 10)
+            continue; // let the tracker find the stroke
+        stroke.at((frame_us - start_us) / 1e6 + horizon_ms / 1e3, x, y);
+        err.push_back(hypot(shown_col - x, shown_row - y));
+        err_none.push_back(hypot(real_col - x, real_row - y));
+    }
+
+    auto mean = [](const std::vector<double> &v) {
+        double sum = 0;
+        for (double d : v)
+            sum += d;
+        return v.empty() ? 0.0 : sum / v.size();
+    };
+    auto p95 = [](std::vector<double> v) {
+        std::sort(v.begin(), v.end());
+        return v.empty() ? 0.0 : v[v.size() * 95 / 100];
+    };
+    printf("bench=predict stroke=%s horizon_ms=%d predictor=%s"
+           " predicted=%d err_mean=%.1f err_p95=%.1f"
+           " none_mean=%.1f none_p95=%.1f\n",
+           stroke.name, horizon_ms, linear ? "linear" : "alpha_beta",
+           predicted, mean(err), p95(err), mean(err_none), p95(err_none));
+}
+
+
+// The virtual interface against the compile-time flavor, on the frame path
+// alone: each script frame is built once as a GT911 burst read leaves it
+// (status, then point records) and fed through frame_events(), so the time
+// is parsing, the map and the contact tracker, with no bus engine in it.
+// Gt911 maps with the tables get_event() uses behind a Touchscreen &;
+// TouchscreenFixed<Gt911, ...> with its constants. Trials of the whole
+// script alternate between the two so clock drift hits both alike; each
+// reports its fastest trial, the median, and the spread of the median over
+// the fastest.
+static void gt911_dispatch(const Script &script)
+{
+    using Gt911Fixed =
+        TouchscreenFixed<Gt911, 480, 320, Touchscreen::Rotation::landscape>;
+    constexpr uint8_t addr = 0x14;
+    constexpr int trials = 31;
+    constexpr int frame_len = 1 + 2 * 8; // status, two point records
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr, int_gpio);
+    Gt911 plain(i2c, addr, rst_gpio, int_gpio);
+    plain.init();
+    plain.set_rotation(Touchscreen::Rotation::landscape);
+    Gt911Fixed fixed(i2c, addr, rst_gpio, int_gpio);
+    fixed.init();
+
+    std::vector<uint8_t> frames(script.frame_cnt * frame_len);
+    for (int f = 0; f < script.frame_cnt; f++) {
+        uint8_t *frame = &frames[f * frame_len];
+        int x[2], y[2];
+        int n = script.frame(f, x, y);
+        frame[0] = uint8_t(0x80 | n);
+        for (int t = 0; t < n; t++) {
+            uint8_t *rec = frame + 1 + t * 8;
+            rec[0] = uint8_t(t);
+            rec[1] = uint8_t(x[t]);
+            rec[2] = uint8_t(x[t] >> 8);
+            rec[3] = uint8_t(y[t]);
+            rec[4] = uint8_t(y[t] >> 8);
+            rec[5] = 10; // size
+            rec[6] = 0;
+            rec[7] = 0;
+        }
+    }
+
+    // one trial: the whole script; returns ns
+    Touchscreen::Event events[2 * Touchscreen::contact_max];
+    int event_cnt = 0;
+    auto trial = [&](auto &ts) {
+        event_cnt = 0;
+        uint64_t t0 = now_ns();
+        for (int f = 0; f < script.frame_cnt; f++)
+            event_cnt += FrameAccess::frame_events(
+                ts, &frames[f * frame_len], events,
+                2 * Touchscreen::contact_max);
+        return now_ns() - t0;
+    };
+    std::vector<uint64_t> ns[2];
+    for (int t = 0; t < trials; t++) {
+        ns[0].push_back(trial(plain));
+        ns[1].push_back(trial(fixed));
+    }
+
+    const char *variants[2] = {"virtual", "fixed"};
+    for (int v = 0; v < 2; v++) {
+        std::sort(ns[v].begin(), ns[v].end());
+        double min = double(ns[v].front()) / script.frame_cnt;
+        double p50 = double(ns[v][ns[v].size() / 2]) / script.frame_cnt;
+        printf("bench=dispatch driver=gt911 variant=%s script=%s frames=%d"
+               " events=%d ns_per_frame_min=%.1f ns_per_frame_p50=%.1f"
+               " spread=%.1f%%\n",
+               variants[v], script.name, script.frame_cnt, event_cnt, min,
+               p50, 100 * (p50 - min) / min);
+    }
+}
+
+
+// Code size of each flavor's get_event(), from this binary's symbol table,
+// with any templates instantiated for it that did not inline. The bus
+// engine and contact tracker both flavors call are "shared".
+static void gt911_dispatch_size()
+{
+    char exe[1024];
+    ssize_t exe_len = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    char cmd[sizeof(exe) + 32];
+    FILE *nm = nullptr;
+    if (exe_len > 0) {
+        exe[exe_len] = '\0';
+        snprintf(cmd, sizeof(cmd), "nm -C -S '%s' 2>/dev/null", exe);
+        nm = popen(cmd, "r");
+    }
+    if (nm == nullptr) {
+        printf("bench=dispatch_size nm=unavailable\n");
+        return;
+    }
+    struct Part {
+        const char *variant;
+        int symbols;
+        unsigned long bytes;
+    } parts[] = {{"virtual", 0, 0}, {"fixed", 0, 0}, {"shared", 0, 0}};
+    char line[4096];
+    while (fgets(line, sizeof(line), nm) != nullptr) {
+        unsigned long adrs, size;
+        char type;
+        int name_pos;
+        if (sscanf(line, "%lx %lx %c %n", &adrs, &size, &type, &name_pos) !=
+            3)
+            continue; // no size
+        if (type != 't' && type != 'T' && type != 'W' && type != 'w')
+            continue; // not code
+        const char *name = line + name_pos;
+        bool event_path = strstr(name, "get_event()") != nullptr;
+        Part *part = nullptr;
+        if (strstr(name, "TouchscreenFixed<Gt911") != nullptr) {
+            if (event_path)
+                part = &parts[1];
+        } else if (strstr(name, "Gt911::") != nullptr && event_path) {
+            part = &parts[0];
+        } else if (strstr(name, "Gt911::engine_step(") != nullptr ||
+                   strstr(name, "Touchscreen::contacts_update(") != nullptr ||
+                   strstr(name, "Touchscreen::event_pop(") != nullptr ||
+                   strstr(name, "Touchscreen::grid_apply(") != nullptr) {
+            part = &parts[2];
+        }
+        if (part != nullptr) {
+            part->symbols++;
+            part->bytes += size;
+        }
+    }
+    pclose(nm);
+    for (const Part &part : parts)
+        printf("bench=dispatch_size driver=gt911 variant=%s symbols=%d"
+               " bytes=%lu\n",
+               part.variant, part.symbols, part.bytes);
+}
+
+
+// Record a minute of GT911 swiping (INT, 100 frames/sec), then time how
+// long replaying it takes.
+static void gt911_replay_speed()
+{
+    constexpr uint8_t addr = 0x14;
+    constexpr int frame_cnt = 6'000;
+    std::vector<uint8_t> trace_buf(2 * 1024 * 1024);
+    std::vector<uint8_t> raw(trace_buf.size());
+    int raw_len;
+    int rec_events = 0;
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(addr, int_gpio);
+        Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+        ts.init();
+        while (ts.get_event().type != Touchscreen::Event::Type::none)
+            ;
+        TouchTrace trace(trace_buf.data(), int(trace_buf.size()));
+        ts.set_trace(&trace);
+        trace.start();
+        for (int f = 0; f < frame_cnt; f++) {
+            SimGt911::Point p{f / 100, 20 + (f % 100) * 3, 240, 10};
+            dev.frame(&p, (f % 100) < 90 ? 1 : 0);
+            uint64_t end_us = sim::now_us() + 10'000;
+            while (sim::now_us() < end_us)
+                if (ts.get_event().type != Touchscreen::Event::Type::none)
+                    rec_events++;
+        }
+        raw_len = trace.take(raw.data(), int(raw.size()));
+    }
+
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr, int_gpio);
+    Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+    ts.init();
+    while (ts.get_event().type != Touchscreen::Event::Type::none)
+        ;
+    TraceReplay replay(addr, 2, int_gpio);
+    replay.load(raw.data(), raw_len);
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t start_us = sim::now_us();
+    replay.start();
+    int events = replay.run(ts, i2c);
+    auto t1 = std::chrono::steady_clock::now();
+    double wall_s = std::chrono::duration<double>(t1 - t0).count();
+    double sim_s = double(sim::now_us() - start_us) / 1e6;
+    printf("bench=gt911_replay records=%d events=%d recorded_events=%d"
+           " sim_s=%.1f wall_s=%.3f speedup=%.0f\n",
+           replay.records(), events, rec_events, sim_s, wall_s,
+           sim_s / wall_s);
+}
+
+
+// Record ten seconds of two fingers dragging on a GT911 reporting every
+// msec, then replay it delivering every event as get_events() would, and
+// per display frame as get_frame_events() would at 30 and 60 Hz.
+static void gt911_frame_sync()
+{
+    constexpr uint8_t addr = 0x14;
+    constexpr int frame_cnt = 10'000;
+    std::vector<uint8_t> trace_buf(4 * 1024 * 1024);
+    std::vector<uint8_t> raw(trace_buf.size());
+    int raw_len;
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(addr, int_gpio);
+        Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+        ts.init();
+        while (ts.get_event().type != Touchscreen::Event::Type::none)
+            ;
+        TouchTrace trace(trace_buf.data(), int(trace_buf.size()));
+        ts.set_trace(&trace);
+        trace.start();
+        for (int f = 0; f < frame_cnt; f++) {
+            int s = f % 1'000; // a stroke a second, lifting for the last 100
+            SimGt911::Point p[2] = {{2 * (f / 1'000), 100, 20 + s / 2, 10},
+                                    {2 * (f / 1'000) + 1, 220, 20 + s / 2, 10}};
+            dev.frame(p, s < 900 ? 2 : 0);
+            uint64_t end_us = sim::now_us() + 1'000;
+            while (sim::now_us() < end_us)
+                ts.get_event();
+        }
+        raw_len = trace.take(raw.data(), int(raw.size()));
+    }
+
+    for (int hz : {0, 30, 60}) {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(addr, int_gpio);
+        Gt911 ts(i2c, addr, rst_gpio, int_gpio);
+        ts.init();
+        while (ts.get_event().type != Touchscreen::Event::Type::none)
+            ;
+        TraceReplay replay(addr, 2, int_gpio);
+        replay.load(raw.data(), raw_len);
+        FrameBatch<Touchscreen::Event, Touchscreen::event_ring_len> batch;
+        const uint32_t frame_us = hz > 0 ? 1'000'000 / hz : 0;
+        uint32_t tick_us = 0;
+        int delivered = 0, moves = 0;
+        auto tick = [&]() {
+            Touchscreen::Event ev[8];
+            int n;
+            while ((n = batch.take(ev, 8)) > 0) {
+                delivered += n;
+                for (int i = 0; i < n; i++)
+                    if (ev[i].type == Touchscreen::Event::Type::move)
+                        moves++;
+            }
+        };
+        uint64_t start_us = sim::now_us();
+        replay.start();
+        int events = replay.run(ts, i2c, [&](const Touchscreen::Event &e) {
+            if (tick_us == 0)
+                tick_us = e.time_us + frame_us;
+            while (frame_us != 0 && int32_t(e.time_us - tick_us) >= 0) {
+                tick();
+                tick_us += frame_us;
+            }
+            batch.add(e);
+            if (frame_us == 0)
+                tick();
+        });
+        tick();
+        double sim_s = double(sim::now_us() - start_us) / 1e6;
+        printf("bench=frame_sync frame_hz=%d events=%d delivered=%d"
+               " moves=%d coalesced=%u delivered_per_sec=%.0f"
+               " reduction=%.1fx\n",
+               hz, events, delivered, moves, unsigned(batch.coalesced()),
+               delivered / sim_s, double(events) / delivered);
+    }
+}
+
+
+// Idle/active duty cycles: touched (and dragging) for on_ms out of every
+// period_ms
+struct Duty {
+    const char *name;
+    uint32_t period_ms;
+    uint32_t on_ms;
+};
+
+static const Duty duties[] = {
+    {"reading", 10'000, 300},  // a page-turn tap every 10 sec
+    {"browsing", 3'000, 1'000}, // a swipe every 3 sec
+    {"drawing", 5'000, 4'000},  // drawing, with short pauses
+};
+
+
+// One simulated minute of duty, without INT and with bus timing on. While
+// touched, present(true) gives the controller a new frame every 10 msec;
+// present(false) is the release. Reports status reads per minute and how
+// long after a finger lands its down event's data is in hand.
+static void duty_run(const char *driver, const char *sched, const Duty &duty,
+                     Touchscreen &ts, const std::function<void(bool)> &present)
+{
+    constexpr uint64_t run_us = 60'000'000;
+    constexpr uint32_t frame_us = 10'000;
+    ts.bus_stats_reset();
+    uint64_t start_us = sim::now_us();
+    uint64_t next_frame_us = start_us;
+    bool touched = false;
+    uint64_t down_us = 0;
+    std::vector<uint32_t> latency_us;
+    while (sim::now_us() - start_us < run_us) {
+        if (sim::now_us() >= next_frame_us) {
+            uint64_t t_ms = (next_frame_us - start_us) / 1'000;
+            bool on = t_ms % duty.period_ms < duty.on_ms;
+            if (on && !touched)
+                down_us = next_frame_us;
+            if (on || touched)
+                present(on);
+            touched = on;
+            next_frame_us += frame_us;
+        }
+        Touchscreen::Event e = ts.get_event();
+        if (e.type == Touchscreen::Event::Type::down)
+            latency_us.push_back(e.time_us - uint32_t(down_us));
+        if (e.type == Touchscreen::Event::Type::none)
+            sim::advance_us(20); // nothing doing; skip ahead a little
+    }
+
+    uint64_t sum_us = 0;
+    uint32_t max_us = 0;
+    for (uint32_t us : latency_us) {
+        sum_us += us;
+        max_us = std::max(max_us, us);
+    }
+    size_t downs = latency_us.size();
+    printf("bench=poll_sched driver=%s duty=%s sched=%s"
+           " transactions_per_min=%lu bus_us_per_sec=%lu downs=%zu"
+           " down_latency_us_mean=%lu down_latency_us_max=%lu\n",
+           driver, duty.name, sched,
+           (unsigned long)ts.bus_stats().transactions,
+           (unsigned long)(ts.bus_stats().bus_us / 60), downs,
+           (unsigned long)(downs > 0 ? sum_us / downs : 0),
+           (unsigned long)max_us);
+}
+
+
+// Each driver's default schedule against polling at its minimum always
+static void gt911_poll_sched(const Duty &duty, bool adaptive)
+{
+    constexpr uint8_t addr = 0x14;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(addr);
+    Gt911 ts(i2c, addr, rst_gpio, -1);
+    ts.init();
+    if (!adaptive) {
+        uint32_t min_us = ts.poll_sched().min_us;
+        ts.set_poll_sched({min_us, min_us, 0});
+    }
+    int x = 0;
+    duty_run("gt911", adaptive ? "adaptive" : "fixed", duty, ts,
+             [&](bool on) {
+                 SimGt911::Point p{0, 20 + x++ % 280, 240, 10};
+                 dev.frame(&p, on ? 1 : 0);
+             });
+}
+
+
+static void ft6336u_poll_sched(const Duty &duty, bool adaptive)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    ts.init();
+    if (!adaptive) {
+        uint32_t min_us = ts.poll_sched().min_us;
+        ts.set_poll_sched({min_us, min_us, 0});
+    }
+    int x = 0;
+    duty_run("ft6336u", adaptive ? "adaptive" : "fixed", duty, ts,
+             [&](bool on) {
+                 SimFt6336u::Point p{0, 20 + x++ % 280, 240, 5, 1};
+                 dev.frame(&p, on ? 1 : 0);
+             });
+}
+
+
+int main()
+{
+    cpu_pin();
+    timer_calibrate();
+    for (Touchscreen::Rotation r : rotations) {
+        gt911_steps(r, 1, 1);
+        gt911_steps(r, 5, 5);
+        ft6336u_steps(r, 2, 2);
+    }
+    gt911_steps(Touchscreen::Rotation::landscape, 1, 3);
+    ft6336u_steps(Touchscreen::Rotation::landscape, 1, 2);
+    ft6336u_get_touches();
+    for (const Script &script : scripts) {
+        gt911_events(script);
+        ft6336u_events(script);
+    }
+    transform_cost(false);
+    transform_cost(true);
+    gesture_cost();
+    jitter_filter();
+    for (const Stroke &stroke : strokes) {
+        for (int horizon_ms : {8, 16, 33}) {
+            predict_run(stroke, horizon_ms, true);
+            predict_run(stroke, horizon_ms, false);
+        }
+    }
+    for (const Script &script : scripts)
+        gt911_dispatch(script);
+    gt911_dispatch_size();
+
+    for (const Trace &trace : traces) {
+        ft6336u_read_len(trace, false);
+        ft6336u_read_len(trace, true);
+    }
+    gt911_replay_speed();
+    gt911_frame_sync();
+    for (const Duty &duty : duties) {
+        gt911_poll_sched(duty, false);
+        gt911_poll_sched(duty, true);
+        ft6336u_poll_sched(duty, false);
+        ft6336u_poll_sched(duty, true);
+    }
+    return 0;
+}
@@ -0,0 +1,2096 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+// host stand-ins
+#include "i2c_dev.h"
+#include "pico/stdlib.h"
+// touchscreen
+#include "event_ring.h"
+#include "frame_batch.h"
+#include "ft6336u.h"
+#include "gesture.h"
+#include "latency_hist.h"
+#include "gt911.h"
+#include "touch_service.h"
+#include "touch_trace.h"
+#include "touchscreen.h"
+#include "touchscreen_fixed.h"
+//
+#include "frame_access.h"
+#include "sim.h"
+#include "sim_ft6336u.h"
+#include "sim_gt911.h"
+#include "trace_replay.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                            \
+    do {                                                                       \
+        if (!(cond)) {                                                         \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);    \
+            failures++;                                                        \
+        }                                                                      \
+    } while (0)
+
+static constexpr uint8_t gt911_addr = 0x14;
+static constexpr int rst_gpio = 2;
+static constexpr int int_gpio = 3;
+
+using Type = Touchscreen::Event::Type;
+
+
+// Run the event engine for us microseconds, returning the first event.
+static Touchscreen::Event run_us(Touchscreen &ts, uint32_t us)
+{
+    Touchscreen::Event first;
+    uint64_t end_us = sim::now_us() + us;
+    while (sim::now_us() < end_us) {
+        Touchscreen::Event e = ts.get_event();
+        if (first.type == Type::none)
+            first = e;
+    }
+    return first;
+}
+
+
+static void gt911_irq()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+
+    // first call after init syncs with the chip once; then nothing
+    run_us(ts, 5'000);
+    uint32_t busy = i2c.busy_cnt();
+    Touchscreen::Event e = run_us(ts, 50'000);
+    CHECK(e.type == Type::none);
+    CHECK(i2c.busy_cnt() == busy); // no bus traffic while idle
+
+    SimGt911::Point p{0, 100, 200, 10};
+    CHECK(dev.frame(&p, 1));
+    e = run_us(ts, 2'000);
+    CHECK(e.type == Type::down);
+    CHECK(e.col == 479 - 200 && e.row == 100);
+
+    p.x = 110;
+    CHECK(dev.frame(&p, 1));
+    e = run_us(ts, 2'000);
+    CHECK(e.type == Type::move);
+    CHECK(e.row == 110);
+
+    CHECK(dev.frame(nullptr, 0));
+    e = run_us(ts, 2'000);
+    CHECK(e.type == Type::up);
+    CHECK(dev.frames_dropped() == 0);
+}
+
+
+static void gt911_poll()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, -1);
+    CHECK(ts.init());
+
+    SimGt911::Point p{0, 100, 200, 10};
+    CHECK(dev.frame(&p, 1));
+    Touchscreen::Event e = run_us(ts, 3'000);
+    CHECK(e.type == Type::down);
+
+    CHECK(dev.frame(nullptr, 0));
+    e = run_us(ts, 3'000);
+    CHECK(e.type == Type::up);
+}
+
+
+// Status plus all 5 point records should come back in one 41-byte read once
+// the touch count is steady.
+static void gt911_burst()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+
+    SimGt911::Point pts[5];
+    for (int t = 0; t < 5; t++)
+        pts[t] = {t, 50 + 10 * t, 100 + 10 * t, 10};
+
+    // first frame learns the count
+    CHECK(dev.frame(pts, 5));
+    run_us(ts, 5'000);
+
+    ts.bus_stats_reset();
+    pts[0].x++;
+    CHECK(dev.frame(pts, 5));
+    run_us(ts, 5'000);
+    Touchscreen::BusStats bs = ts.bus_stats();
+    CHECK(bs.transactions == 2); // status + points, clear status
+    CHECK(bs.bytes_rd == 41);
+
+    // blocking path does the same
+    CHECK(dev.frame(pts, 5));
+    ts.bus_stats_reset();
+    int col[5], row[5];
+    CHECK(ts.get_touches(col, row, 5) == 5);
+    bs = ts.bus_stats();
+    CHECK(bs.transactions == 2);
+    CHECK(bs.bytes_rd == 41);
+    CHECK(col[4] == 479 - 140 && row[4] == 90);
+
+    // more touches than the last frame: the rest come in a second read
+    CHECK(dev.frame(pts, 2));
+    CHECK(ts.get_touches(col, row, 5) == 2);
+    CHECK(dev.frame(pts, 5));
+    ts.bus_stats_reset();
+    CHECK(ts.get_touches(col, row, 5) == 5);
+    bs = ts.bus_stats();
+    CHECK(bs.transactions == 3); // status + 2 points, 3 points, clear
+    CHECK(bs.bytes_rd == 1 + 2 * 8 + 3 * 8);
+    CHECK(col[4] == 479 - 140 && row[4] == 90);
+}
+
+
+// Collect events for us microseconds.
+static int events_us(Touchscreen &ts, uint32_t us, Touchscreen::Event ev[],
+                     int ev_max)
+{
+    int n = 0;
+    uint64_t end_us = sim::now_us() + us;
+    while (sim::now_us() < end_us) {
+        Touchscreen::Event e = ts.get_event();
+        if (e.type != Type::none && n < ev_max)
+            ev[n++] = e;
+    }
+    return n;
+}
+
+
+static bool is(const Touchscreen::Event &e, Type type, int id)
+{
+    return e.type == type && e.id == id;
+}
+
+
+// Two fingers down, one moves, first lifts, second lifts.
+static void gt911_multi()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+
+    Touchscreen::Event ev[8];
+    SimGt911::Point p[2] = {{3, 100, 100, 10}, {4, 200, 300, 10}};
+
+    CHECK(dev.frame(p, 2));
+    CHECK(events_us(ts, 5'000, ev, 8) == 2);
+    CHECK(is(ev[0], Type::down, 3) && is(ev[1], Type::down, 4));
+
+    p[1].x = 210;
+    CHECK(dev.frame(p, 2));
+    CHECK(events_us(ts, 5'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::move, 4) && ev[0].row == 210);
+
+    Touchscreen::Contact c[5];
+    CHECK(ts.get_contacts(c, 5) == 2);
+
+    CHECK(dev.frame(&p[1], 1));
+    CHECK(events_us(ts, 5'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::up, 3) && ev[0].row == 100);
+
+    CHECK(dev.frame(nullptr, 0));
+    CHECK(events_us(ts, 5'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::up, 4));
+    CHECK(ts.get_contacts(c, 5) == 0);
+}
+
+
+static void ft6336u_multi()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    CHECK(dev.booted());
+
+    Touchscreen::Event ev[8];
+    SimFt6336u::Point p[2] = {{0, 10, 20, 5, 1}, {1, 30, 40, 5, 1}};
+
+    dev.frame(p, 2);
+    CHECK(events_us(ts, 30'000, ev, 8) == 2);
+    CHECK(is(ev[0], Type::down, 0) && is(ev[1], Type::down, 1));
+
+    dev.frame(&p[1], 1);
+    CHECK(events_us(ts, 30'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::up, 0));
+
+    dev.frame(nullptr, 0);
+    CHECK(events_us(ts, 30'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::up, 1));
+}
+
+
+// Size, weight and area from the point records, through get_touches(),
+// events and get_contacts(), with no more bus traffic than positions only.
+static void contact_records()
+{
+    static_assert(64 / sizeof(Touchscreen::Contact) >=
+                  Touchscreen::contact_max);
+    Touchscreen::Contact c[5];
+    Touchscreen::Event ev[8];
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio);
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+        SimGt911::Point p[2] = {{3, 100, 200, 12}, {7, 150, 250, 700}};
+        dev.frame(p, 2);
+        CHECK(events_us(ts, 5'000, ev, 8) == 2);
+        CHECK(is(ev[0], Type::down, 3) && ev[0].size == 12);
+        CHECK(is(ev[1], Type::down, 7) && ev[1].size == 700);
+        CHECK(ts.get_contacts(c, 5) == 2);
+        CHECK(c[1].id == 7 && c[1].size == 700 && c[1].area == 0);
+        CHECK(c[1].flag == Touchscreen::Contact::contact);
+
+        // a fresh frame for each, since reading one clears the status
+        int col[2], row[2];
+        dev.frame(p, 2);
+        uint32_t tr = ts.bus_stats().transactions;
+        CHECK(ts.get_touches(col, row, 2) == 2);
+        uint32_t tr_pos = ts.bus_stats().transactions - tr;
+        dev.frame(p, 2);
+        tr = ts.bus_stats().transactions;
+        CHECK(ts.get_touches(c, 2) == 2);
+        CHECK(ts.bus_stats().transactions - tr == tr_pos);
+        CHECK(c[0].id == 3 && c[0].size == 12);
+        CHECK(c[0].col == col[0] && c[0].row == row[0]);
+        CHECK(c[1].id == 7 && c[1].size == 700);
+    }
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimFt6336u dev(rst_gpio, int_gpio);
+        Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        SimFt6336u::Point p[2] = {{0, 10, 20, 40, 3}, {1, 30, 40, 90, 9}};
+        dev.frame(p, 2);
+        CHECK(events_us(ts, 30'000, ev, 8) == 2);
+        CHECK(is(ev[0], Type::down, 0) && ev[0].size == 40 && ev[0].area == 3);
+        CHECK(is(ev[1], Type::down, 1) && ev[1].size == 90 && ev[1].area == 9);
+        p[1].weight = 120;
+        p[1].x = 35;
+        dev.frame(p, 2);
+        CHECK(events_us(ts, 30'000, ev, 8) == 1);
+        CHECK(is(ev[0], Type::move, 1) && ev[0].size == 120);
+
+        int col[2], row[2];
+        uint32_t tr = ts.bus_stats().transactions;
+        CHECK(ts.get_touches(col, row, 2) == 2);
+        uint32_t tr_pos = ts.bus_stats().transactions - tr;
+        tr = ts.bus_stats().transactions;
+        CHECK(ts.get_touches(c, 2) == 2);
+        CHECK(ts.bus_stats().transactions - tr == tr_pos);
+        CHECK(c[0].id == 0 && c[0].size == 40 && c[0].area == 3);
+        CHECK(c[0].flag == Touchscreen::Contact::contact);
+        CHECK(c[1].col == col[1] && c[1].row == row[1]);
+        CHECK(c[1].size == 120 && c[1].area == 9);
+    }
+}
+
+
+// get_event() never waits on the bus: each call takes only the simulated
+// time of a busy() check and a few clock reads, however long the transfers
+// are.
+static void ft6336u_never_blocks()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 100'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    CHECK(ts.init());
+
+    SimFt6336u::Point p[2] = {{0, 10, 20, 5, 1}, {1, 30, 40, 5, 1}};
+    dev.frame(p, 2);
+
+    ts.bus_stats_reset();
+    uint64_t max_us = 0;
+    int events = 0;
+    for (int i = 0; i < 20'000; i++) {
+        uint64_t start_us = sim::now_us();
+        if (ts.get_event().type != Type::none)
+            events++;
+        uint64_t call_us = sim::now_us() - start_us;
+        if (call_us > max_us)
+            max_us = call_us;
+    }
+    CHECK(events == 2);
+    CHECK(max_us <= 4);
+    CHECK(i2c.busy_cnt() > 0);
+
+    // steady two touches: TD_STATUS and both points in one read per poll
+    ts.bus_stats_reset();
+    run_us(ts, 10'000);
+    CHECK(ts.bus_stats().transactions == 1);
+    CHECK(ts.bus_stats().bytes_rd == 13);
+}
+
+
+// Drive init_poll() from a "main loop" that also does 100 usec of other work
+// per pass. Returns how long init took; max_poll_us is the longest any one
+// init_poll() call took.
+template <typename TS>
+static uint64_t init_loop(TS &ts, uint64_t &max_poll_us)
+{
+    uint64_t start_us = sim::now_us();
+    max_poll_us = 0;
+    ts.init_start();
+    while (true) {
+        uint64_t poll_us = sim::now_us();
+        bool done = ts.init_poll();
+        poll_us = sim::now_us() - poll_us;
+        if (poll_us > max_poll_us)
+            max_poll_us = poll_us;
+        if (done)
+            break;
+        sim::advance_us(100); // drawing the first frame, etc.
+    }
+    return sim::now_us() - start_us;
+}
+
+
+static void gt911_init_incremental()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(!ts.init_poll() && !ts.ready()); // no init_start() yet
+    uint64_t max_poll_us;
+    uint64_t init_us = init_loop(ts, max_poll_us);
+    CHECK(ts.ready());
+    CHECK(max_poll_us <= 5);
+    CHECK(init_us >= 55'200 && init_us < 57'000);
+
+    // wrong vendor ID fails
+    dev.reg(0x8140, '8');
+    init_loop(ts, max_poll_us);
+    CHECK(!ts.ready());
+}
+
+
+static void ft6336u_init_incremental()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    CHECK(!ts.init_poll() && !ts.ready()); // no init_start() yet
+    uint64_t max_poll_us;
+    uint64_t init_us = init_loop(ts, max_poll_us);
+    CHECK(ts.ready());
+    CHECK(max_poll_us <= 5);
+    CHECK(init_us >= 730'000 && init_us < 734'000);
+
+    // no INT high: fails after a second
+    sim::reset();
+    SimFt6336u dead(rst_gpio, -1);
+    Ft6336u ts2(i2c, 21, 20, rst_gpio, int_gpio);
+    init_us = init_loop(ts2, max_poll_us);
+    CHECK(!ts2.ready());
+    CHECK(init_us >= 1'007'000 && init_us < 1'009'000);
+}
+
+
+// Producer and consumer threads hammer a ring. Events carry a sequence
+// number per contact in col; whatever the consumer sees must be in order per
+// contact, and received + dropped + coalesced must account for everything.
+// With backoff, the producer waits for room (yielding) instead of
+// overflowing, and nothing may be lost.
+static void event_ring_threads(EventRingOverflow overflow, bool backoff)
+{
+    using Event = Touchscreen::Event;
+    using Ring = EventRing<Event, 32, 5>;
+    auto ring_ptr = std::make_unique<Ring>();
+    Ring &ring = *ring_ptr;
+    ring.set_overflow(overflow);
+
+    constexpr int event_cnt = 1'000'000;
+    std::atomic<bool> done(false);
+
+    std::thread producer([&]() {
+        for (int i = 0; i < event_cnt; i++) {
+            while (backoff && ring.size() == ring.capacity())
+                std::this_thread::yield();
+            Type type = (i % 100) == 0 ? Type::down : Type::move;
+            ring.push(Event(type, i, 0, i % 3));
+        }
+        done = true;
+    });
+
+    int received = 0;
+    int last[3] = {-1, -1, -1};
+    bool in_order = true;
+    Event ev[16];
+    while (true) {
+        bool was_done = done;
+        int n = ring.pop(ev, 16);
+        for (int i = 0; i < n; i++) {
+            if (ev[i].col <= last[ev[i].id])
+                in_order = false;
+            last[ev[i].id] = ev[i].col;
+        }
+        received += n;
+        if (n == 0) {
+            if (was_done)
+                break;
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+
+    // anything still held by coalesce_moves
+    ring.flush();
+    received += ring.pop(ev, 16);
+
+    CHECK(in_order);
+    CHECK(uint32_t(received) + ring.dropped() + ring.coalesced() ==
+          uint32_t(event_cnt));
+    if (backoff)
+        CHECK(received == event_cnt);
+}
+
+
+// Polling an idle GT911 is one status read (2-byte register address, 1 byte
+// back: 49 bits) per msec. Injected failures land in the right counters, and
+// the driver carries on afterwards.
+static void gt911_bus_stats()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, -1);
+    CHECK(ts.init());
+    CHECK(ts.bus_stats().errors() == 0);
+
+    ts.bus_stats_reset();
+    run_us(ts, 10'000);
+    Touchscreen::BusStats bs = ts.bus_stats();
+    CHECK(bs.transactions >= 9 && bs.transactions <= 11);
+    CHECK(bs.bytes_wr == 2 * bs.transactions);
+    CHECK(bs.bytes_rd == bs.transactions);
+    CHECK(bs.bits == 49 * bs.transactions);
+    CHECK(bs.bus_us == (bs.bits * 1'000'000 + 399'999) / 400'000);
+    CHECK(bs.errors() == 0);
+
+    ts.bus_stats_reset();
+    i2c.inject(PICO_ERROR_GENERIC);
+    run_us(ts, 2'000);
+    i2c.inject(PICO_ERROR_TIMEOUT);
+    run_us(ts, 2'000);
+    i2c.inject(0); // nothing read
+    run_us(ts, 2'000);
+    bs = ts.bus_stats();
+    CHECK(bs.nacks == 1);
+    CHECK(bs.timeouts == 1);
+    CHECK(bs.mismatches == 1);
+    CHECK(bs.errors() == 3);
+
+    SimGt911::Point p{0, 100, 200, 10};
+    CHECK(dev.frame(&p, 1));
+    CHECK(run_us(ts, 3'000).type == Type::down);
+
+    // sync reads count too
+    ts.bus_stats_reset();
+    i2c.inject(PICO_ERROR_TIMEOUT);
+    int col, row;
+    CHECK(ts.get_touches(&col, &row, 1) < 0);
+    CHECK(ts.bus_stats().timeouts == 1);
+}
+
+
+// Config edits go back with a checksum the chip accepts, and a change of INT
+// mode is followed.
+static void gt911_config()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+
+    Gt911::Config cfg;
+    CHECK(ts.config_read(cfg));
+    CHECK(cfg.version() == 0x41);
+    CHECK(cfg.touch_max() == 5);
+    CHECK(cfg.int_mode() == Gt911::Config::IntMode::falling);
+    CHECK(!cfg.x2y() && !cfg.x2x() && cfg.y2y());
+    CHECK(cfg.touch_thresh() == 0x3c && cfg.leave_thresh() == 0x28);
+    CHECK(cfg.report_ms() == 10);
+
+    cfg.set_report_ms(5);
+    cfg.set_touch_thresh(50);
+    cfg.set_leave_thresh(30);
+    cfg.set_touch_max(2);
+    cfg.set_int_mode(Gt911::Config::IntMode::rising);
+    ts.bus_stats_reset();
+    CHECK(ts.config_write(cfg));
+    CHECK(ts.bus_stats().bytes_wr == 2 + Gt911::Config::len + 2);
+    CHECK(dev.config_loads() == 1 && dev.config_rejects() == 0);
+    CHECK(dev.reg(0x8056) == 0x00);
+    CHECK(dev.reg(0x8100) == 0);
+
+    Gt911::Config back;
+    CHECK(ts.config_read(back));
+    CHECK(memcmp(back.regs, cfg.regs, Gt911::Config::len) == 0);
+    CHECK(back.report_ms() == 5 && back.touch_max() == 2);
+
+    // INT now rises; the engine has to follow
+    SimGt911::Point p{0, 100, 200, 10};
+    CHECK(dev.frame(&p, 1));
+    CHECK(run_us(ts, 2'000).type == Type::down);
+
+    // not while a frame is in flight
+    CHECK(dev.frame(nullptr, 0));
+    ts.get_event();
+    CHECK(!ts.config_read(back));
+    CHECK(!ts.config_write(cfg));
+    CHECK(run_us(ts, 2'000).type == Type::up);
+
+    // the chip keeps its config if the checksum is wrong...
+    const uint8_t rate[] = {0x80, 0x56, 0x0f};
+    const uint8_t fresh[] = {0x81, 0x00, 0x01};
+    dev.write(rate, sizeof(rate));
+    dev.write(fresh, sizeof(fresh));
+    CHECK(dev.config_rejects() == 1);
+    CHECK(ts.config_read(back));
+    CHECK(back.report_ms() == 5);
+
+    // ...or the version goes backwards
+    cfg.regs[Gt911::Config::VERSION]--;
+    cfg.set_report_ms(20);
+    CHECK(ts.config_write(cfg));
+    CHECK(dev.config_rejects() == 2 && dev.config_loads() == 1);
+    CHECK(ts.config_read(back));
+    CHECK(back.report_ms() == 5);
+}
+
+
+// Profiles land in the tuning registers, and INT trigger mode replaces
+// polling.
+static void ft6336u_tuning()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+    CHECK(ts.init());
+
+    Ft6336u::Tuning t;
+    CHECK(ts.tuning_read(t));
+    CHECK(t.touch_thresh == 0x0f && t.filter_coef == 0xa0);
+    CHECK(t.monitor_auto && t.monitor_wait_s == 30);
+    CHECK(t.period_active == 10 && t.period_monitor == 40);
+
+    CHECK(ts.set_profile(Ft6336u::Profile::low_latency));
+    CHECK(dev.reg(0x86) == 0 && dev.reg(0x88) == 3 && dev.reg(0xa4) == 1);
+    CHECK(dev.reg(0x80) == 0x0f); // thresholds left alone
+
+    // no polling while nothing happens
+    run_us(ts, 5'000);
+    ts.bus_stats_reset();
+    run_us(ts, 50'000);
+    CHECK(ts.bus_stats().transactions == 0);
+
+    Touchscreen::Event ev[8];
+    SimFt6336u::Point p = {0, 10, 20, 5, 1};
+    dev.frame(&p, 1);
+    CHECK(events_us(ts, 1'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::down, 0));
+    dev.frame(nullptr, 0);
+    CHECK(events_us(ts, 1'000, ev, 8) == 1);
+    CHECK(is(ev[0], Type::up, 0));
+
+    CHECK(ts.set_profile(Ft6336u::Profile::low_power));
+    CHECK(dev.reg(0x86) == 1 && dev.reg(0x87) == 2 && dev.reg(0x88) == 14);
+
+    // back to polling, at the new period
+    CHECK(ts.tuning_read(t));
+    t.int_trigger = false;
+    t.touch_thresh = 0x20;
+    CHECK(ts.tuning_write(t));
+    CHECK(dev.reg(0x80) == 0x20 && dev.reg(0xa4) == 0);
+    run_us(ts, 5'000);
+    ts.bus_stats_reset();
+    run_us(ts, 140'000);
+    CHECK(ts.bus_stats().transactions == 10);
+
+    // not while a read is in flight
+    while (ts.bus_stats().transactions == 10)
+        ts.get_event();
+    CHECK(!ts.tuning_read(t));
+    CHECK(!ts.tuning_write(t));
+    run_us(ts, 1'000);
+
+    // a report period out of range is refused, without touching the chip
+    Ft6336u::Tuning bad = t;
+    for (uint8_t period : {uint8_t(0), uint8_t(2), uint8_t(15)}) {
+        bad.period_active = period;
+        ts.bus_stats_reset();
+        CHECK(!ts.tuning_write(bad));
+        CHECK(ts.bus_stats().transactions == 0);
+    }
+    CHECK(dev.reg(0x88) == 14 && ts.poll_sched().min_us == 14'000);
+
+    // a failed write is reported
+    i2c.inject(PICO_ERROR_GENERIC);
+    CHECK(!ts.set_profile(Ft6336u::Profile::balanced));
+    CHECK(ts.set_profile(Ft6336u::Profile::balanced));
+    CHECK(dev.reg(0x88) == 10 && dev.reg(0x89) == 40);
+}
+
+
+// Polling backs off while idle and snaps back to fast on a touch.
+static void gt911_poll_sched()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, -1);
+    CHECK(ts.init());
+    ts.set_poll_sched({1'000, 8'000, 100'000});
+
+    // 1, 2, 4, 8, 8, ... msec: 100 + 50 + 25 + 12.5 + 12.5 polls
+    CHECK(ts.poll_interval_us() == 1'000);
+    ts.bus_stats_reset();
+    run_us(ts, 500'000);
+    uint32_t polls = ts.bus_stats().transactions;
+    CHECK(polls >= 195 && polls <= 205);
+    CHECK(ts.poll_interval_us() == 8'000);
+
+    // the touch is seen within one slow interval, then polling is fast
+    SimGt911::Point p{0, 100, 200, 10};
+    CHECK(dev.frame(&p, 1));
+    uint64_t t0_us = sim::now_us();
+    Touchscreen::Event e;
+    while ((e = ts.get_event()).type == Type::none)
+        ;
+    CHECK(e.type == Type::down);
+    CHECK(sim::now_us() - t0_us <= 8'000 + 1'000);
+    CHECK(ts.poll_interval_us() == 1'000);
+
+    // held down: stays fast
+    for (int f = 0; f < 20; f++) {
+        run_us(ts, 10'000);
+        p.x++;
+        dev.frame(&p, 1);
+    }
+    CHECK(ts.poll_interval_us() == 1'000);
+
+    // lifted: fast for idle_us after the last touched frame, then one step
+    run_us(ts, 10'000);
+    CHECK(dev.frame(nullptr, 0));
+    CHECK(run_us(ts, 5'000).type == Type::up);
+    run_us(ts, 70'000);
+    CHECK(ts.poll_interval_us() == 1'000);
+    run_us(ts, 20'000);
+    CHECK(ts.poll_interval_us() == 2'000);
+
+    // no back-off
+    ts.set_poll_sched({1'000, 1'000, 0});
+    run_us(ts, 1'000'000);
+    CHECK(ts.poll_interval_us() == 1'000);
+}
+
+
+// Touch at (x, y) and lift; returns the down event.
+static Touchscreen::Event gt911_tap(Gt911 &ts, SimGt911 &dev, int x, int y)
+{
+    SimGt911::Point p{0, x, y, 10};
+    dev.frame(&p, 1);
+    Touchscreen::Event e = run_us(ts, 2'000);
+    dev.frame(nullptr, 0);
+    run_us(ts, 2'000);
+    return e;
+}
+
+
+static bool at(const Touchscreen::Event &e, int col, int row)
+{
+    return e.type == Type::down && e.col == col && e.row == row;
+}
+
+
+// Controller (x, y) to (col, row) for each rotation, panel orientation and
+// scale, and following a change of SWITCH_1.
+static void transform()
+{
+    using Rotation = Touchscreen::Rotation;
+    {
+        // 320x480 portrait panel on a 480x320 display
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio);
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+        CHECK(ts.get_panel().x_res == 320 && ts.get_panel().y_res == 480);
+
+        CHECK(at(gt911_tap(ts, dev, 100, 200), 279, 100));
+        CHECK(at(gt911_tap(ts, dev, 0, 0), 479, 0));
+        CHECK(at(gt911_tap(ts, dev, 319, 479), 0, 319));
+        ts.set_rotation(Rotation::portrait);
+        CHECK(at(gt911_tap(ts, dev, 100, 200), 100, 200));
+        ts.set_rotation(Rotation::landscape2);
+        CHECK(at(gt911_tap(ts, dev, 100, 200), 200, 219));
+        ts.set_rotation(Rotation::portrait2);
+        CHECK(at(gt911_tap(ts, dev, 100, 200), 219, 279));
+        ts.set_rotation(Rotation::landscape);
+
+        // out of range is clamped
+        CHECK(at(gt911_tap(ts, dev, 400, 600), 0, 319));
+
+        // Setting x2y makes the chip swap before it reverses y, so the same
+        // spot now reads (279, 319 - 100).
+        Gt911::Config cfg;
+        CHECK(ts.config_read(cfg));
+        cfg.set_x2y(true);
+        CHECK(ts.config_write(cfg));
+        const Touchscreen::Panel &panel = ts.get_panel();
+        CHECK(panel.x_res == 480 && panel.y_res == 320);
+        CHECK(panel.swap_xy && panel.mirror_x && panel.mirror_y);
+        CHECK(at(gt911_tap(ts, dev, 279, 219), 279, 100));
+
+        // x2x reverses what is now x
+        cfg.set_x2x(true);
+        CHECK(ts.config_write(cfg));
+        CHECK(at(gt911_tap(ts, dev, 479 - 279, 219), 279, 100));
+
+        // and back
+        cfg.set_x2y(false);
+        cfg.set_x2x(false);
+        CHECK(ts.config_write(cfg));
+        CHECK(!panel.swap_xy && !panel.mirror_x && !panel.mirror_y);
+        CHECK(at(gt911_tap(ts, dev, 100, 200), 279, 100));
+    }
+    {
+        // 800x480 landscape panel on an 800x480 display
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio, 800, 480);
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio, 800, 480);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+
+        CHECK(at(gt911_tap(ts, dev, 700, 50), 700, 50));
+        CHECK(at(gt911_tap(ts, dev, 799, 479), 799, 479));
+        ts.set_rotation(Rotation::portrait);
+        CHECK(at(gt911_tap(ts, dev, 700, 50), 50, 99));
+    }
+    {
+        // 320x480 panel scaled up to a 960x640 display
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio);
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio, 960, 640);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+
+        CHECK(at(gt911_tap(ts, dev, 0, 0), 959, 0));
+        CHECK(at(gt911_tap(ts, dev, 319, 479), 0, 639));
+        CHECK(at(gt911_tap(ts, dev, 100, 300), 358, 200));
+    }
+    {
+        // FT6336U: no resolution register, so the panel is the display
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimFt6336u dev(rst_gpio, int_gpio);
+        Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+        CHECK(ts.init());
+
+        Touchscreen::Event ev[2];
+        SimFt6336u::Point p{0, 10, 20, 5, 1};
+        const int want[][2] = {{459, 10}, {10, 20}, {20, 309}, {309, 459}};
+        const Rotation rots[] = {Rotation::landscape, Rotation::portrait,
+                                 Rotation::landscape2, Rotation::portrait2};
+        for (int r = 0; r < 4; r++) {
+            ts.set_rotation(rots[r]);
+            dev.frame(&p, 1);
+            CHECK(events_us(ts, 30'000, ev, 2) == 1);
+            CHECK(at(ev[0], want[r][0], want[r][1]));
+            dev.frame(nullptr, 0);
+            CHECK(events_us(ts, 30'000, ev, 2) == 1);
+        }
+    }
+}
+
+
+struct EventLog {
+    std::vector<Touchscreen::Event> events;
+
+    void add(const Touchscreen::Event &e)
+    {
+        events.push_back(e);
+    }
+
+    bool operator==(const EventLog &other) const
+    {
+        if (events.size() != other.events.size())
+            return false;
+        for (size_t i = 0; i < events.size(); i++) {
+            const Touchscreen::Event &a = events[i];
+            const Touchscreen::Event &b = other.events[i];
+            if (a.type != b.type || a.id != b.id || a.col != b.col ||
+                a.row != b.row)
+                return false;
+        }
+        return true;
+    }
+};
+
+
+// Run ts over a scripted session: a two-finger swipe where the second
+// finger lifts first, then a tap, f frames 10 msec apart.
+template <typename Point>
+static Point point(int id, int x, int y)
+{
+    Point p{};
+    p.id = id;
+    p.x = x;
+    p.y = y;
+    return p;
+}
+
+
+template <typename Dev, typename Point>
+static void touch_script(Touchscreen &ts, Dev &dev, EventLog &log)
+{
+    Touchscreen::Event ev[8];
+    for (int f = 0; f < 40; f++) {
+        Point p[2] = {point<Point>(0, 50 + 4 * f, 100),
+                      point<Point>(1, 150, 100 + 3 * f)};
+        int n = f < 30 ? 2 : 1;
+        if (f >= 35)
+            n = 0;
+        dev.frame(p, n);
+        int cnt = events_us(ts, 10'000, ev, 8);
+        for (int e = 0; e < cnt; e++)
+            log.add(ev[e]);
+    }
+    Point tap[1] = {point<Point>(2, 160, 240)};
+    dev.frame(tap, 1);
+    int cnt = events_us(ts, 10'000, ev, 8);
+    dev.frame(tap, 0);
+    cnt += events_us(ts, 10'000, ev + cnt, 8 - cnt);
+    for (int e = 0; e < cnt; e++)
+        log.add(ev[e]);
+}
+
+
+// Capture trace.stream() output in a temporary file.
+static FILE *stream_to_file(TouchTrace &trace, int &recs)
+{
+    FILE *f = tmpfile();
+    fflush(stdout);
+    int saved = dup(1);
+    dup2(fileno(f), 1);
+    recs = trace.stream();
+    fflush(stdout);
+    dup2(saved, 1);
+    close(saved);
+    rewind(f);
+    return f;
+}
+
+
+// Record a GT911 session with INT, stream it out as hex, replay it into a
+// fresh driver: the same events come out, and replay is deterministic.
+static void gt911_trace_replay()
+{
+    static uint8_t trace_buf[32 * 1024];
+    EventLog recorded;
+    FILE *f;
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio);
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+
+        TouchTrace trace(trace_buf, sizeof(trace_buf));
+        ts.set_trace(&trace);
+        trace.start();
+        touch_script<SimGt911, SimGt911::Point>(ts, dev, recorded);
+        trace.stop();
+        CHECK(trace.dropped() == 0);
+        int recs;
+        f = stream_to_file(trace, recs);
+        CHECK(recs > 40 * 3); // INT, status+points read, clear per frame
+        CHECK(trace.size() == 0);
+    }
+    CHECK(recorded.events.size() == 69);
+
+    EventLog replayed[2];
+    for (EventLog &log : replayed) {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio); // for init
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+
+        TraceReplay replay(gt911_addr, 2, int_gpio);
+        rewind(f);
+        CHECK(replay.load_hex(f));
+        replay.start();
+        uint64_t start_us = sim::now_us();
+        replay.run(ts, i2c, [&](const Touchscreen::Event &e) { log.add(e); });
+        CHECK(replay.done());
+        CHECK(replay.unknown_reads() == 0);
+        CHECK(sim::now_us() - start_us < 600'000);
+    }
+    fclose(f);
+    CHECK(replayed[0] == recorded);
+    CHECK(replayed[1] == recorded);
+}
+
+
+// Same with the FT6336U, polled, using the raw records instead of hex.
+static void ft6336u_trace_replay()
+{
+    static uint8_t trace_buf[32 * 1024];
+    static uint8_t raw[32 * 1024];
+    int raw_len;
+    EventLog recorded;
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimFt6336u dev(rst_gpio, int_gpio);
+        Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 20'000);
+
+        TouchTrace trace(trace_buf, sizeof(trace_buf));
+        ts.set_trace(&trace);
+        trace.start();
+        touch_script<SimFt6336u, SimFt6336u::Point>(ts, dev, recorded);
+        raw_len = trace.take(raw, sizeof(raw));
+        CHECK(raw_len > 0 && trace.size() == 0);
+    }
+
+    EventLog replayed;
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimFt6336u dev(rst_gpio, int_gpio);
+        Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 20'000);
+
+        TraceReplay replay(SimFt6336u::addr, 1);
+        CHECK(replay.load(raw, raw_len));
+        replay.start();
+        replay.run(ts, i2c,
+                   [&](const Touchscreen::Event &e) { replayed.add(e); });
+        CHECK(replay.unknown_reads() == 0);
+    }
+    CHECK(recorded.events.size() == 69);
+    CHECK(replayed == recorded);
+}
+
+
+// The GT911 config block is the longest transfer; its records are whole, so
+// a replayed driver reads back the config the recorded one wrote.
+static void gt911_config_trace()
+{
+    static uint8_t trace_buf[4 * 1024];
+    Gt911::Config cfg;
+    FILE *f;
+    {
+        sim::reset();
+        I2cDev i2c(i2c0, 21, 20, 400'000);
+        SimGt911 dev(gt911_addr, int_gpio);
+        Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+        CHECK(ts.init());
+        run_us(ts, 5'000);
+
+        TouchTrace trace(trace_buf, sizeof(trace_buf));
+        ts.set_trace(&trace);
+        trace.start();
+        CHECK(ts.config_read(cfg));
+        cfg.set_touch_thresh(50);
+        CHECK(ts.config_write(cfg));
+        CHECK(ts.config_read(cfg));
+        trace.stop();
+        int recs;
+        f = stream_to_file(trace, recs);
+        CHECK(recs == 3);
+    }
+
+    // one write of register, block, checksum and fresh flag, and two reads
+    // of block and checksum
+    char line[2 * TouchTrace::rec_max + 16];
+    uint8_t rec_buf[TouchTrace::rec_max];
+    int writes = 0, reads = 0;
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        TouchTrace::Record rec;
+        int len = TouchTrace::unhex(line, rec_buf, sizeof(rec_buf));
+        CHECK(len > 0 && TouchTrace::parse(rec_buf, len, rec) == len);
+        if (rec.wr_len == 2 + Gt911::Config::len + 2)
+            writes++;
+        if (rec.rd_len == Gt911::Config::len + 1)
+            reads++;
+    }
+    CHECK(writes == 1 && reads == 2);
+
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio); // for init
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+
+    TraceReplay replay(gt911_addr, 2, int_gpio);
+    rewind(f);
+    CHECK(replay.load_hex(f));
+    fclose(f);
+    replay.start();
+    replay.run(ts, i2c);
+    Gt911::Config back;
+    CHECK(ts.config_read(back));
+    CHECK(memcmp(back.regs, cfg.regs, Gt911::Config::len) == 0);
+    CHECK(back.touch_thresh() == 50);
+    CHECK(replay.unknown_reads() == 0);
+}
+
+
+// The panel is off against the display by a skew, scale and offset; a
+// 3- or 5-point calibration brings every point back to within a pixel, in
+// any rotation, and survives a save and load.
+static void calibration()
+{
+    using Rotation = Touchscreen::Rotation;
+    using CalPoint = Touchscreen::CalPoint;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+
+    // Touch portrait (u, v) on the 320x480 display and read it back in the
+    // current rotation. The panel reads that spot as skewed.
+    auto touch = [&](int u, int v, CalPoint &got) {
+        SimGt911::Point p{0, int(lround(1.04 * u + 0.03 * v - 9)),
+                          int(lround(-0.02 * u + 0.96 * v + 6)), 10};
+        dev.frame(&p, 1);
+        return ts.get_touch(got.col, got.row) == 1;
+    };
+    // portrait (u, v) <-> (col, row)
+    auto rotate = [&](int u, int v) -> CalPoint {
+        if (ts.get_rotation() == Rotation::landscape)
+            return {479 - v, u};
+        return {u, v};
+    };
+    auto unrotate = [&](const CalPoint &p, int &u, int &v) {
+        u = p.col;
+        v = p.row;
+        if (ts.get_rotation() == Rotation::landscape) {
+            u = p.row;
+            v = 479 - p.col;
+        }
+    };
+    // worst error over a grid
+    auto err_max = [&]() {
+        int err = 0;
+        for (int u = 20; u < 320; u += 40) {
+            for (int v = 20; v < 480; v += 40) {
+                CalPoint got;
+                if (!touch(u, v, got))
+                    return 1'000;
+                CalPoint want = rotate(u, v);
+                err = std::max(err, abs(got.col - want.col));
+                err = std::max(err, abs(got.row - want.row));
+            }
+        }
+        return err;
+    };
+    // capture n targets, with noise of +/- noise pixels, and solve
+    auto calibrate = [&](int n, int noise) {
+        CalPoint targets[5], touches[5];
+        ts.calibration_targets(targets, n);
+        for (int i = 0; i < n; i++) {
+            int u, v;
+            unrotate(targets[i], u, v);
+            if (!touch(u, v, touches[i]))
+                return false;
+            touches[i].col += (i & 1) ? noise : -noise;
+            touches[i].row += (i & 2) ? noise : -noise;
+        }
+        return ts.calibration_solve(targets, touches, n);
+    };
+
+    ts.set_rotation(Rotation::portrait);
+    CHECK(err_max() > 8);
+    CHECK(calibrate(3, 0));
+    CHECK(err_max() <= 1);
+
+    // 5 points, in another rotation
+    ts.calibration_clear();
+    ts.set_rotation(Rotation::landscape);
+    CHECK(calibrate(5, 0));
+    CHECK(err_max() <= 1);
+    ts.set_rotation(Rotation::portrait);
+    CHECK(err_max() <= 1);
+
+    // a pixel of noise on every touch costs at most another pixel
+    ts.calibration_clear();
+    CHECK(calibrate(5, 1));
+    CHECK(err_max() <= 2);
+
+    // again on top of a calibration already in place
+    CHECK(calibrate(5, 0));
+    CHECK(err_max() <= 1);
+
+    uint8_t blob[Touchscreen::Calibration::blob_len];
+    ts.get_calibration().save(blob);
+    ts.calibration_clear();
+    CHECK(err_max() > 8);
+    Touchscreen::Calibration cal;
+    CHECK(cal.load(blob));
+    ts.set_calibration(cal);
+    CHECK(err_max() <= 1);
+    blob[5] ^= 0x10;
+    CHECK(!cal.load(blob));
+
+    // points in a line do not calibrate
+    const CalPoint line[3] = {{10, 10}, {100, 100}, {200, 201}};
+    CHECK(!ts.calibration_solve(line, line, 3));
+    CHECK(!ts.calibration_solve(line, line, 2));
+}
+
+
+// The panel bunches up toward its edges by up to 6 pixels across and 8
+// down; learning the grid at every node takes that out.
+static void grid()
+{
+    using Rotation = Touchscreen::Rotation;
+    using CalPoint = Touchscreen::CalPoint;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+
+    // touch portrait (u, v) and read it back in the current rotation
+    auto touch = [&](int u, int v, CalPoint &got) {
+        double du = (u - 159.5) / 159.5;
+        double dv = (v - 239.5) / 239.5;
+        SimGt911::Point p{0, int(lround(u - 6 * du * du * du)),
+                          int(lround(v - 8 * dv * dv * dv)), 10};
+        dev.frame(&p, 1);
+        return ts.get_touch(got.col, got.row) == 1;
+    };
+    auto err_max = [&](int step) {
+        int err = 0;
+        for (int u = 0; u < 320; u += step) {
+            for (int v = 0; v < 480; v += step) {
+                CalPoint got, want;
+                if (!touch(u, v, got))
+                    return 1'000;
+                if (ts.get_rotation() == Rotation::landscape)
+                    want = {479 - v, u};
+                else
+                    want = {u, v};
+                err = std::max(err, abs(got.col - want.col));
+                err = std::max(err, abs(got.row - want.row));
+            }
+        }
+        return err;
+    };
+
+    CHECK(!ts.grid_on());
+    CHECK(err_max(20) >= 6);
+
+    CalPoint targets[Touchscreen::grid_cnt];
+    CHECK(ts.grid_targets(targets) == Touchscreen::grid_cnt);
+    CHECK(targets[0].col == 479 && targets[0].row == 0);
+    for (const CalPoint &target : targets) {
+        int u = target.row;
+        int v = 479 - target.col;
+        CalPoint got;
+        CHECK(touch(u, v, got));
+        ts.grid_learn(target, got);
+    }
+    CHECK(ts.grid_on());
+    CHECK(ts.get_grid().off[0][0][0] == -6 && ts.get_grid().off[0][0][1] == -8);
+    CHECK(err_max(20) <= 1);
+    ts.set_rotation(Rotation::portrait);
+    CHECK(err_max(20) <= 1);
+
+    // saved and restored
+    Touchscreen::Grid saved = ts.get_grid();
+    ts.grid_clear();
+    CHECK(!ts.grid_on());
+    CHECK(err_max(20) >= 6);
+    ts.set_grid(saved);
+    CHECK(err_max(20) <= 1);
+}
+
+
+// One frame every 10 msec; returns the move count.
+static int gt911_frame_moves(Gt911 &ts, SimGt911 &dev, int x, int y,
+                             Touchscreen::Event *last = nullptr)
+{
+    SimGt911::Point p{0, x, y, 10};
+    dev.frame(&p, 1);
+    Touchscreen::Event ev[4];
+    int n = events_us(ts, 10'000, ev, 4);
+    int moves = 0;
+    for (int i = 0; i < n; i++) {
+        if (ev[i].type == Type::move)
+            moves++;
+        if (last != nullptr)
+            *last = ev[i];
+    }
+    return moves;
+}
+
+
+// A resting finger with a pixel of noise, then a fast stroke, with the
+// jitter filter off and on.
+static void jitter_filter()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    ts.set_rotation(Touchscreen::Rotation::portrait); // (col, row) = (x, y)
+    CHECK(!ts.jitter_filter_on());
+
+    static const int noise[] = {0, 1, -1, 1, 0, -1, -1, 1, 0, 1};
+    for (bool on : {false, true}) {
+        if (on)
+            ts.set_jitter_filter(Touchscreen::JitterFilter());
+        Touchscreen::Event e;
+        gt911_frame_moves(ts, dev, 161, 239, &e);
+        CHECK(at(e, 161, 239)); // downs are not filtered
+        int moves = 0;
+        for (int f = 0; f < 50; f++)
+            moves += gt911_frame_moves(ts, dev, 160 + noise[f % 10],
+                                       240 + noise[(f + 3) % 10]);
+        if (on)
+            CHECK(moves <= 1);
+        else
+            CHECK(moves >= 30);
+
+        // 20 pixels a frame; the filter keeps up within a few
+        Touchscreen::Event last;
+        for (int f = 1; f <= 10; f++) {
+            moves = gt911_frame_moves(ts, dev, 160, 240 + 20 * f, &last);
+            CHECK(moves == 1);
+            CHECK(last.type == Type::move);
+            if (f >= 5)
+                CHECK(abs(last.row - (240 + 20 * f)) <= 6);
+        }
+        // settles on where the finger stopped
+        for (int f = 0; f < 20; f++)
+            gt911_frame_moves(ts, dev, 160, 440, &last);
+        Touchscreen::Contact c;
+        CHECK(ts.get_contacts(&c, 1) == 1);
+        CHECK(c.col == 160 && abs(c.row - 440) <= 1);
+        dev.frame(nullptr, 0);
+        e = run_us(ts, 10'000);
+        CHECK(e.type == Type::up && e.col == c.col && e.row == c.row);
+    }
+    ts.jitter_filter_off();
+    CHECK(!ts.jitter_filter_on());
+}
+
+
+static Touchscreen::Event ev(Type type, int id, int col, int row,
+                             uint32_t ms)
+{
+    Touchscreen::Event e(type, col, row, id);
+    e.time_us = ms * 1'000;
+    return e;
+}
+
+
+// Scripted event streams through the gesture recognizer.
+static void gestures()
+{
+    using G = GestureRecognizer::Gesture;
+    GestureRecognizer gr;
+    G g;
+
+    // tap, reported once the double-tap window is over
+    gr.event(ev(Type::down, 0, 100, 100, 1'000));
+    gr.event(ev(Type::move, 0, 104, 101, 1'050));
+    gr.event(ev(Type::up, 0, 104, 101, 1'100));
+    gr.poll(1'300'000);
+    CHECK(!gr.pop(g));
+    gr.poll(1'500'000);
+    CHECK(gr.pop(g) && g.type == G::Type::tap);
+    CHECK(g.col == 100 && g.row == 100);
+    CHECK(!gr.pop(g));
+
+    // double tap
+    gr.event(ev(Type::down, 1, 100, 100, 2'000));
+    gr.event(ev(Type::up, 1, 100, 100, 2'080));
+    gr.event(ev(Type::down, 2, 110, 95, 2'200));
+    gr.event(ev(Type::up, 2, 110, 95, 2'280));
+    CHECK(gr.pop(g) && g.type == G::Type::double_tap);
+    gr.poll(3'000'000);
+    CHECK(!gr.pop(g));
+
+    // two taps too far apart are two taps
+    gr.event(ev(Type::down, 3, 100, 100, 4'000));
+    gr.event(ev(Type::up, 3, 100, 100, 4'080));
+    gr.event(ev(Type::down, 4, 300, 100, 4'200));
+    CHECK(gr.pop(g) && g.type == G::Type::tap && g.col == 100);
+    gr.event(ev(Type::up, 4, 300, 100, 4'280));
+    gr.poll(5'000'000);
+    CHECK(gr.pop(g) && g.type == G::Type::tap && g.col == 300);
+
+    // long press, with a little jitter; no tap when it lifts
+    gr.event(ev(Type::down, 5, 200, 200, 6'000));
+    for (uint32_t ms = 6'100; ms < 6'600; ms += 100)
+        gr.event(ev(Type::move, 5, 200 + (ms / 100) % 3, 200, ms));
+    CHECK(!gr.pop(g));
+    gr.poll(6'600'000);
+    CHECK(gr.pop(g) && g.type == G::Type::long_press);
+    CHECK(g.col == 200 && g.row == 200);
+    gr.event(ev(Type::up, 5, 201, 200, 7'000));
+    gr.poll(8'000'000);
+    CHECK(!gr.pop(g));
+
+    // swipe right, 240 pixels in 128 msec
+    gr.event(ev(Type::down, 6, 50, 150, 9'000));
+    for (int f = 1; f <= 8; f++)
+        gr.event(ev(Type::move, 6, 50 + 30 * f, 150 + f, 9'000 + 16 * f));
+    gr.event(ev(Type::up, 6, 290, 158, 9'128));
+    CHECK(gr.pop(g) && g.type == G::Type::swipe);
+    CHECK(g.dir == G::Dir::right && g.speed == 1875);
+    CHECK(g.col == 50 && g.row == 150);
+
+    // the same distance up, too slowly, is nothing
+    gr.event(ev(Type::down, 7, 150, 300, 10'000));
+    for (int f = 1; f <= 8; f++)
+        gr.event(ev(Type::move, 7, 150, 300 - 30 * f, 10'000 + 250 * f));
+    gr.event(ev(Type::up, 7, 150, 60, 12'000));
+    gr.poll(13'000'000);
+    CHECK(!gr.pop(g));
+
+    // quick swipe up
+    gr.event(ev(Type::down, 8, 150, 300, 14'000));
+    gr.event(ev(Type::move, 8, 152, 200, 14'040));
+    gr.event(ev(Type::up, 8, 153, 100, 14'080));
+    CHECK(gr.pop(g) && g.type == G::Type::swipe && g.dir == G::Dir::up);
+
+    // pinch out, then turn
+    gr.event(ev(Type::down, 0, 200, 160, 15'000));
+    gr.event(ev(Type::down, 1, 280, 160, 15'010));
+    gr.event(ev(Type::move, 1, 282, 160, 15'020));
+    CHECK(!gr.pop(g)); // under the threshold
+    gr.event(ev(Type::move, 1, 300, 160, 15'030));
+    CHECK(gr.pop(g) && g.type == G::Type::pinch);
+    CHECK(g.scale == 320 && g.angle == 0);
+    CHECK(g.col == 250 && g.row == 160);
+    gr.event(ev(Type::move, 1, 200, 240, 15'040));
+    CHECK(gr.pop(g) && g.type == G::Type::pinch);
+    CHECK(g.scale == 256 && g.angle == 9000);
+    gr.event(ev(Type::move, 1, 120, 160, 15'050));
+    CHECK(gr.pop(g) && abs(g.angle) == 18000);
+    // lifting ends it; a second finger means no tap or swipe
+    gr.event(ev(Type::up, 1, 120, 160, 15'060));
+    gr.event(ev(Type::move, 0, 260, 160, 15'070));
+    gr.event(ev(Type::up, 0, 260, 160, 15'080));
+    gr.poll(16'000'000);
+    CHECK(!gr.pop(g));
+
+    // taps at once with no double-tap window
+    GestureRecognizer::Config cfg;
+    cfg.double_tap_us = 0;
+    gr.set_config(cfg);
+    gr.event(ev(Type::down, 2, 10, 10, 17'000));
+    gr.event(ev(Type::up, 2, 10, 10, 17'050));
+    CHECK(gr.pop(g) && g.type == G::Type::tap);
+
+    // angle() against atan2, isqrt() against sqrt
+    int err = 0;
+    for (int deg = -179; deg <= 180; deg += 7) {
+        double rad = deg * M_PI / 180;
+        int x = int(lround(1'000 * cos(rad)));
+        int y = int(lround(1'000 * sin(rad)));
+        int want = int(lround(atan2(y, x) * 18'000 / M_PI));
+        err = std::max(err, abs(GestureRecognizer::angle(x, y) - want));
+    }
+    CHECK(err <= 15);
+    for (uint64_t n : {0ull, 1ull, 65'535ull, 65'536ull, 1'000'000'007ull})
+        CHECK(GestureRecognizer::isqrt(n) == uint32_t(sqrt(double(n))));
+}
+
+
+template <typename Ts>
+static void gt911_script(EventLog &log, Touchscreen::Rotation rotation,
+                         const Touchscreen::Grid *grid = nullptr)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Ts ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    ts.set_rotation(rotation);
+    if (grid != nullptr)
+        ts.set_grid(*grid);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    touch_script<SimGt911, SimGt911::Point>(ts, dev, log);
+}
+
+
+// Frames straight into frame_events(): down, move, up.
+template <typename Ts>
+static void gt911_frames(EventLog &log)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Ts ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    ts.set_rotation(Touchscreen::Rotation::landscape);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    static const uint8_t frames[][1 + 8] = {
+        {0x81, 0, 100, 0, 200, 0, 10, 0, 0},
+        {0x81, 0, 0x2c, 0x01, 0x2c, 0x01, 12, 0, 0}, // (300, 300)
+        {0x80},
+    };
+    for (const uint8_t *frame : frames) {
+        Touchscreen::Event events[4];
+        int n = FrameAccess::frame_events(ts, frame, events, 4);
+        for (int i = 0; i < n; i++)
+            log.add(events[i]);
+    }
+}
+
+
+template <typename Ts>
+static void ft6336u_script(EventLog &log, Touchscreen::Rotation rotation)
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimFt6336u dev(rst_gpio, int_gpio);
+    Ts ts(i2c, 21, 20, rst_gpio, int_gpio);
+    ts.set_rotation(rotation);
+    CHECK(ts.init());
+    touch_script<SimFt6336u, SimFt6336u::Point>(ts, dev, log);
+}
+
+
+// The compile-time flavor gives the same events as the driver it wraps,
+// called through Touchscreen &.
+static void touchscreen_fixed()
+{
+    using Rotation = Touchscreen::Rotation;
+    constexpr Rotation landscape = Rotation::landscape;
+    constexpr Rotation portrait2 = Rotation::portrait2;
+    EventLog want, got;
+
+    gt911_script<Gt911>(want, landscape);
+    gt911_script<TouchscreenFixed<Gt911, 480, 320, landscape>>(got,
+                                                               landscape);
+    CHECK(want.events.size() == 69);
+    CHECK(got == want);
+
+    want.events.clear();
+    got.events.clear();
+    gt911_script<Gt911>(want, portrait2);
+    gt911_script<TouchscreenFixed<Gt911, 480, 320, portrait2>>(got,
+                                                               portrait2);
+    CHECK(got == want);
+
+    want.events.clear();
+    got.events.clear();
+    ft6336u_script<Ft6336u>(want, landscape);
+    ft6336u_script<TouchscreenFixed<Ft6336u, 480, 320, landscape>>(got,
+                                                                   landscape);
+    CHECK(want.events.size() > 40);
+    CHECK(got == want);
+
+    want.events.clear();
+    got.events.clear();
+    gt911_frames<Gt911>(want);
+    gt911_frames<TouchscreenFixed<Gt911, 480, 320, landscape>>(got);
+    CHECK(want.events.size() == 3);
+    CHECK(want.events[0].type == Type::down &&
+          want.events[1].type == Type::move &&
+          want.events[2].type == Type::up);
+    CHECK(got == want);
+}
+
+
+// The fixed flavor cannot follow the panel turning, so config_write()
+// refuses to flip x2x there and nothing moves; other edits go through.
+static void touchscreen_fixed_panel()
+{
+    using Fixed =
+        TouchscreenFixed<Gt911, 480, 320, Touchscreen::Rotation::landscape>;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Fixed ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+
+    Gt911::Config cfg;
+    CHECK(ts.config_read(cfg));
+    cfg.set_x2x(!cfg.x2x());
+    CHECK(!ts.config_write(cfg));
+    CHECK(dev.config_loads() == 0);
+    CHECK(!ts.get_panel().mirror_x);
+    CHECK(!ts.panel_allowed({320, 480, false, true, false}));
+    CHECK(ts.panel_allowed({320, 480, false, false, false}));
+
+    SimGt911::Point p{0, 100, 200, 10};
+    CHECK(dev.frame(&p, 1));
+    Touchscreen::Event e = run_us(ts, 2'000);
+    CHECK(e.type == Type::down && e.col == 479 - 200 && e.row == 100);
+
+    CHECK(ts.config_read(cfg));
+    cfg.set_touch_thresh(50);
+    CHECK(ts.config_write(cfg));
+    CHECK(dev.config_loads() == 1);
+}
+
+
+// The fixed flavor applies an edge grid the same as the driver does.
+static void touchscreen_fixed_grid()
+{
+    using Rotation = Touchscreen::Rotation;
+    constexpr Rotation landscape = Rotation::landscape;
+    constexpr Rotation portrait2 = Rotation::portrait2;
+    Touchscreen::Grid grid;
+    for (int v = 0; v < Touchscreen::grid_v; v++) {
+        for (int u = 0; u < Touchscreen::grid_u; u++) {
+            grid.off[v][u][0] = int8_t(2 * (u - 3));
+            grid.off[v][u][1] = int8_t(v - 4);
+        }
+    }
+
+    EventLog plain, want, got;
+    gt911_script<Gt911>(plain, landscape);
+    gt911_script<Gt911>(want, landscape, &grid);
+    gt911_script<TouchscreenFixed<Gt911, 480, 320, landscape>>(
+        got, landscape, &grid);
+    CHECK(want.events.size() == 69);
+    CHECK(!(want == plain));
+    CHECK(got == want);
+
+    plain.events.clear();
+    want.events.clear();
+    got.events.clear();
+    gt911_script<Gt911>(plain, portrait2);
+    gt911_script<Gt911>(want, portrait2, &grid);
+    gt911_script<TouchscreenFixed<Gt911, 480, 320, portrait2>>(
+        got, portrait2, &grid);
+    CHECK(!(want == plain));
+    CHECK(got == want);
+}
+
+
+// A small ring keeps the newest whole records.
+static void touch_trace_ring()
+{
+    uint8_t buf[TouchTrace::rec_max + 20];
+    TouchTrace trace(buf, sizeof(buf));
+    trace.record_irq(1); // not recording yet
+    CHECK(trace.size() == 0);
+
+    trace.start();
+    const uint8_t wr[2] = {0x81, 0x4e};
+    for (int i = 0; i < 20; i++) {
+        uint8_t rd[9] = {uint8_t(0x80 | i)};
+        trace.record_start(0x14, wr, 2, 9);
+        trace.record_end(i == 5 ? PICO_ERROR_TIMEOUT : 9, rd);
+    }
+    CHECK(trace.dropped() > 0);
+
+    uint8_t out[sizeof(buf)];
+    int len = trace.take(out, sizeof(out));
+    TouchTrace::Record rec;
+    int pos = 0, recs = 0;
+    bool ok = true;
+    while (pos < len) {
+        int rec_len = TouchTrace::parse(out + pos, len - pos, rec);
+        if (rec_len == 0) {
+            ok = false;
+            break;
+        }
+        pos += rec_len;
+        recs++;
+    }
+    CHECK(ok && recs > 0);
+    CHECK(uint32_t(recs) + trace.dropped() == 20);
+    CHECK(rec.type == TouchTrace::xfer && rec.rd[0] == (0x80 | 19));
+
+    uint8_t line_buf[TouchTrace::rec_max];
+    CHECK(TouchTrace::unhex("tt 5800000000000a000000", line_buf,
+                            sizeof(line_buf)) == 10);
+    CHECK(TouchTrace::unhex("hello", line_buf, sizeof(line_buf)) == 0);
+    CHECK(TouchTrace::unhex("tt 58000000", line_buf, sizeof(line_buf)) == 0);
+}
+
+
+// Percentiles come back within a bucket (25%) of the true value, and never
+// over max().
+static void latency_hist()
+{
+    LatencyHist hist;
+    CHECK(hist.count() == 0 && hist.percentile(50) == 0);
+
+    for (uint32_t us = 1; us <= 1000; us++)
+        hist.add(us);
+    CHECK(hist.count() == 1000);
+    CHECK(hist.min() == 1 && hist.max() == 1000 && hist.mean() == 500);
+    CHECK(hist.percentile(50) >= 500 && hist.percentile(50) < 625);
+    CHECK(hist.percentile(90) >= 900 && hist.percentile(90) < 1125);
+    CHECK(hist.percentile(100) == 1000);
+
+    // every value lands in the bucket whose range holds it
+    bool buckets_ok = true;
+    for (uint32_t us = 0; us < 100'000; us += 7) {
+        int b = LatencyHist::bucket(us);
+        if (us < LatencyHist::bucket_lo(b) ||
+            (b + 1 < LatencyHist::bucket_cnt &&
+             us >= LatencyHist::bucket_lo(b + 1)))
+            buckets_ok = false;
+    }
+    CHECK(buckets_ok);
+    CHECK(LatencyHist::bucket(UINT32_MAX) == LatencyHist::bucket_cnt - 1);
+
+    hist.reset();
+    CHECK(hist.count() == 0 && hist.max() == 0);
+}
+
+
+// Events carry INT, poll and data arrival times from the simulated clock,
+// and the histograms see the bus time and a consumer that lags 5 msec.
+static void gt911_latency()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    ts.latency_reset();
+
+    using Latency = Touchscreen::Latency;
+    constexpr int frame_cnt = 50;
+    bool times_ok = true;
+    int events = 0;
+    for (int f = 0; f < frame_cnt; f++) {
+        SimGt911::Point p{0, 100 + f, 200, 10};
+        uint64_t int_us = sim::now_us();
+        CHECK(dev.frame(&p, 1));
+        uint64_t end_us = sim::now_us() + 2'000;
+        while (sim::now_us() < end_us)
+            ts.service();
+        sim::advance_us(5'000); // UI busy
+        Touchscreen::Event ev[4];
+        int n = ts.get_events(ev, 4);
+        events += n;
+        for (int e = 0; e < n; e++) {
+            // INT edge <= poll start < data arrival, all within the 2 msec
+            if (ev[e].int_us < uint32_t(int_us) ||
+                ev[e].poll_us < ev[e].int_us ||
+                ev[e].time_us <= ev[e].poll_us ||
+                ev[e].time_us > uint32_t(end_us))
+                times_ok = false;
+        }
+    }
+    CHECK(events == frame_cnt);
+    CHECK(times_ok);
+
+    // The first frame reads status alone, then its point record; after that
+    // status and the point come in one 9-byte burst (~300 usec at 400 kHz).
+    const LatencyHist &int_to_status = ts.latency(Latency::int_to_status);
+    const LatencyHist &status_to_touch = ts.latency(Latency::status_to_touch);
+    const LatencyHist &read_to_consume = ts.latency(Latency::read_to_consume);
+    CHECK(int_to_status.count() >= uint32_t(frame_cnt));
+    CHECK(int_to_status.percentile(50) > 100);
+    CHECK(int_to_status.percentile(99) < 500);
+    CHECK(status_to_touch.count() >= uint32_t(frame_cnt));
+    CHECK(status_to_touch.percentile(50) < 20); // burst: same read
+    CHECK(status_to_touch.max() > 200);         // first frame: separate read
+    CHECK(read_to_consume.count() == uint32_t(frame_cnt));
+    CHECK(read_to_consume.percentile(50) >= 5'000);
+    CHECK(read_to_consume.percentile(99) < 7'500);
+    ts.latency_dump();
+}
+
+
+// One frame with the given touches every 2 msec for a 16 msec display
+// frame, then the tick.
+static int gt911_tick(Gt911 &ts, SimGt911 &dev,
+                      const std::function<int(int, SimGt911::Point[])> &frame,
+                      Touchscreen::Event ev[], int ev_max)
+{
+    for (int f = 0; f < 8; f++) {
+        SimGt911::Point p[2];
+        dev.frame(p, frame(f, p));
+        uint64_t end_us = sim::now_us() + 2'000;
+        while (sim::now_us() < end_us)
+            ts.service();
+    }
+    return ts.get_frame_events(ev, ev_max);
+}
+
+
+// Moves merged per display frame; downs and ups kept, in order per contact.
+static void gt911_frame_events()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    ts.set_rotation(Touchscreen::Rotation::portrait); // (col, row) = (x, y)
+    ts.set_overflow(Touchscreen::Overflow::coalesce_moves);
+
+    Touchscreen::Event ev[8];
+    // finger 0 down and moving: one down, one move where it got to
+    int n = gt911_tick(ts, dev, [](int f, SimGt911::Point p[]) {
+        p[0] = {0, 100 + 5 * f, 200, 10};
+        return 1;
+    }, ev, 8);
+    CHECK(n == 2);
+    CHECK(is(ev[0], Type::down, 0) && ev[0].col == 100);
+    CHECK(is(ev[1], Type::move, 0) && ev[1].col == 135);
+    CHECK(ts.frame_coalesced() == 6);
+
+    // finger 0 moves and lifts while finger 1 lands and moves
+    n = gt911_tick(ts, dev, [](int f, SimGt911::Point p[]) {
+        int cnt = 0;
+        if (f < 5)
+            p[cnt++] = {0, 140 + 5 * f, 200, 10};
+        if (f >= 2)
+            p[cnt++] = {1, 50, 300 + 10 * f, 10};
+        return cnt;
+    }, ev, 8);
+    // finger 1's moves merge across finger 0's up
+    CHECK(n == 4);
+    CHECK(is(ev[0], Type::move, 0) && ev[0].col == 160);
+    CHECK(is(ev[1], Type::down, 1) && ev[1].row == 320);
+    CHECK(is(ev[2], Type::move, 1) && ev[2].row == 370);
+    CHECK(is(ev[3], Type::up, 0) && ev[3].col == 160);
+    CHECK(ts.frame_coalesced() == 6 + 4 + 4);
+
+    // more than the caller takes at once: the rest waits for the next call
+    n = gt911_tick(ts, dev, [](int f, SimGt911::Point p[]) {
+        p[0] = {1, 50, 380 + f, 10};
+        return f < 7 ? 1 : 0;
+    }, ev, 1);
+    CHECK(n == 1 && is(ev[0], Type::move, 1) && ev[0].row == 386);
+    n = ts.get_frame_events(ev, 8);
+    CHECK(n == 1 && is(ev[0], Type::up, 1));
+    CHECK(ts.get_frame_events(ev, 8) == 0);
+    CHECK(ts.frame_coalesced() == 6 + 4 + 4 + 6);
+    CHECK(ts.events_dropped() == 0);
+}
+
+
+// Predicted moves lead a steady stroke, come back when it stops, and merge
+// per frame without taking a real move's place.
+static void prediction()
+{
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    ts.set_rotation(Touchscreen::Rotation::portrait); // (col, row) = (x, y)
+    CHECK(!ts.predictor_on());
+    Touchscreen::Predictor pr;
+    pr.horizon_ms = 20;
+    ts.set_predictor(pr);
+
+    // 10 pixels every 10 msec: 20 msec ahead is 20 pixels on
+    Touchscreen::Event ev[8];
+    bool ahead = true;
+    for (int f = 0; f < 15; f++) {
+        SimGt911::Point p{0, 50 + 10 * f, 200, 10};
+        dev.frame(&p, 1);
+        int n = events_us(ts, 10'000, ev, 8);
+        if (f == 0) {
+            CHECK(n == 1 && is(ev[0], Type::down, 0) && !ev[0].predicted);
+            continue;
+        }
+        CHECK(n == 2);
+        CHECK(is(ev[0], Type::move, 0) && !ev[0].predicted);
+        CHECK(ev[0].col == 50 + 10 * f);
+        CHECK(is(ev[1], Type::move, 0) && ev[1].predicted);
+        CHECK(ev[1].time_us == ev[0].time_us);
+        if (f >= 5 && abs(ev[1].col - (70 + 10 * f)) > 1)
+            ahead = false;
+    }
+    CHECK(ahead);
+
+    // stopped: predictions come back to it, and then there are none
+    int last_col = 0;
+    for (int f = 0; f < 10; f++) {
+        SimGt911::Point p{0, 190, 200, 10};
+        dev.frame(&p, 1);
+        int n = events_us(ts, 10'000, ev, 8);
+        for (int e = 0; e < n; e++) {
+            CHECK(ev[e].predicted);
+            last_col = ev[e].col;
+        }
+    }
+    CHECK(last_col == 190);
+    dev.frame(nullptr, 0);
+    int n = events_us(ts, 10'000, ev, 8);
+    CHECK(n == 1 && is(ev[0], Type::up, 0) && !ev[0].predicted);
+
+    // off: no predictions
+    ts.predictor_off();
+    for (int f = 0; f < 5; f++) {
+        SimGt911::Point p{1, 50 + 10 * f, 200, 10};
+        dev.frame(&p, 1);
+        n = events_us(ts, 10'000, ev, 8);
+        CHECK(n == 1 && !ev[0].predicted);
+    }
+
+    // per-frame merging keeps the latest real move, then the latest
+    // prediction
+    using Event = Touchscreen::Event;
+    auto pred = [](int col) {
+        Event e(Type::move, col, 0, 0);
+        e.predicted = true;
+        return e;
+    };
+    FrameBatch<Event, 8> batch;
+    batch.add(Event(Type::move, 1, 0, 0));
+    batch.add(pred(5));
+    batch.add(Event(Type::move, 2, 0, 0));
+    batch.add(pred(6));
+    batch.add(Event(Type::move, 3, 0, 1));
+    CHECK(batch.take(ev, 8) == 3);
+    CHECK(!ev[0].predicted && ev[0].col == 2);
+    CHECK(ev[1].predicted && ev[1].col == 6);
+    CHECK(ev[2].id == 1);
+    CHECK(batch.coalesced() == 2);
+    batch.add(pred(7));
+    batch.add(Event(Type::move, 4, 0, 0));
+    CHECK(batch.take(ev, 8) == 1 && !ev[0].predicted && ev[0].col == 4);
+}
+
+
+// A quick nudge that stays inside tap_slop is still a tap with prediction
+// on, though the predictions overshoot past it.
+static void gestures_predicted()
+{
+    using G = GestureRecognizer::Gesture;
+    sim::reset();
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    SimGt911 dev(gt911_addr, int_gpio);
+    Gt911 ts(i2c, gt911_addr, rst_gpio, int_gpio);
+    CHECK(ts.init());
+    run_us(ts, 5'000);
+    ts.set_rotation(Touchscreen::Rotation::portrait); // (col, row) = (x, y)
+    ts.set_predictor(Touchscreen::Predictor());
+
+    GestureRecognizer gr;
+    const int slop = gr.config().tap_slop;
+    const int cols[] = {100, 105, 110, 110, 110};
+    int overshoot = 0;
+    Touchscreen::Event ev[8];
+    for (int f = 0; f <= 5; f++) {
+        SimGt911::Point p{0, f < 5 ? cols[f] : 0, 200, 10};
+        dev.frame(&p, f < 5 ? 1 : 0);
+        int n = events_us(ts, 10'000, ev, 8);
+        for (int e = 0; e < n; e++) {
+            if (ev[e].predicted)
+                overshoot = std::max(overshoot, ev[e].col - 100);
+            gr.event(ev[e]);
+        }
+    }
+    CHECK(overshoot >= slop);
+    CHECK(cols[4] - cols[0] < slop);
+
+    G g;
+    gr.poll(time_us_32() + gr.config().double_tap_us + 1);
+    CHECK(gr.pop(g) && g.type == G::Type::tap);
+    CHECK(g.col == 100 && g.row == 200);
+}
+
+
+// frame number from FakeTouchscreen's (col, row)
+static int fake_frame(int col, int row)
+{
+    return (row << 15) | col;
+}
+
+
+// Makes up a new frame every get_event(): contact_cnt cycles 1..5, and every
+// contact carries the frame number in (col, row) (see fake_frame()), so a
+// snapshot mixing two frames shows up as contacts disagreeing with each
+// other or with snap.frame.
+class FakeTouchscreen : public Touchscreen
+{
+public:
+
+    FakeTouchscreen() : Touchscreen(480, 320), _frame(0)
+    {
+    }
+
+    int get_touches(Contact[], int, int) override
+    {
+        return 0;
+    }
+
+    Event get_event() override
+    {
+        Event event;
+        if (event_pop(event))
+            return event;
+        Contact cur[contact_max];
+        int cnt = 1 + _frame % contact_max;
+        for (int c = 0; c < cnt; c++) {
+            // the frame number, in 15-bit halves to fit Contact
+            cur[c].id = uint8_t(c);
+            cur[c].col = int16_t(_frame & 0x7fff);
+            cur[c].row = int16_t(_frame >> 15);
+        }
+        _frame++;
+        contacts_update(cur, cnt);
+        return Event(); // the rest come out on later calls
+    }
+
+private:
+
+    int _frame;
+};
+
+
+// TouchService runs the fake touchscreen on another thread while this one
+// reads snapshots and events, the way core 0 does on target.
+static void touch_service_snapshot()
+{
+    FakeTouchscreen ts;
+    ts.set_overflow(Touchscreen::Overflow::drop_newest);
+    TouchService::start(ts);
+    CHECK(TouchService::running());
+
+    constexpr int snap_cnt = 200'000;
+    bool consistent = true;
+    bool monotonic = true;
+    uint32_t last_frame = 0;
+    int last_ev_frame[Touchscreen::contact_max] = {-1, -1, -1, -1, -1};
+    bool in_order = true;
+    Touchscreen::Event ev[16];
+    for (int i = 0; i < snap_cnt; i++) {
+        Touchscreen::Snapshot snap;
+        ts.get_snapshot(snap);
+        if (snap.frame < last_frame)
+            monotonic = false;
+        last_frame = snap.frame;
+        if (snap.frame != 0) {
+            int frame = int(snap.frame - 1);
+            if (snap.contact_cnt != 1 + frame % Touchscreen::contact_max)
+                consistent = false;
+            for (int c = 0; c < snap.contact_cnt; c++)
+                if (snap.contacts[c].id != c ||
+                    fake_frame(snap.contacts[c].col, snap.contacts[c].row) !=
+                        frame)
+                    consistent = false;
+        }
+        int n = ts.get_events(ev, 16);
+        for (int e = 0; e < n; e++) {
+            if (ev[e].type == Type::up)
+                continue;
+            int frame = fake_frame(ev[e].col, ev[e].row);
+            if (frame <= last_ev_frame[ev[e].id])
+                in_order = false;
+            last_ev_frame[ev[e].id] = frame;
+        }
+        if ((i % 64) == 0)
+            std::this_thread::yield();
+    }
+
+    TouchService::stop();
+    CHECK(!TouchService::running());
+    CHECK(TouchService::loops() > 0);
+    CHECK(last_frame > 0);
+    CHECK(consistent);
+    CHECK(monotonic);
+    CHECK(in_order);
+}
+
+
+int main()
+{
+    gt911_irq();
+    gt911_poll();
+    gt911_burst();
+    gt911_multi();
+    ft6336u_multi();
+    ft6336u_never_blocks();
+    gt911_init_incremental();
+    ft6336u_init_incremental();
+    event_ring_threads(EventRingOverflow::drop_newest, true);
+    event_ring_threads(EventRingOverflow::drop_newest, false);
+    event_ring_threads(EventRingOverflow::drop_oldest, false);
+    event_ring_threads(EventRingOverflow::coalesce_moves, false);
+    touch_service_snapshot();
+    latency_hist();
+    gt911_bus_stats();
+    gt911_trace_replay();
+    ft6336u_trace_replay();
+    gt911_config_trace();
+    touch_trace_ring();
+    gt911_latency();
+    gt911_config();
+    ft6336u_tuning();
+    gt911_poll_sched();
+    transform();
+    touchscreen_fixed();
+    touchscreen_fixed_grid();
+    touchscreen_fixed_panel();
+    calibration();
+    grid();
+    gestures();
+    jitter_filter();
+    gt911_frame_events();
+    prediction();
+    gestures_predicted();
+    contact_records();
+
+    printf("host_test: %s (%d failures)\n", failures == 0 ? "PASS" : "FAIL",
+           failures);
+    return failures == 0 ? 0 : 1;
+}
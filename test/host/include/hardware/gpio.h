@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hardware/irq.h"
+
+enum gpio_function {
+    GPIO_FUNC_SIO = 5,
+    GPIO_FUNC_I2C = 3,
+};
+
+enum gpio_irq_level {
+    GPIO_IRQ_LEVEL_LOW = 0x1u,
+    GPIO_IRQ_LEVEL_HIGH = 0x2u,
+    GPIO_IRQ_EDGE_FALL = 0x4u,
+    GPIO_IRQ_EDGE_RISE = 0x8u,
+};
+
+void gpio_init(unsigned int gpio);
+void gpio_put(unsigned int gpio, bool value);
+bool gpio_get(unsigned int gpio);
+void gpio_set_dir(unsigned int gpio, bool out);
+void gpio_pull_down(unsigned int gpio);
+void gpio_pull_up(unsigned int gpio);
+void gpio_set_function(unsigned int gpio, gpio_function fn);
+
+void gpio_set_irq_enabled(unsigned int gpio, uint32_t events, bool enabled);
+void gpio_acknowledge_irq(unsigned int gpio, uint32_t events);
+uint32_t gpio_get_irq_event_mask(unsigned int gpio);
+void gpio_add_raw_irq_handler(unsigned int gpio, irq_handler_t handler);
+void gpio_remove_raw_irq_handler(unsigned int gpio, irq_handler_t handler);
@@ -0,0 +1,7 @@
+#pragma once
+
+typedef struct i2c_inst i2c_inst_t;
+
+extern i2c_inst_t *const i2c0;
+extern i2c_inst_t *const i2c1;
+
@@ -0,0 +1,9 @@
+#pragma once
+
+typedef void (*irq_handler_t)();
+
+enum {
+    IO_IRQ_BANK0 = 13,
+};
+
+void irq_set_enabled(unsigned int num, bool enabled);
@@ -0,0 +1,83 @@
+#pragma once
+
+// Host stand-in for misc's I2cDev. Transactions go to the simulated
+// targets registered with sim::attach(); with bus timing on, each one takes
+// the time it would at the configured baud rate, and the async API stays
+// busy() until the simulated clock gets there.
+
+#include <cstdint>
+
+#include "hardware/i2c.h"
+#include "pico/stdlib.h"
+
+
+class I2cDev
+{
+public:
+
+    I2cDev(i2c_inst_t *i2c, int scl_gpio, int sda_gpio, uint32_t baud);
+
+    uint32_t baud() const
+    {
+        return _baud;
+    }
+
+    int write_sync(uint8_t addr, const uint8_t *buf, int buf_len, bool nostop,
+                   uint timeout_us);
+
+    int read_sync(uint8_t addr, uint8_t *buf, int buf_len, bool nostop,
+                  uint timeout_us);
+
+    bool busy();
+
+    void write_read_async_start(uint8_t addr, const uint8_t *wr_buf,
+                                int wr_len, uint8_t *rd_buf = nullptr,
+                                int rd_len = 0);
+
+    int write_read_async_check();
+
+    // host only
+
+    // model bus time (default on)
+    void bus_timing(bool enable)
+    {
+        _bus_timing = enable;
+    }
+
+    // number of times busy() returned true
+    uint32_t busy_cnt() const
+    {
+        return _busy_cnt;
+    }
+
+    // when the async transfer in flight finishes (0 if none)
+    uint64_t done_us() const
+    {
+        return _async_active ? _done_us : 0;
+    }
+
+    // make the next cnt transactions return result (e.g. PICO_ERROR_TIMEOUT)
+    void inject(int result, int cnt = 1)
+    {
+        _inject_result = result;
+        _inject_cnt = cnt;
+    }
+
+private:
+
+    uint32_t _baud;
+    bool _bus_timing;
+
+    uint64_t _done_us;
+    int _async_result;
+    bool _async_active;
+
+    uint32_t _busy_cnt;
+
+    int _inject_result;
+    int _inject_cnt;
+
+    bool injected(int &result);
+
+    void bus_time(int bits);
+};
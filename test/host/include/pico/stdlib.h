@@ -0,0 +1,27 @@
+#pragma once
+
+// Host stand-in for the parts of the Pico SDK the touchscreen library uses.
+// Time is simulated (see sim.h); GPIO and IRQ state live in sim.cpp.
+
+#include <cstdint>
+
+#include "hardware/gpio.h"
+
+typedef unsigned int uint;
+
+#define PICO_ON_DEVICE 0
+
+enum {
+    PICO_OK = 0,
+    PICO_ERROR_GENERIC = -1,
+    PICO_ERROR_TIMEOUT = -2,
+};
+
+uint32_t time_us_32();
+uint64_t time_us_64();
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+static inline void tight_loop_contents()
+{
+}
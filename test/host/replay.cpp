@@ -0,0 +1,183 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+// host stand-ins
+#include "i2c_dev.h"
+#include "pico/stdlib.h"
+// touchscreen
+#include "frame_batch.h"
+#include "ft6336u.h"
+#include "gt911.h"
+#include "touchscreen.h"
+//
+#include "sim.h"
+#include "sim_ft6336u.h"
+#include "sim_gt911.h"
+#include "trace_replay.h"
+
+// Replay a trace captured with TouchTrace::stream() (the "tt " lines; other
+// lines are ignored) through a driver and print the events.
+//
+//   replay [-q] [-f hz] gt911 [int|poll] trace.txt
+//   replay [-q] [-f hz] ft6336u trace.txt
+//
+// -q prints only the summary. -f delivers events the way
+// Touchscreen::get_frame_events() would to a UI ticking at hz (moves merged
+// per tick), and the summary says how many that saves.
+
+static constexpr int rst_gpio = 2;
+static constexpr int int_gpio = 3;
+
+
+static void usage()
+{
+    printf("usage: replay [-q] [-f hz] gt911 [int|poll] <trace>\n");
+    printf("       replay [-q] [-f hz] ft6336u <trace>\n");
+}
+
+
+static void event_print(const Touchscreen::Event &e)
+{
+    printf("%lu %s id=%d (%d, %d)\n", (unsigned long)e.time_us,
+           e.type_name(), e.id, e.col, e.row);
+}
+
+
+static int replay(Touchscreen &ts, I2cDev &i2c, TraceReplay &rp, bool quiet,
+                  int frame_hz)
+{
+    // -f: a tick every frame_us of event time hands out the batch
+    FrameBatch<Touchscreen::Event, 256> batch;
+    const uint32_t frame_us = frame_hz > 0 ? 1'000'000 / frame_hz : 0;
+    uint32_t tick_us = 0;
+    bool ticking = false;
+    int frames = 0;
+    int delivered = 0;
+    auto tick = [&]() {
+        Touchscreen::Event ev[16];
+        int n;
+        while ((n = batch.take(ev, 16)) > 0) {
+            delivered += n;
+            for (int i = 0; i < n && !quiet; i++)
+                event_print(ev[i]);
+        }
+        frames++;
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t start_us = sim::now_us();
+    rp.start();
+    int events = rp.run(ts, i2c, [&](const Touchscreen::Event &e) {
+        if (frame_us == 0) {
+            if (!quiet)
+                event_print(e);
+            return;
+        }
+        if (!ticking) {
+            tick_us = e.time_us + frame_us;
+            ticking = true;
+        }
+        while (int32_t(e.time_us - tick_us) >= 0) {
+            tick();
+            tick_us += frame_us;
+        }
+        if (!batch.add(e))
+            printf("replay: frame batch full\n");
+    });
+    if (frame_us != 0)
+        tick();
+    auto t1 = std::chrono::steady_clock::now();
+    double wall_s = std::chrono::duration<double>(t1 - t0).count();
+    double sim_s = double(sim::now_us() - start_us) / 1e6;
+    printf("replay: records=%d events=%d unknown_reads=%u sim_s=%.3f"
+           " wall_s=%.3f speedup=%.0f\n",
+           rp.records(), events, unsigned(rp.unknown_reads()), sim_s, wall_s,
+           wall_s > 0 ? sim_s / wall_s : 0.0);
+    if (frame_us != 0)
+        printf("replay: frame_hz=%d frames=%d delivered=%d coalesced=%u"
+               " events_per_sec=%.1f delivered_per_sec=%.1f\n",
+               frame_hz, frames, delivered, unsigned(batch.coalesced()),
+               sim_s > 0 ? events / sim_s : 0.0,
+               sim_s > 0 ? delivered / sim_s : 0.0);
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    bool quiet = false;
+    int frame_hz = 0;
+    while (argc > 1 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[1], "-f") == 0 && argc > 2) {
+            frame_hz = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else {
+            usage();
+            return 1;
+        }
+        argc--;
+        argv++;
+    }
+    if (argc < 3) {
+        usage();
+        return 1;
+    }
+
+    bool gt911 = strcmp(argv[1], "gt911") == 0;
+    bool use_int = true;
+    const char *path = argv[2];
+    if (gt911 && argc > 3) {
+        use_int = strcmp(argv[2], "poll") != 0;
+        path = argv[3];
+    } else if (!gt911 && strcmp(argv[1], "ft6336u") != 0) {
+        usage();
+        return 1;
+    }
+
+    FILE *f = fopen(path, "r");
+    if (f == nullptr) {
+        perror(path);
+        return 1;
+    }
+
+    I2cDev i2c(i2c0, 21, 20, 400'000);
+    int ret;
+    if (gt911) {
+        // init against the model, then hand the bus over to the trace
+        constexpr uint8_t addr = 0x14;
+        SimGt911 dev(addr, use_int ? int_gpio : -1);
+        Gt911 ts(i2c, addr, rst_gpio, use_int ? int_gpio : -1);
+        if (!ts.init()) {
+            printf("replay: Gt911 init failed\n");
+            return 1;
+        }
+        while (ts.get_event().type != Touchscreen::Event::Type::none)
+            ;
+        TraceReplay rp(addr, 2, use_int ? int_gpio : -1);
+        if (!rp.load_hex(f)) {
+            printf("replay: bad trace\n");
+            return 1;
+        }
+        ret = replay(ts, i2c, rp, quiet, frame_hz);
+    } else {
+        SimFt6336u dev(rst_gpio, int_gpio);
+        Ft6336u ts(i2c, 21, 20, rst_gpio, int_gpio);
+        if (!ts.init()) {
+            printf("replay: Ft6336u init failed\n");
+            return 1;
+        }
+        TraceReplay rp(SimFt6336u::addr, 1);
+        if (!rp.load_hex(f)) {
+            printf("replay: bad trace\n");
+            return 1;
+        }
+        ret = replay(ts, i2c, rp, quiet, frame_hz);
+    }
+    fclose(f);
+    return ret;
+}
@@ -0,0 +1,437 @@
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <new>
+#include <utility>
+#include <vector>
+// host stand-ins
+#include "hardware/gpio.h"
+#include "hardware/i2c.h"
+#include "hardware/irq.h"
+#include "i2c_dev.h"
+#include "pico/stdlib.h"
+//
+#include "sim.h"
+
+
+namespace {
+
+constexpr int gpio_cnt = 30;
+
+struct Pin {
+    bool out = false;     // direction
+    bool out_val = false; // value when output
+    bool ext = false;     // driven by a target
+    bool ext_val = false;
+    bool pull_up = false;
+    bool pull_down = false;
+    uint32_t irq_en = 0;
+    uint32_t irq_latched = 0;
+};
+
+struct State {
+    std::atomic<uint64_t> now_us{0}; // service thread reads it too
+    uint32_t step_us = 1;
+    Pin pins[gpio_cnt];
+    bool bank0_en = false;
+    std::vector<std::pair<unsigned, irq_handler_t>> handlers;
+    sim::Target *targets[128] = {};
+};
+
+State st;
+
+
+bool pin_level(const Pin &p)
+{
+    if (p.out)
+        return p.out_val;
+    if (p.ext)
+        return p.ext_val;
+    return p.pull_up && !p.pull_down;
+}
+
+
+// Call after anything that might change a pin's level.
+void pin_changed(unsigned gpio, bool was)
+{
+    Pin &p = st.pins[gpio];
+    bool now = pin_level(p);
+    if (now == was)
+        return;
+    p.irq_latched |= now ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+    if (!st.bank0_en || (p.irq_latched & p.irq_en) == 0)
+        return;
+    // copy: a handler is allowed to remove itself
+    auto handlers = st.handlers;
+    for (auto &h : handlers)
+        h.second();
+}
+
+
+void tick()
+{
+    for (sim::Target *t : st.targets)
+        if (t != nullptr)
+            t->tick(st.now_us);
+}
+
+} // namespace
+
+
+namespace sim {
+
+uint64_t now_us()
+{
+    return st.now_us;
+}
+
+
+void advance_us(uint64_t us)
+{
+    st.now_us += us;
+    tick();
+}
+
+
+void time_step_us(uint32_t us)
+{
+    st.step_us = us;
+}
+
+
+void drive(int gpio, bool level)
+{
+    assert(0 <= gpio && gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.ext = true;
+    p.ext_val = level;
+    pin_changed(gpio, was);
+}
+
+
+void release(int gpio)
+{
+    assert(0 <= gpio && gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.ext = false;
+    pin_changed(gpio, was);
+}
+
+
+bool level(int gpio)
+{
+    assert(0 <= gpio && gpio < gpio_cnt);
+    return pin_level(st.pins[gpio]);
+}
+
+
+bool is_output(int gpio)
+{
+    assert(0 <= gpio && gpio < gpio_cnt);
+    return st.pins[gpio].out;
+}
+
+
+void attach(uint8_t addr, Target *target)
+{
+    assert(addr < 128);
+    st.targets[addr] = target;
+}
+
+
+void detach(uint8_t addr)
+{
+    assert(addr < 128);
+    st.targets[addr] = nullptr;
+}
+
+
+Target *target(uint8_t addr)
+{
+    return addr < 128 ? st.targets[addr] : nullptr;
+}
+
+
+void reset()
+{
+    st.~State();
+    new (&st) State();
+}
+
+} // namespace sim
+
+
+// pico/stdlib.h
+
+uint32_t time_us_32()
+{
+    return uint32_t(time_us_64());
+}
+
+
+uint64_t time_us_64()
+{
+    sim::advance_us(st.step_us);
+    return st.now_us;
+}
+
+
+void sleep_us(uint64_t us)
+{
+    sim::advance_us(us);
+}
+
+
+void sleep_ms(uint32_t ms)
+{
+    sim::advance_us(uint64_t(ms) * 1'000);
+}
+
+
+// hardware/gpio.h
+
+void gpio_init(unsigned int gpio)
+{
+    assert(gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.out = false;
+    p.out_val = false;
+    pin_changed(gpio, was);
+}
+
+
+void gpio_put(unsigned int gpio, bool value)
+{
+    assert(gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.out_val = value;
+    pin_changed(gpio, was);
+}
+
+
+bool gpio_get(unsigned int gpio)
+{
+    assert(gpio < gpio_cnt);
+    tick();
+    return pin_level(st.pins[gpio]);
+}
+
+
+void gpio_set_dir(unsigned int gpio, bool out)
+{
+    assert(gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.out = out;
+    pin_changed(gpio, was);
+}
+
+
+void gpio_pull_down(unsigned int gpio)
+{
+    assert(gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.pull_down = true;
+    p.pull_up = false;
+    pin_changed(gpio, was);
+}
+
+
+void gpio_pull_up(unsigned int gpio)
+{
+    assert(gpio < gpio_cnt);
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    p.pull_up = true;
+    p.pull_down = false;
+    pin_changed(gpio, was);
+}
+
+
+void gpio_set_function(unsigned int gpio, gpio_function fn)
+{
+    assert(gpio < gpio_cnt);
+    // i2c lines idle high (external pull-ups)
+    Pin &p = st.pins[gpio];
+    bool was = pin_level(p);
+    if (fn == GPIO_FUNC_I2C) {
+        p.out = false;
+        p.pull_up = true;
+    }
+    pin_changed(gpio, was);
+}
+
+
+void gpio_set_irq_enabled(unsigned int gpio, uint32_t events, bool enabled)
+{
+    assert(gpio < gpio_cnt);
+    if (enabled)
+        st.pins[gpio].irq_en |= events;
+    else
+        st.pins[gpio].irq_en &= ~events;
+}
+
+
+void gpio_acknowledge_irq(unsigned int gpio, uint32_t events)
+{
+    assert(gpio < gpio_cnt);
+    st.pins[gpio].irq_latched &= ~events;
+}
+
+
+uint32_t gpio_get_irq_event_mask(unsigned int gpio)
+{
+    assert(gpio < gpio_cnt);
+    return st.pins[gpio].irq_latched & st.pins[gpio].irq_en;
+}
+
+
+void gpio_add_raw_irq_handler(unsigned int gpio, irq_handler_t handler)
+{
+    st.handlers.emplace_back(gpio, handler);
+}
+
+
+void gpio_remove_raw_irq_handler(unsigned int gpio, irq_handler_t handler)
+{
+    for (auto it = st.handlers.begin(); it != st.handlers.end(); it++) {
+        if (it->first == gpio && it->second == handler) {
+            st.handlers.erase(it);
+            return;
+        }
+    }
+}
+
+
+// hardware/irq.h
+
+void irq_set_enabled(unsigned int num, bool enabled)
+{
+    if (num == IO_IRQ_BANK0)
+        st.bank0_en = enabled;
+}
+
+
+// hardware/i2c.h
+
+struct i2c_inst {
+    int unused;
+};
+
+static i2c_inst i2c_inst_0;
+static i2c_inst i2c_inst_1;
+i2c_inst_t *const i2c0 = &i2c_inst_0;
+i2c_inst_t *const i2c1 = &i2c_inst_1;
+
+
+// i2c_dev.h
+
+I2cDev::I2cDev(i2c_inst_t *, int, int, uint32_t baud) :
+    _baud(baud),
+    _bus_timing(true),
+    _done_us(0),
+    _async_result(0),
+    _async_active(false),
+    _busy_cnt(0),
+    _inject_result(0),
+    _inject_cnt(0)
+{
+}
+
+
+bool I2cDev::injected(int &result)
+{
+    if (_inject_cnt <= 0)
+        return false;
+    _inject_cnt--;
+    result = _inject_result;
+    return true;
+}
+
+
+// Start, address + ack, { data + ack }n, stop
+void I2cDev::bus_time(int bits)
+{
+    if (_bus_timing)
+        sim::advance_us((uint64_t(bits) * 1'000'000 + _baud - 1) / _baud);
+}
+
+
+int I2cDev::write_sync(uint8_t addr, const uint8_t *buf, int buf_len, bool,
+                       uint)
+{
+    bus_time(11 + 9 * buf_len);
+    int result;
+    if (injected(result))
+        return result;
+    sim::Target *t = sim::target(addr);
+    if (t == nullptr)
+        return PICO_ERROR_GENERIC;
+    return t->write(buf, buf_len);
+}
+
+
+int I2cDev::read_sync(uint8_t addr, uint8_t *buf, int buf_len, bool, uint)
+{
+    bus_time(11 + 9 * buf_len);
+    int result;
+    if (injected(result))
+        return result;
+    sim::Target *t = sim::target(addr);
+    if (t == nullptr)
+        return PICO_ERROR_GENERIC;
+    return t->read(buf, buf_len);
+}
+
+
+bool I2cDev::busy()
+{
+    sim::advance_us(1); // polling costs something
+    if (_async_active && sim::now_us() < _done_us) {
+        _busy_cnt++;
+        return true;
+    }
+    return false;
+}
+
+
+void I2cDev::write_read_async_start(uint8_t addr, const uint8_t *wr_buf,
+                                    int wr_len, uint8_t *rd_buf, int rd_len)
+{
+    assert(!_async_active || sim::now_us() >= _done_us);
+
+    // The transaction happens now; it just doesn't look finished until the
+    // bus time has gone by.
+    sim::Target *t = sim::target(addr);
+    int bits = 11 + 9 * wr_len;
+    if (injected(_async_result)) {
+        // as if the target had not answered
+    } else if (t == nullptr) {
+        _async_result = PICO_ERROR_GENERIC;
+    } else {
+        _async_result = t->write(wr_buf, wr_len);
+        if (_async_result == wr_len && rd_len > 0) {
+            _async_result = t->read(rd_buf, rd_len);
+            bits += 11 + 9 * rd_len;
+        }
+    }
+
+    _done_us = sim::now_us();
+    if (_bus_timing)
+        _done_us += (uint64_t(bits) * 1'000'000 + _baud - 1) / _baud;
+    _async_active = true;
+}
+
+
+int I2cDev::write_read_async_check()
+{
+    assert(_async_active);
+    _async_active = false;
+    return _async_result;
+}
+
@@ -0,0 +1,46 @@
+#pragma once
+
+// Simulated clock, GPIOs and i2c targets behind the host stand-ins for
+// pico/stdlib.h, hardware/gpio.h and i2c_dev.h.
+
+#include <cstdint>
+
+
+namespace sim {
+
+// Clock. Every time_us_32() call also advances the clock by time_step_us
+// (default 1) so busy-wait loops in the drivers terminate.
+uint64_t now_us();
+void advance_us(uint64_t us);
+void time_step_us(uint32_t us);
+
+// GPIOs. A target drives a pin with drive(); the driver side sees it with
+// gpio_get() when the pin is an input. Edges run the raw IRQ handlers.
+void drive(int gpio, bool level);
+void release(int gpio);
+bool level(int gpio);
+bool is_output(int gpio);
+
+// i2c targets
+class Target
+{
+public:
+    virtual ~Target() = default;
+    // Return bytes accepted or PICO_ERROR_GENERIC (nack).
+    virtual int write(const uint8_t *buf, int buf_len) = 0;
+    virtual int read(uint8_t *buf, int buf_len) = 0;
+    // called as the simulated clock advances
+    virtual void tick(uint64_t now_us)
+    {
+        (void)now_us;
+    }
+};
+
+void attach(uint8_t addr, Target *target);
+void detach(uint8_t addr);
+Target *target(uint8_t addr);
+
+// back to time 0, pins released, no targets
+void reset();
+
+} // namespace sim
@@ -0,0 +1,133 @@
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+// host stand-ins
+#include "pico/stdlib.h"
+//
+#include "sim.h"
+#include "sim_ft6336u.h"
+
+
+SimFt6336u::SimFt6336u(int rst_gpio, int int_gpio) :
+    _rst_gpio(rst_gpio),
+    _int_gpio(int_gpio),
+    _ptr(0),
+    _in_reset(true),
+    _booted(false),
+    _release_us(0)
+{
+    power_on_regs();
+    sim::attach(addr, this);
+}
+
+
+SimFt6336u::~SimFt6336u()
+{
+    sim::detach(addr);
+}
+
+
+// From a Hosyond display's FT6336U (see the end of ft6336u.cpp).
+void SimFt6336u::power_on_regs()
+{
+    memset(_regs, 0, sizeof(_regs));
+    memset(_regs + 0x0f, 0xff, 0x80 - 0x0f);
+    static const uint8_t r80[] = {0x0f, 0x00, 0x00, 0x00, 0x00, 0xa0,
+                                  0x01, 0x1e, 0x0a, 0x28};
+    memcpy(_regs + 0x80, r80, sizeof(r80));
+    _regs[0x9f] = 0x26;
+    static const uint8_t ra0[] = {0x02, 0x05, 0x01, 0x64, 0x01, 0x00,
+                                  0xa3, 0x00, 0x11, 0x0f};
+    memcpy(_regs + 0xa0, ra0, sizeof(ra0));
+    _regs[0xaf] = 0x01;
+    _regs[0xbc] = 0x01;
+}
+
+
+void SimFt6336u::frame(const Point *pts, int n)
+{
+    assert(0 <= n && n <= touch_max);
+    if (!_booted)
+        return;
+    _regs[0x02] = uint8_t(n);
+    for (int t = 0; t < touch_max; t++) {
+        uint8_t *p = _regs + 0x03 + 6 * t;
+        if (t < n) {
+            p[0] = uint8_t((2 << 6) | ((pts[t].x >> 8) & 0x0f)); // contact
+            p[1] = uint8_t(pts[t].x);
+            p[2] = uint8_t((pts[t].id << 4) | ((pts[t].y >> 8) & 0x0f));
+            p[3] = uint8_t(pts[t].y);
+            p[4] = uint8_t(pts[t].weight);
+            p[5] = uint8_t(pts[t].area << 4);
+        } else {
+            memset(p, 0xff, 6);
+        }
+    }
+    int_update(true);
+}
+
+
+// G_MODE (0xa4) 0: INT low while touched; 1: INT pulses low per frame
+void SimFt6336u::int_update(bool pulse)
+{
+    if (_int_gpio < 0 || !_booted)
+        return;
+    bool touched = (_regs[0x02] & 0x0f) != 0;
+    if (_regs[0xa4] == 0) {
+        sim::drive(_int_gpio, !touched);
+    } else if (pulse) {
+        sim::drive(_int_gpio, false);
+        sim::drive(_int_gpio, true);
+    }
+}
+
+
+int SimFt6336u::write(const uint8_t *buf, int buf_len)
+{
+    if (!_booted || buf_len < 1)
+        return PICO_ERROR_GENERIC;
+    _ptr = buf[0];
+    for (int i = 1; i < buf_len; i++)
+        _regs[_ptr++] = buf[i];
+    if (buf_len > 1)
+        int_update(false);
+    return buf_len;
+}
+
+
+int SimFt6336u::read(uint8_t *buf, int buf_len)
+{
+    if (!_booted)
+        return PICO_ERROR_GENERIC;
+    for (int i = 0; i < buf_len; i++)
+        buf[i] = _regs[_ptr++];
+    return buf_len;
+}
+
+
+void SimFt6336u::tick(uint64_t now_us)
+{
+    if (_rst_gpio < 0)
+        return;
+
+    bool rst = sim::level(_rst_gpio);
+    if (!rst) {
+        if (!_in_reset && _int_gpio >= 0)
+            sim::release(_int_gpio);
+        _in_reset = true;
+        _booted = false;
+        return;
+    }
+
+    if (_in_reset) {
+        _in_reset = false;
+        _release_us = now_us;
+        power_on_regs();
+    }
+
+    if (!_booted && now_us - _release_us >= boot_us) {
+        _booted = true;
+        if (_int_gpio >= 0)
+            sim::drive(_int_gpio, true);
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "sim.h"
+
+
+// Register-level FT6336U model
+//
+// 256 one-byte registers with an auto-incrementing pointer, initialized
+// from a real part's dump. Holding RST low resets it; it NACKs until boot_us
+// after RST goes high, then drives INT high. With G_MODE = 0 INT is held low
+// while there are touches; with G_MODE = 1 it pulses low for each frame.
+class SimFt6336u : public sim::Target
+{
+public:
+
+    static constexpr uint8_t addr = 0x38;
+    static constexpr int touch_max = 2;
+    static constexpr uint32_t boot_us = 125'000;
+
+    struct Point {
+        int id;
+        int x, y;
+        int weight;
+        int area;
+    };
+
+    SimFt6336u(int rst_gpio, int int_gpio);
+
+    virtual ~SimFt6336u();
+
+    void frame(const Point *pts, int n);
+
+    bool booted() const
+    {
+        return _booted;
+    }
+
+    uint8_t reg(uint8_t r) const
+    {
+        return _regs[r];
+    }
+
+    void reg(uint8_t r, uint8_t v)
+    {
+        _regs[r] = v;
+    }
+
+    virtual int write(const uint8_t *buf, int buf_len) override;
+    virtual int read(uint8_t *buf, int buf_len) override;
+    virtual void tick(uint64_t now_us) override;
+
+private:
+
+    const int _rst_gpio;
+    const int _int_gpio;
+
+    uint8_t _regs[256];
+    uint8_t _ptr;
+
+    bool _in_reset;
+    bool _booted;
+    uint64_t _release_us;
+
+    void power_on_regs();
+    void int_update(bool pulse);
+};
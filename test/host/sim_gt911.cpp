@@ -0,0 +1,149 @@
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+// host stand-ins
+#include "pico/stdlib.h"
+//
+#include "sim.h"
+#include "sim_gt911.h"
+
+
+SimGt911::SimGt911(uint8_t addr, int int_gpio, int x_res, int y_res) :
+    _addr(addr),
+    _int_gpio(int_gpio),
+    _ptr(reg_base),
+    _frames_dropped(0),
+    _config_loads(0),
+    _config_rejects(0)
+{
+    memset(_regs, 0, sizeof(_regs));
+
+    // vendor ID '9' '1' '1' '\0'
+    reg(0x8140, '9');
+    reg(0x8141, '1');
+    reg(0x8142, '1');
+    reg(0x8143, '\0');
+
+    reg(0x8146, uint8_t(x_res));
+    reg(0x8147, uint8_t(x_res >> 8));
+    reg(0x8148, uint8_t(y_res));
+    reg(0x8149, uint8_t(y_res >> 8));
+
+    reg(CONFIG, 0x41);    // config version
+    reg(0x8048, uint8_t(x_res));
+    reg(0x8049, uint8_t(x_res >> 8));
+    reg(0x804a, uint8_t(y_res));
+    reg(0x804b, uint8_t(y_res >> 8));
+    reg(0x804c, touch_max);
+    reg(SWITCH_1, 0x81);  // y2y=1 x2x=0, INT falling
+    reg(0x8053, 0x3c);    // touch threshold
+    reg(0x8054, 0x28);    // leave threshold
+    reg(0x8056, 0x05);    // report every 10 msec
+    reg(CONFIG_CHKSUM, config_checksum());
+    memcpy(_config, &_regs[CONFIG - reg_base], sizeof(_config));
+
+    sim::attach(_addr, this);
+}
+
+
+SimGt911::~SimGt911()
+{
+    sim::detach(_addr);
+}
+
+
+bool SimGt911::frame(const Point *pts, int n)
+{
+    assert(0 <= n && n <= touch_max);
+
+    if ((reg(TOUCH_STAT) & 0x80) != 0) {
+        _frames_dropped++;
+        return false;
+    }
+
+    // record t at 0x814f + 8 * t: id, x_lo, x_hi, y_lo, y_hi, s_lo, s_hi, 0
+    for (int t = 0; t < n; t++) {
+        uint16_t r = TOUCH_STAT + 1 + 8 * t;
+        reg(r + 0, uint8_t(pts[t].id));
+        reg(r + 1, uint8_t(pts[t].x));
+        reg(r + 2, uint8_t(pts[t].x >> 8));
+        reg(r + 3, uint8_t(pts[t].y));
+        reg(r + 4, uint8_t(pts[t].y >> 8));
+        reg(r + 5, uint8_t(pts[t].size));
+        reg(r + 6, uint8_t(pts[t].size >> 8));
+        reg(r + 7, 0);
+    }
+    reg(TOUCH_STAT, uint8_t(0x80 | n));
+
+    int_pulse();
+    return true;
+}
+
+
+// INT idles at the inactive level and pulses to the active one.
+void SimGt911::int_pulse()
+{
+    if (_int_gpio < 0 || sim::is_output(_int_gpio))
+        return;
+    bool active_hi = (reg(SWITCH_1) & 0x03) == 0 || (reg(SWITCH_1) & 0x03) == 3;
+    sim::drive(_int_gpio, !active_hi);
+    sim::drive(_int_gpio, active_hi);
+    sim::drive(_int_gpio, !active_hi);
+}
+
+
+uint8_t SimGt911::config_checksum() const
+{
+    uint8_t sum = 0;
+    for (uint16_t r = CONFIG; r < CONFIG_CHKSUM; r++)
+        sum += reg(r);
+    return uint8_t(~sum + 1);
+}
+
+
+void SimGt911::config_load()
+{
+    uint8_t *block = &_regs[CONFIG - reg_base];
+    if (reg(CONFIG_CHKSUM) == config_checksum() && block[0] >= _config[0]) {
+        memcpy(_config, block, sizeof(_config));
+        _config_loads++;
+    } else {
+        memcpy(block, _config, sizeof(_config));
+        _config_rejects++;
+    }
+    reg(CONFIG_FRESH, 0);
+}
+
+
+// First two bytes are the register address (big-endian); anything after
+// that is data, auto-incrementing.
+int SimGt911::write(const uint8_t *buf, int buf_len)
+{
+    if (buf_len < 2)
+        return PICO_ERROR_GENERIC;
+    _ptr = uint16_t((buf[0] << 8) | buf[1]);
+    bool fresh = false;
+    for (int i = 2; i < buf_len; i++) {
+        if (_ptr < reg_base || _ptr >= reg_base + reg_cnt)
+            return PICO_ERROR_GENERIC;
+        reg(_ptr, buf[i]);
+        if (_ptr == CONFIG_FRESH && buf[i] != 0)
+            fresh = true;
+        _ptr++;
+    }
+    if (fresh)
+        config_load();
+    return buf_len;
+}
+
+
+int SimGt911::read(uint8_t *buf, int buf_len)
+{
+    for (int i = 0; i < buf_len; i++) {
+        if (_ptr < reg_base || _ptr >= reg_base + reg_cnt)
+            return PICO_ERROR_GENERIC;
+        buf[i] = reg(_ptr);
+        _ptr++;
+    }
+    return buf_len;
+}
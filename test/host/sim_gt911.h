@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+//
+#include "sim.h"
+
+
+// Register-level GT911 model
+//
+// Covers what the driver touches: vendor ID, resolution, SWITCH_1, the
+// status register (bit 7 = buffer ready, [3:0] = touch count, cleared by
+// writing it) and the 8-byte point records after it. A new frame is only
+// latched if the host has cleared the previous one, like the real chip, and
+// each latched frame pulses INT per SWITCH_1[1:0].
+//
+// The config block (0x8047 - 0x80fe) is loaded when the host writes 1 to
+// the config-fresh flag (0x8100). A config with a bad checksum (0x80ff) or
+// an older version is rejected and the block goes back to the last one
+// loaded.
+class SimGt911 : public sim::Target
+{
+public:
+
+    static constexpr int touch_max = 5;
+
+    struct Point {
+        int id;
+        int x, y;
+        int size;
+    };
+
+    SimGt911(uint8_t addr, int int_gpio = -1, int x_res = 320,
+             int y_res = 480);
+
+    virtual ~SimGt911();
+
+    // Present a new frame (n == 0 is a release frame). Returns false if the
+    // host has not cleared the previous one.
+    bool frame(const Point *pts, int n);
+
+    uint8_t reg(uint16_t r) const
+    {
+        return _regs[r - reg_base];
+    }
+
+    void reg(uint16_t r, uint8_t v)
+    {
+        _regs[r - reg_base] = v;
+    }
+
+    // frames offered but not latched because status was not cleared
+    int frames_dropped() const
+    {
+        return _frames_dropped;
+    }
+
+    // configs loaded and rejected since construction
+    int config_loads() const
+    {
+        return _config_loads;
+    }
+
+    int config_rejects() const
+    {
+        return _config_rejects;
+    }
+
+    virtual int write(const uint8_t *buf, int buf_len) override;
+    virtual int read(uint8_t *buf, int buf_len) override;
+
+private:
+
+    static constexpr uint16_t reg_base = 0x8000;
+    static constexpr int reg_cnt = 0x200;
+
+    static constexpr uint16_t CONFIG = 0x8047;
+    static constexpr uint16_t SWITCH_1 = 0x804d;
+    static constexpr uint16_t CONFIG_CHKSUM = 0x80ff;
+    static constexpr uint16_t CONFIG_FRESH = 0x8100;
+    static constexpr uint16_t TOUCH_STAT = 0x814e;
+
+    const uint8_t _addr;
+    const int _int_gpio;
+
+    uint8_t _regs[reg_cnt];
+    uint16_t _ptr;
+
+    int _frames_dropped;
+
+    // last config loaded, through the checksum
+    uint8_t _config[CONFIG_CHKSUM + 1 - CONFIG];
+    int _config_loads;
+    int _config_rejects;
+
+    void int_pulse();
+    uint8_t config_checksum() const;
+    void config_load();
+};
@@ -0,0 +1,220 @@
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+// host stand-ins
+#include "pico/stdlib.h"
+// touchscreen
+#include "touch_trace.h"
+#include "touchscreen.h"
+//
+#include "sim.h"
+#include "trace_replay.h"
+
+
+TraceReplay::TraceReplay(uint8_t i2c_addr, int reg_len, int int_gpio,
+                         bool int_rising) :
+    _i2c_addr(i2c_addr),
+    _reg_len(reg_len),
+    _int_gpio(int_gpio),
+    _int_rising(int_rising),
+    _next(0),
+    _start_us(0),
+    _regs(size_t(1) << (8 * reg_len), 0),
+    _known(size_t(1) << (8 * reg_len), false),
+    _ptr(0),
+    _err(0),
+    _unknown_reads(0)
+{
+    assert(reg_len == 1 || reg_len == 2);
+}
+
+
+TraceReplay::~TraceReplay()
+{
+    if (sim::target(_i2c_addr) == this)
+        sim::detach(_i2c_addr);
+}
+
+
+bool TraceReplay::load(const uint8_t *buf, int buf_len)
+{
+    while (buf_len > 0) {
+        TouchTrace::Record r;
+        int len = TouchTrace::parse(buf, buf_len, r);
+        if (len == 0)
+            return false;
+        if (r.type == TouchTrace::irq || r.i2c_addr == _i2c_addr) {
+            Rec rec;
+            rec.type = r.type;
+            rec.i2c_addr = r.i2c_addr;
+            rec.result = r.result;
+            rec.time_us = r.time_us;
+            rec.wr.assign(r.wr, r.wr + r.wr_len);
+            rec.rd.assign(r.rd, r.rd + r.rd_len);
+            _recs.push_back(rec);
+        }
+        buf += len;
+        buf_len -= len;
+    }
+    return true;
+}
+
+
+bool TraceReplay::load_hex(FILE *f)
+{
+    char line[2 * TouchTrace::rec_max + 16];
+    uint8_t rec[TouchTrace::rec_max];
+    while (fgets(line, sizeof(line), f) != nullptr) {
+        int len = TouchTrace::unhex(line, rec, sizeof(rec));
+        if (len > 0 && !load(rec, len))
+            return false;
+    }
+    return true;
+}
+
+
+void TraceReplay::start()
+{
+    _next = 0;
+    _start_us = sim::now_us();
+    sim::attach(_i2c_addr, this);
+}
+
+
+uint64_t TraceReplay::next_us() const
+{
+    if (done())
+        return UINT64_MAX;
+    // times are time_us_32(), so differences are rollover-safe
+    return _start_us + uint32_t(_recs[_next].time_us - _recs[0].time_us);
+}
+
+
+// The clock only jumps when the driver is waiting: no transfer in flight
+// and a few calls in a row that neither returned an event nor started a
+// transfer. Then it goes straight to the next record (the driver is waiting
+// on INT or its poll timer, and the recorded driver acted at that time).
+int TraceReplay::run(Touchscreen &ts, I2cDev &i2c, const EventFn &on_event)
+{
+    constexpr int quiet_calls = 3;
+    constexpr uint32_t idle_step_us = 1'000;
+
+    int events = 0;
+    int quiet = 0;
+    uint32_t transactions = ts.bus_stats().transactions;
+    // once the records run out, give the driver a moment to finish up
+    uint64_t end_us = UINT64_MAX;
+    while (sim::now_us() < end_us) {
+        Touchscreen::Event event = ts.get_event();
+        if (event.type != Touchscreen::Event::Type::none) {
+            events++;
+            if (on_event)
+                on_event(event);
+            quiet = 0;
+            continue;
+        }
+        if (done() && end_us == UINT64_MAX)
+            end_us = sim::now_us() + 50'000;
+
+        uint32_t t = ts.bus_stats().transactions;
+        quiet = t == transactions ? quiet + 1 : 0;
+        transactions = t;
+
+        uint64_t now_us = sim::now_us();
+        uint64_t to_us;
+        if (i2c.done_us() > now_us)
+            to_us = i2c.done_us(); // transfer in flight
+        else if (quiet >= quiet_calls)
+            to_us = now_us + idle_step_us;
+        else
+            continue;
+        if (next_us() < to_us)
+            to_us = next_us();
+        if (to_us > now_us)
+            sim::advance_us(to_us - now_us);
+    }
+    return events;
+}
+
+
+void TraceReplay::tick(uint64_t now_us)
+{
+    while (!done() && next_us() <= now_us) {
+        const Rec &rec = _recs[_next++];
+        if (rec.type != TouchTrace::irq) {
+            apply(rec);
+            continue;
+        }
+        // the data the edge announced, then the edge
+        while (!done() && _recs[_next].type != TouchTrace::irq &&
+               !_recs[_next].rd.empty())
+            apply(_recs[_next++]);
+        int_pulse();
+    }
+}
+
+
+// Update the register image from one recorded transaction. Only reads go
+// in: the driver under test makes its own writes (e.g. clearing the GT911
+// status), and replaying the recorded ones on the recorded schedule could
+// wipe out data the driver has not picked up yet.
+void TraceReplay::apply(const Rec &rec)
+{
+    if (rec.result < 0) {
+        _err = rec.result;
+        return;
+    }
+    if (int(rec.wr.size()) < _reg_len)
+        return;
+    uint32_t reg = rec.wr[0];
+    if (_reg_len == 2)
+        reg = (reg << 8) | rec.wr[1];
+    uint32_t mask = uint32_t(_regs.size() - 1);
+    for (uint8_t b : rec.rd) {
+        _regs[reg & mask] = b;
+        _known[reg & mask] = true;
+        reg++;
+    }
+}
+
+
+void TraceReplay::int_pulse()
+{
+    if (_int_gpio < 0 || sim::is_output(_int_gpio))
+        return;
+    sim::drive(_int_gpio, !_int_rising);
+    sim::drive(_int_gpio, _int_rising);
+    sim::drive(_int_gpio, !_int_rising);
+}
+
+
+int TraceReplay::write(const uint8_t *buf, int buf_len)
+{
+    if (_err != 0) {
+        int err = _err;
+        _err = 0;
+        return err;
+    }
+    if (buf_len < _reg_len)
+        return PICO_ERROR_GENERIC;
+    uint32_t mask = uint32_t(_regs.size() - 1);
+    _ptr = buf[0];
+    if (_reg_len == 2)
+        _ptr = (_ptr << 8) | buf[1];
+    for (int i = _reg_len; i < buf_len; i++, _ptr++)
+        _regs[_ptr & mask] = buf[i];
+    return buf_len;
+}
+
+
+int TraceReplay::read(uint8_t *buf, int buf_len)
+{
+    uint32_t mask = uint32_t(_regs.size() - 1);
+    for (int i = 0; i < buf_len; i++, _ptr++) {
+        if (!_known[_ptr & mask])
+            _unknown_reads++;
+        buf[i] = _regs[_ptr & mask];
+    }
+    return buf_len;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <vector>
+// host stand-ins
+#include "i2c_dev.h"
+// touchscreen
+#include "touchscreen.h"
+//
+#include "sim.h"
+
+
+// Plays a TouchTrace back to a driver on the host
+//
+// Stands in for the controller on the simulated bus. The controller's
+// registers are rebuilt from what the trace says was read, as of the
+// simulated time, so the driver under test does not have to issue
+// exactly the reads the recorded one did: it sees what the chip would have
+// shown it. INT edges are replayed on int_gpio, with the reads that followed
+// each edge applied first so the data is there when the driver looks. A
+// recorded error result comes back from the driver's next transaction.
+//
+// run() drives a Touchscreen through the whole trace, skipping the clock
+// ahead over idle time, so hours of recording replay in seconds, the same
+// way every time. Start it where the recording started: after init() and a
+// first get_event().
+class TraceReplay : public sim::Target
+{
+public:
+
+    // reg_len is the register address size: 2 for GT911, 1 for FT6336U
+    TraceReplay(uint8_t i2c_addr, int reg_len, int int_gpio = -1,
+                bool int_rising = false);
+
+    virtual ~TraceReplay();
+
+    // add records (raw, as from TouchTrace::take())
+    bool load(const uint8_t *buf, int buf_len);
+
+    // add records from "tt " lines; other lines are skipped
+    bool load_hex(FILE *f);
+
+    int records() const
+    {
+        return int(_recs.size());
+    }
+
+    // Takes over i2c_addr on the simulated bus and maps the first record's
+    // time to now.
+    void start();
+
+    bool done() const
+    {
+        return _next >= _recs.size();
+    }
+
+    // simulated time of the next record
+    uint64_t next_us() const;
+
+    // Replay everything through ts, which is on i2c. Returns the number of
+    // events; on_event (if given) sees each one.
+    using EventFn = std::function<void(const Touchscreen::Event &)>;
+    int run(Touchscreen &ts, I2cDev &i2c, const EventFn &on_event = nullptr);
+
+    // reads of registers the trace had not shown yet
+    uint32_t unknown_reads() const
+    {
+        return _unknown_reads;
+    }
+
+    virtual int write(const uint8_t *buf, int buf_len) override;
+    virtual int read(uint8_t *buf, int buf_len) override;
+    virtual void tick(uint64_t now_us) override;
+
+private:
+
+    struct Rec {
+        uint8_t type;
+        uint8_t i2c_addr;
+        int16_t result;
+        uint32_t time_us;
+        std::vector<uint8_t> wr;
+        std::vector<uint8_t> rd;
+    };
+
+    const uint8_t _i2c_addr;
+    const int _reg_len;
+    const int _int_gpio;
+    const bool _int_rising;
+
+    std::vector<Rec> _recs;
+    size_t _next;
+    uint64_t _start_us;
+
+    std::vector<uint8_t> _regs;
+    std::vector<bool> _known;
+    uint32_t _ptr;
+
+    int _err; // returned by the next transaction if not 0
+    uint32_t _unknown_reads;
+
+    void apply(const Rec &rec);
+    void int_pulse();
+};